@@ -0,0 +1,448 @@
+/*============================================================================
+ * libebookinfo
+ * bench.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+/*============================================================================
+Benchmark driver. Runs the library over a corpus of files a number of
+times, timing each phase of reading a book separately, and reports
+throughput and latency per format. With --pool, it also holds the 
+metadata of the whole corpus at once, as a catalog in memory would,
+with and without a string pool, and reports the memory each takes
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <ebookinfo/ebookinfo.h>
+
+// The phases of reading a book. Each corresponds to one library call,
+//  so that a regression can be pinned on a particular stage of a
+//  particular format
+#define PHASE_SNIFF    0 // ebook_probe()
+#define PHASE_OPEN     1 // ebook_open()
+#define PHASE_METADATA 2 // ebook_get_metadata()
+#define PHASE_CLOSE    3 // ebookmetadata_destroy() and ebook_close()
+#define N_PHASES       4
+
+// EBOOK_TYPE_ constants are small and dense; the last slot is for
+//  files that no format recognizes
+#define MAX_TYPES      8
+
+static const char *phase_names[N_PHASES] =
+  { "sniff", "open", "metadata", "close" };
+
+typedef struct _Samples
+  {
+  uint64_t *ns;
+  int n;
+  int size;
+  } Samples;
+
+typedef struct _FormatStats
+  {
+  int files;
+  int errors;
+  uint64_t bytes;
+  uint64_t total_ns;
+  Samples phases[N_PHASES];
+  uint64_t allocations;      // Made by ebook_get_metadata(), with -a
+  uint64_t alloc_bytes;
+  size_t alloc_peak;
+  } FormatStats;
+
+typedef struct _Corpus
+  {
+  char **paths;
+  off_t *sizes;
+  int n;
+  int size;
+  } Corpus;
+
+static Corpus corpus;
+static BOOL count_allocs;
+static BOOL hold;
+
+
+/*============================================================================
+now_ns
+============================================================================*/
+static uint64_t now_ns (void)
+  {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+
+/*============================================================================
+samples_add
+============================================================================*/
+static void samples_add (Samples *s, uint64_t ns)
+  {
+  if (s->n == s->size)
+    {
+    s->size = s->size ? s->size * 2 : 256;
+    s->ns = realloc (s->ns, s->size * sizeof (uint64_t));
+    }
+  s->ns[s->n++] = ns;
+  }
+
+
+/*============================================================================
+compare_ns
+============================================================================*/
+static int compare_ns (const void *a, const void *b)
+  {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+  }
+
+
+/*============================================================================
+samples_percentile
+Nearest-rank percentile; the samples must already be sorted
+============================================================================*/
+static double samples_percentile (const Samples *s, int p)
+  {
+  if (s->n == 0) return 0;
+  int rank = (int)((p * (long)s->n + 99) / 100);
+  if (rank < 1) rank = 1;
+  return s->ns[rank - 1] / 1000.0;
+  }
+
+
+/*============================================================================
+add_file
+nftw() callback
+============================================================================*/
+static int add_file (const char *path, const struct stat *sb, int flag,
+      struct FTW *ftw)
+  {
+  if (flag != FTW_F || !S_ISREG (sb->st_mode)) return 0;
+  if (corpus.n == corpus.size)
+    {
+    corpus.size = corpus.size ? corpus.size * 2 : 256;
+    corpus.paths = realloc (corpus.paths, corpus.size * sizeof (char *));
+    corpus.sizes = realloc (corpus.sizes, corpus.size * sizeof (off_t));
+    }
+  corpus.paths[corpus.n] = strdup (path);
+  corpus.sizes[corpus.n] = sb->st_size;
+  corpus.n++;
+  return 0;
+  }
+
+
+/*============================================================================
+run_file
+============================================================================*/
+static void run_file (FormatStats *stats, const char *path, off_t size)
+  {
+  uint64_t t[N_PHASES + 1];
+  char *error = NULL;
+
+  t[0] = now_ns ();
+  int type = ebook_probe (path, NULL, &error);
+  t[1] = now_ns ();
+
+  FormatStats *fs = &stats[(type >= 0 && type < MAX_TYPES - 1)
+     ? type : MAX_TYPES - 1];
+  if (error || type == EBOOK_TYPE_UNKNOWN)
+    {
+    fs->errors++;
+    free (error);
+    return;
+    }
+
+  EBook *ebook = ebook_open (path, &error);
+  t[2] = now_ns ();
+  if (!ebook)
+    {
+    fs->errors++;
+    free (error);
+    return;
+    }
+
+  if (count_allocs) ebook_alloc_stats_reset ();
+  EBookMetadata *metadata = ebook_get_metadata (ebook, &error);
+  t[3] = now_ns ();
+  if (metadata && count_allocs)
+    {
+    EBookAllocStats as;
+    ebook_alloc_stats_get (&as);
+    fs->allocations += as.allocations;
+    fs->alloc_bytes += as.bytes;
+    if (as.peak > fs->alloc_peak) fs->alloc_peak = as.peak;
+    }
+  if (metadata)
+    ebookmetadata_destroy (metadata);
+  else
+    {
+    fs->errors++;
+    free (error);
+    }
+  ebook_close (ebook);
+  t[4] = now_ns ();
+
+  if (!metadata) return;
+
+  int p;
+  for (p = 0; p < N_PHASES; p++)
+    samples_add (&fs->phases[p], t[p + 1] - t[p]);
+  fs->files++;
+  fs->bytes += size;
+  fs->total_ns += t[N_PHASES] - t[0];
+  }
+
+
+/*============================================================================
+hold_corpus
+Read every book's metadata and keep it all, through pool if it is not
+NULL, and return the library memory then in use, which is the 
+metadata's and the pool's; the books themselves have been closed
+============================================================================*/
+static size_t hold_corpus (EBookStringPool *pool, int *books)
+  {
+  EBookMetadata **held = calloc (corpus.n, sizeof (EBookMetadata *));
+  int i;
+  *books = 0;
+  ebook_alloc_stats_reset ();
+  for (i = 0; i < corpus.n; i++)
+    {
+    char *error = NULL;
+    EBook *ebook = ebook_open (corpus.paths[i], &error);
+    if (!ebook)
+      {
+      free (error);
+      continue;
+      }
+    ebook_set_string_pool (ebook, pool);
+    held[i] = ebook_get_metadata (ebook, &error);
+    if (held[i]) 
+      (*books)++;
+    else
+      free (error);
+    ebook_close (ebook);
+    }
+  EBookAllocStats as;
+  ebook_alloc_stats_get (&as);
+  for (i = 0; i < corpus.n; i++)
+    if (held[i]) ebookmetadata_destroy (held[i]);
+  free (held);
+  return as.live;
+  }
+
+
+/*============================================================================
+report_hold
+============================================================================*/
+static void report_hold (BOOL json)
+  {
+  int books;
+  size_t plain = hold_corpus (NULL, &books);
+  EBookStringPool *pool = ebookstringpool_create ();
+  size_t pooled = hold_corpus (pool, &books);
+  size_t strings, pool_bytes;
+  ebookstringpool_get_stats (pool, &strings, &pool_bytes);
+  ebookstringpool_destroy (pool);
+
+  if (json)
+    printf ("{\"held_books\":%d,\"plain_bytes\":%zu,\"pooled_bytes\":%zu,"
+      "\"pool_strings\":%zu,\"pool_bytes\":%zu}\n", books, plain, pooled,
+      strings, pool_bytes);
+  else
+    printf ("Holding %d books' metadata: %zu bytes; with a string pool, "
+      "%zu bytes (%.0f%%),\nof which the pool has %zu bytes for %zu "
+      "strings\n", books, plain, pooled, 
+      plain ? 100.0 * pooled / plain : 0, pool_bytes, strings);
+  }
+
+
+/*============================================================================
+format_name
+============================================================================*/
+static const char *format_name (int slot)
+  {
+  return slot == MAX_TYPES - 1 ? "unknown" : ebook_type_name (slot);
+  }
+
+
+/*============================================================================
+report_text
+============================================================================*/
+static void report_text (FormatStats *stats, int iterations)
+  {
+  int i, p;
+  printf ("%d files, %d iterations\n", corpus.n, iterations);
+  printf ("%-8s %7s %6s %10s %8s  %-9s %10s %10s\n", "format", "files",
+    "errors", "files/s", "MB/s", "phase", "p50 us", "p99 us");
+  for (i = 0; i < MAX_TYPES; i++)
+    {
+    FormatStats *fs = &stats[i];
+    if (fs->files == 0 && fs->errors == 0) continue;
+    double secs = fs->total_ns / 1e9 / iterations;
+    printf ("%-8s %7d %6d %10.1f %8.2f", format_name (i), fs->files,
+      fs->errors, secs > 0 ? fs->files / secs : 0,
+      secs > 0 ? fs->bytes / 1048576.0 / secs : 0);
+    if (fs->files == 0) printf ("\n");
+    for (p = 0; p < N_PHASES && fs->files; p++)
+      {
+      if (p > 0) printf ("%-8s %7s %6s %10s %8s", "", "", "", "", "");
+      printf ("  %-9s %10.1f %10.1f\n", phase_names[p],
+        samples_percentile (&fs->phases[p], 50),
+        samples_percentile (&fs->phases[p], 99));
+      }
+    if (count_allocs && fs->files)
+      printf ("%-8s metadata: %.1f allocations, %.0f bytes per call; "
+        "peak %zu bytes\n", "", 
+        (double)fs->allocations / fs->phases[PHASE_METADATA].n,
+        (double)fs->alloc_bytes / fs->phases[PHASE_METADATA].n,
+        fs->alloc_peak);
+    }
+  }
+
+
+/*============================================================================
+report_json
+One object, so that the results of different releases can be stored
+and compared by script
+============================================================================*/
+static void report_json (FormatStats *stats, int iterations)
+  {
+  int i, p, first = TRUE;
+  printf ("{\"version\":\"%s\",\"files\":%d,\"iterations\":%d,\"formats\":[",
+    VERSION, corpus.n, iterations);
+  for (i = 0; i < MAX_TYPES; i++)
+    {
+    FormatStats *fs = &stats[i];
+    if (fs->files == 0 && fs->errors == 0) continue;
+    double secs = fs->total_ns / 1e9 / iterations;
+    printf ("%s\n{\"format\":\"%s\",\"files\":%d,\"errors\":%d,"
+      "\"bytes\":%llu,\"files_per_sec\":%.2f,\"mb_per_sec\":%.3f,"
+      "\"phases\":{", first ? "" : ",", format_name (i), fs->files,
+      fs->errors, (unsigned long long)fs->bytes,
+      secs > 0 ? fs->files / secs : 0,
+      secs > 0 ? fs->bytes / 1048576.0 / secs : 0);
+    for (p = 0; p < N_PHASES; p++)
+      {
+      printf ("%s\"%s\":{\"p50_us\":%.2f,\"p99_us\":%.2f}", p ? "," : "",
+        phase_names[p], samples_percentile (&fs->phases[p], 50),
+        samples_percentile (&fs->phases[p], 99));
+      }
+    printf ("}");
+    if (count_allocs && fs->files)
+      printf (",\"metadata_allocs\":{\"allocations_per_call\":%.1f,"
+        "\"bytes_per_call\":%.0f,\"peak_bytes\":%zu}",
+        (double)fs->allocations / fs->phases[PHASE_METADATA].n,
+        (double)fs->alloc_bytes / fs->phases[PHASE_METADATA].n,
+        fs->alloc_peak);
+    printf ("}");
+    first = FALSE;
+    }
+  printf ("\n]}\n");
+  }
+
+
+/*============================================================================
+main
+============================================================================*/
+int main (int argc, char **argv)
+  {
+  int iterations = 10;
+  BOOL json = FALSE;
+  BOOL show_usage = FALSE;
+
+  static struct option long_options[] =
+   {
+     {"iterations", required_argument, NULL, 'n'},
+     {"json", no_argument, NULL, 'j'},
+     {"allocs", no_argument, NULL, 'a'},
+     {"pool", no_argument, NULL, 'p'},
+     {"help", no_argument, NULL, '?'},
+     {0, 0, 0, 0}
+   };
+
+  int opt;
+  while ((opt = getopt_long (argc, argv, "?ajn:p", long_options, NULL)) != -1)
+    {
+    switch (opt)
+      {
+      case 'n': iterations = atoi (optarg); break;
+      case 'j': json = TRUE; break;
+      case 'a': count_allocs = TRUE; break;
+      case 'p': hold = TRUE; break;
+      default: show_usage = TRUE; break;
+      }
+    }
+
+  if (show_usage || optind == argc || iterations < 1)
+    {
+    printf ("Usage %s [options] {files or directories}\n", argv[0]);
+    printf ("  -n, --iterations N    read the corpus N times (default 10)\n");
+    printf ("  -a, --allocs          count allocations by ebook_get_metadata()\n");
+    printf ("  -j, --json            write the results as JSON\n");
+    printf ("  -p, --pool            compare the memory held by the metadata of\n"
+            "                        the whole corpus, with and without a string pool\n");
+    printf ("  -?                    show this message\n");
+    exit (show_usage ? 0 : -1);
+    }
+
+  int i, n;
+  for (i = optind; i < argc; i++)
+    {
+    if (nftw (argv[i], add_file, 16, FTW_PHYS) != 0)
+      {
+      fprintf (stderr, "Can't read %s\n", argv[i]);
+      exit (-1);
+      }
+    }
+  if (corpus.n == 0)
+    {
+    fprintf (stderr, "No files in corpus\n");
+    exit (-1);
+    }
+
+  if (count_allocs || hold) 
+    ebook_set_allocator (ebook_counting_allocator ());
+
+  FormatStats stats[MAX_TYPES];
+  memset (stats, 0, sizeof (stats));
+
+  // One untimed pass to warm the page cache, so that all timed
+  //  iterations measure the library rather than the disk
+  FormatStats warm[MAX_TYPES];
+  memset (warm, 0, sizeof (warm));
+  for (i = 0; i < corpus.n; i++)
+    run_file (warm, corpus.paths[i], corpus.sizes[i]);
+
+  for (n = 0; n < iterations; n++)
+    for (i = 0; i < corpus.n; i++)
+      run_file (stats, corpus.paths[i], corpus.sizes[i]);
+
+  for (i = 0; i < MAX_TYPES; i++)
+    {
+    int p;
+    for (p = 0; p < N_PHASES; p++)
+      qsort (stats[i].phases[p].ns, stats[i].phases[p].n,
+        sizeof (uint64_t), compare_ns);
+    // Files and errors are counted once per file, not once per iteration
+    stats[i].files /= iterations;
+    stats[i].bytes /= iterations;
+    stats[i].errors /= iterations;
+    }
+
+  if (json)
+    report_json (stats, iterations);
+  else
+    report_text (stats, iterations);
+  if (hold) report_hold (json);
+
+  return 0;
+  }
+
@@ -0,0 +1,706 @@
+/*============================================================================
+ * libebookinfo
+ * mkcorpus.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+/*============================================================================
+Synthetic corpus generator for the benchmarks. Writes EPUB, MOBI and
+RTF files that exercise both the common case and the pathological
+ones -- huge OPFs, thousands of PDB records, RTF meta-data beyond the
+part of the file that is searched -- without needing real books. The
+output depends only on the seed and the options, so the same corpus
+can be regenerated anywhere
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <ebookinfo/constants.h>
+
+typedef struct _Buf
+  {
+  unsigned char *data;
+  size_t length;
+  size_t size;
+  } Buf;
+
+typedef struct _Zip
+  {
+  FILE *f;
+  Buf central;
+  int count;
+  uint32_t offset;
+  } Zip;
+
+typedef struct _Options
+  {
+  int count;      // Files of each kind
+  int scale;      // Multiplies every size
+  const char *dir;
+  } Options;
+
+static uint64_t rng_state;
+
+static const char *syllables[] =
+  {
+  "an", "ber", "cal", "dor", "el", "fen", "gar", "hol", "is", "jen",
+  "kel", "lor", "mar", "nor", "ol", "per", "quin", "ros", "sal", "ter",
+  "ul", "ven", "wil", "xan", "yor", "zel"
+  };
+#define N_SYLLABLES (sizeof (syllables) / sizeof (syllables[0]))
+
+static const char *genres[] =
+  { "Fiction", "History", "Science", "Poetry", "Travel", "Biography" };
+#define N_GENRES (sizeof (genres) / sizeof (genres[0]))
+
+
+/*============================================================================
+rng
+xorshift64*; good enough for test data, and the same everywhere
+============================================================================*/
+static uint32_t rng (void)
+  {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (uint32_t)((rng_state * 2685821657736338717ULL) >> 32);
+  }
+
+
+/*============================================================================
+rng_range
+A number from lo to hi, inclusive
+============================================================================*/
+static int rng_range (int lo, int hi)
+  {
+  return lo + (int)(rng () % (uint32_t)(hi - lo + 1));
+  }
+
+
+/*============================================================================
+buf_add
+============================================================================*/
+static void buf_add (Buf *b, const void *data, size_t length)
+  {
+  if (b->length + length > b->size)
+    {
+    while (b->length + length > b->size)
+      b->size = b->size ? b->size * 2 : 4096;
+    b->data = realloc (b->data, b->size);
+    }
+  memcpy (b->data + b->length, data, length);
+  b->length += length;
+  }
+
+
+/*============================================================================
+buf_printf
+============================================================================*/
+static void buf_printf (Buf *b, const char *fmt, ...)
+  {
+  char *s;
+  va_list ap;
+  va_start (ap, fmt);
+  int n = vasprintf (&s, fmt, ap);
+  va_end (ap);
+  if (n > 0) buf_add (b, s, n);
+  free (s);
+  }
+
+
+/*============================================================================
+buf_u16le, buf_u32le, buf_u16be, buf_u32be
+============================================================================*/
+static void buf_u16le (Buf *b, uint16_t v)
+  {
+  unsigned char c[2] = { v, v >> 8 };
+  buf_add (b, c, 2);
+  }
+
+static void buf_u32le (Buf *b, uint32_t v)
+  {
+  unsigned char c[4] = { v, v >> 8, v >> 16, v >> 24 };
+  buf_add (b, c, 4);
+  }
+
+static void buf_u16be (Buf *b, uint16_t v)
+  {
+  unsigned char c[2] = { v >> 8, v };
+  buf_add (b, c, 2);
+  }
+
+static void buf_u32be (Buf *b, uint32_t v)
+  {
+  unsigned char c[4] = { v >> 24, v >> 16, v >> 8, v };
+  buf_add (b, c, 4);
+  }
+
+
+/*============================================================================
+buf_free
+============================================================================*/
+static void buf_free (Buf *b)
+  {
+  free (b->data);
+  memset (b, 0, sizeof (Buf));
+  }
+
+
+/*============================================================================
+buf_word
+============================================================================*/
+static void buf_word (Buf *b, BOOL capital)
+  {
+  int i, n = rng_range (1, 3);
+  for (i = 0; i < n; i++)
+    {
+    const char *s = syllables[rng () % N_SYLLABLES];
+    if (i == 0 && capital)
+      {
+      char c = s[0] - 'a' + 'A';
+      buf_add (b, &c, 1);
+      buf_add (b, s + 1, strlen (s) - 1);
+      }
+    else
+      buf_add (b, s, strlen (s));
+    }
+  }
+
+
+/*============================================================================
+buf_words
+============================================================================*/
+static void buf_words (Buf *b, int n, BOOL capitals)
+  {
+  int i;
+  for (i = 0; i < n; i++)
+    {
+    if (i) buf_add (b, " ", 1);
+    buf_word (b, capitals || i == 0);
+    }
+  }
+
+
+/*============================================================================
+buf_text
+Paragraphs of prose, until at least length bytes have been added
+============================================================================*/
+static void buf_text (Buf *b, size_t length, const char *para_start,
+       const char *para_end)
+  {
+  size_t target = b->length + length;
+  while (b->length < target)
+    {
+    buf_printf (b, "%s", para_start);
+    int sentences = rng_range (2, 8), i;
+    for (i = 0; i < sentences; i++)
+      {
+      if (i) buf_add (b, " ", 1);
+      buf_words (b, rng_range (4, 16), FALSE);
+      buf_add (b, ".", 1);
+      }
+    buf_printf (b, "%s", para_end);
+    }
+  }
+
+
+/*============================================================================
+buf_random
+Incompressible bytes, standing in for images
+============================================================================*/
+static void buf_random (Buf *b, size_t length)
+  {
+  size_t i;
+  for (i = 0; i < length; i += 4)
+    {
+    uint32_t r = rng ();
+    unsigned char c[4] = { r, r >> 8, r >> 16, r >> 24 };
+    buf_add (b, c, length - i < 4 ? length - i : 4);
+    }
+  }
+
+
+/*============================================================================
+write_file
+============================================================================*/
+static void write_file (const char *path, const Buf *b)
+  {
+  FILE *f = fopen (path, "wb");
+  if (!f || fwrite (b->data, 1, b->length, f) != b->length || fclose (f))
+    {
+    fprintf (stderr, "Can't write %s: %s\n", path, strerror (errno));
+    exit (-1);
+    }
+  }
+
+
+/*============================================================================
+zip_create
+============================================================================*/
+static Zip *zip_create (const char *path)
+  {
+  Zip *zip = malloc (sizeof (Zip));
+  memset (zip, 0, sizeof (Zip));
+  zip->f = fopen (path, "wb");
+  if (!zip->f)
+    {
+    fprintf (stderr, "Can't write %s: %s\n", path, strerror (errno));
+    exit (-1);
+    }
+  return zip;
+  }
+
+
+/*============================================================================
+zip_add
+Add one entry, either stored or raw-deflated, with sizes in the local
+header (no data descriptors)
+============================================================================*/
+static void zip_add (Zip *zip, const char *name, const Buf *content,
+      BOOL deflated)
+  {
+  uint32_t crc = crc32 (0, content->data, content->length);
+  const unsigned char *data = content->data;
+  size_t length = content->length;
+  unsigned char *packed = NULL;
+
+  if (deflated)
+    {
+    z_stream z;
+    memset (&z, 0, sizeof (z));
+    deflateInit2 (&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+      Z_DEFAULT_STRATEGY);
+    uLong bound = deflateBound (&z, content->length);
+    packed = malloc (bound);
+    z.next_in = content->data;
+    z.avail_in = content->length;
+    z.next_out = packed;
+    z.avail_out = bound;
+    deflate (&z, Z_FINISH);
+    length = z.total_out;
+    deflateEnd (&z);
+    data = packed;
+    }
+
+  uint16_t method = deflated ? 8 : 0;
+  uint16_t name_length = strlen (name);
+  Buf h;
+  memset (&h, 0, sizeof (h));
+  buf_u32le (&h, 0x04034b50);
+  buf_u16le (&h, 20);           // Version needed
+  buf_u16le (&h, 0);            // Flags
+  buf_u16le (&h, method);
+  buf_u16le (&h, 0);            // Time
+  buf_u16le (&h, 0x4a21);       // Date: 2017-01-01
+  buf_u32le (&h, crc);
+  buf_u32le (&h, length);
+  buf_u32le (&h, content->length);
+  buf_u16le (&h, name_length);
+  buf_u16le (&h, 0);            // Extra length
+  buf_add (&h, name, name_length);
+  fwrite (h.data, 1, h.length, zip->f);
+  fwrite (data, 1, length, zip->f);
+
+  Buf *c = &zip->central;
+  buf_u32le (c, 0x02014b50);
+  buf_u16le (c, 20);            // Version made by
+  buf_u16le (c, 20);
+  buf_u16le (c, 0);
+  buf_u16le (c, method);
+  buf_u16le (c, 0);
+  buf_u16le (c, 0x4a21);
+  buf_u32le (c, crc);
+  buf_u32le (c, length);
+  buf_u32le (c, content->length);
+  buf_u16le (c, name_length);
+  buf_u16le (c, 0);             // Extra length
+  buf_u16le (c, 0);             // Comment length
+  buf_u16le (c, 0);             // Disk
+  buf_u16le (c, 0);             // Internal attributes
+  buf_u32le (c, 0);             // External attributes
+  buf_u32le (c, zip->offset);
+  buf_add (c, name, name_length);
+
+  zip->offset += h.length + length;
+  zip->count++;
+  buf_free (&h);
+  free (packed);
+  }
+
+
+/*============================================================================
+zip_close
+============================================================================*/
+static void zip_close (Zip *zip)
+  {
+  Buf e;
+  memset (&e, 0, sizeof (e));
+  buf_u32le (&e, 0x06054b50);
+  buf_u16le (&e, 0);
+  buf_u16le (&e, 0);
+  buf_u16le (&e, zip->count);
+  buf_u16le (&e, zip->count);
+  buf_u32le (&e, zip->central.length);
+  buf_u32le (&e, zip->offset);
+  buf_u16le (&e, 0);
+  fwrite (zip->central.data, 1, zip->central.length, zip->f);
+  fwrite (e.data, 1, e.length, zip->f);
+  fclose (zip->f);
+  buf_free (&e);
+  buf_free (&zip->central);
+  free (zip);
+  }
+
+
+/*============================================================================
+make_epub
+manifest_items chapters are listed in the OPF, but only the first few
+are written, since only the OPF matters to the library. images are
+written stored, as real EPUB images usually are
+============================================================================*/
+static void make_epub (const char *path, int manifest_items, int images,
+      size_t image_size, BOOL deflated)
+  {
+  Zip *zip = zip_create (path);
+  Buf b;
+  memset (&b, 0, sizeof (b));
+  int i;
+
+  // The mimetype entry is always stored, and always first
+  buf_printf (&b, "application/epub+zip");
+  zip_add (zip, "mimetype", &b, FALSE);
+  b.length = 0;
+
+  buf_printf (&b, "<?xml version=\"1.0\"?>\n"
+    "<container version=\"1.0\" "
+    "xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\">\n"
+    "<rootfiles><rootfile full-path=\"OEBPS/content.opf\" "
+    "media-type=\"application/oebps-package+xml\"/></rootfiles>\n"
+    "</container>\n");
+  zip_add (zip, "META-INF/container.xml", &b, deflated);
+  b.length = 0;
+
+  buf_printf (&b, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<package xmlns=\"http://www.idpf.org/2007/opf\" version=\"2.0\" "
+    "unique-identifier=\"uid\">\n"
+    "<metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\" "
+    "xmlns:opf=\"http://www.idpf.org/2007/opf\">\n<dc:title>");
+  buf_words (&b, rng_range (1, 6), TRUE);
+  buf_printf (&b, "</dc:title>\n<dc:creator opf:role=\"aut\">");
+  buf_words (&b, 2, TRUE);
+  buf_printf (&b, "</dc:creator>\n<dc:date>%d-%02d-%02d</dc:date>\n",
+    rng_range (1800, 2017), rng_range (1, 12), rng_range (1, 28));
+  int n = rng_range (1, 3);
+  for (i = 0; i < n; i++)
+    buf_printf (&b, "<dc:subject>%s</dc:subject>\n",
+      genres[rng () % N_GENRES]);
+  buf_printf (&b, "<dc:description>");
+  buf_text (&b, rng_range (100, 2000), "&lt;p&gt;", "&lt;/p&gt;");
+  buf_printf (&b, "</dc:description>\n"
+    "<dc:identifier id=\"uid\">urn:uuid:%08x-%04x</dc:identifier>\n"
+    "</metadata>\n<manifest>\n", rng (), rng () & 0xffff);
+  for (i = 0; i < manifest_items; i++)
+    buf_printf (&b, "<item id=\"c%d\" href=\"text/c%d.xhtml\" "
+      "media-type=\"application/xhtml+xml\"/>\n", i, i);
+  for (i = 0; i < images; i++)
+    buf_printf (&b, "<item id=\"i%d\" href=\"images/i%d.jpg\" "
+      "media-type=\"image/jpeg\"/>\n", i, i);
+  buf_printf (&b, "</manifest>\n<spine>\n");
+  for (i = 0; i < manifest_items; i++)
+    buf_printf (&b, "<itemref idref=\"c%d\"/>\n", i);
+  buf_printf (&b, "</spine>\n</package>\n");
+  zip_add (zip, "OEBPS/content.opf", &b, deflated);
+  b.length = 0;
+
+  n = manifest_items < 8 ? manifest_items : 8;
+  for (i = 0; i < n; i++)
+    {
+    char name[64];
+    snprintf (name, sizeof (name), "OEBPS/text/c%d.xhtml", i);
+    buf_printf (&b, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<html xmlns=\"http://www.w3.org/1999/xhtml\"><body>\n");
+    buf_text (&b, rng_range (2000, 20000), "<p>", "</p>\n");
+    buf_printf (&b, "</body></html>\n");
+    zip_add (zip, name, &b, deflated);
+    b.length = 0;
+    }
+
+  for (i = 0; i < images; i++)
+    {
+    char name[64];
+    snprintf (name, sizeof (name), "OEBPS/images/i%d.jpg", i);
+    buf_random (&b, rng_range (image_size / 2, image_size * 3 / 2));
+    zip_add (zip, name, &b, FALSE);
+    b.length = 0;
+    }
+
+  zip_close (zip);
+  buf_free (&b);
+  }
+
+
+/*============================================================================
+make_mobi
+A PalmDB file whose first record holds the MOBI and EXTH headers,
+followed by records - 1 text records
+============================================================================*/
+static void make_mobi (const char *path, int records, int exth_records)
+  {
+  Buf rec0, b;
+  memset (&rec0, 0, sizeof (rec0));
+  memset (&b, 0, sizeof (b));
+  int i;
+
+  // PalmDOC header, then the MOBI header
+  buf_u16be (&rec0, 2);         // Compression: PalmDOC
+  buf_u16be (&rec0, 0);
+  buf_u32be (&rec0, (records - 1) * 4096);
+  buf_u16be (&rec0, records - 1);
+  buf_u16be (&rec0, 4096);
+  buf_u32be (&rec0, 0);
+  size_t mobi_start = rec0.length;
+  buf_add (&rec0, "MOBI", 4);
+  buf_u32be (&rec0, 232);       // Header length
+  while (rec0.length < mobi_start + 232) buf_u32be (&rec0, 0);
+  // EXTH flag, at offset 0x80 in the record
+  rec0.data[mobi_start + 0x70] = 0;
+  rec0.data[mobi_start + 0x73] = 0x50;
+
+  Buf exth;
+  memset (&exth, 0, sizeof (exth));
+  Buf value;
+  memset (&value, 0, sizeof (value));
+  for (i = 0; i < exth_records; i++)
+    {
+    uint32_t type;
+    value.length = 0;
+    switch (i)
+      {
+      case 0: type = 100; buf_words (&value, 2, TRUE); break;
+      case 1: type = 503; buf_words (&value, rng_range (1, 6), TRUE); break;
+      case 2:
+        type = 106;
+        buf_printf (&value, "%d-01-01", rng_range (1800, 2017));
+        break;
+      case 3: type = 105; buf_printf (&value, "%s", genres[0]); break;
+      case 4: type = 103; buf_text (&value, rng_range (100, 2000), "", " ");
+        break;
+      default:
+        // Records the library has no interest in, but must skip
+        type = 200 + rng () % 300;
+        buf_words (&value, rng_range (1, 20), FALSE);
+      }
+    buf_u32be (&exth, type);
+    buf_u32be (&exth, value.length + 8);
+    buf_add (&exth, value.data, value.length);
+    }
+  buf_add (&rec0, "EXTH", 4);
+  buf_u32be (&rec0, exth.length + 12);
+  buf_u32be (&rec0, exth_records);
+  buf_add (&rec0, exth.data, exth.length);
+  while (rec0.length % 4) buf_add (&rec0, "", 1);
+
+  // PalmDB header
+  char name[32];
+  memset (name, 0, sizeof (name));
+  Buf title;
+  memset (&title, 0, sizeof (title));
+  buf_words (&title, 2, TRUE);
+  memcpy (name, title.data, title.length < 31 ? title.length : 31);
+  buf_add (&b, name, 32);
+  while (b.length < 60) buf_add (&b, "", 1);
+  buf_add (&b, "BOOKMOBI", 8);
+  buf_u32be (&b, 0);
+  buf_u32be (&b, 0);
+  buf_u16be (&b, records);
+
+  uint32_t offset = 78 + records * 8 + 2;
+  Buf text;
+  memset (&text, 0, sizeof (text));
+  for (i = 0; i < records; i++)
+    {
+    buf_u32be (&b, offset);
+    buf_u32be (&b, i * 2);
+    offset += i == 0 ? rec0.length : 4096;
+    }
+  buf_u16be (&b, 0);
+  buf_add (&b, rec0.data, rec0.length);
+  for (i = 1; i < records; i++)
+    {
+    text.length = 0;
+    buf_text (&text, 4096, "", " ");
+    buf_add (&b, text.data, 4096);
+    }
+
+  write_file (path, &b);
+  buf_free (&b);
+  buf_free (&rec0);
+  buf_free (&exth);
+  buf_free (&value);
+  buf_free (&title);
+  buf_free (&text);
+  }
+
+
+/*============================================================================
+make_rtf
+padding bytes of text come before the info group. If with_info is
+FALSE there is no info group at all, so a reader must search the
+whole of its window to find that out
+============================================================================*/
+static void make_rtf (const char *path, size_t padding, BOOL with_info,
+      size_t body)
+  {
+  Buf b;
+  memset (&b, 0, sizeof (b));
+  buf_printf (&b, "{\\rtf1\\ansi\\deff0{\\fonttbl{\\f0 Times;}}\n");
+  if (padding) buf_text (&b, padding, "{\\pard ", "\\par}\n");
+  if (with_info)
+    {
+    buf_printf (&b, "{\\info{\\title ");
+    buf_words (&b, rng_range (1, 6), TRUE);
+    buf_printf (&b, "}{\\author ");
+    buf_words (&b, 2, TRUE);
+    buf_printf (&b, "}{\\subject %s}{\\doccomm ", genres[rng () % N_GENRES]);
+    buf_text (&b, rng_range (50, 500), "", " ");
+    buf_printf (&b, "}{\\creatim\\yr%d\\mo1\\dy1}}\n", rng_range (1800, 2017));
+    }
+  buf_text (&b, body, "{\\pard ", "\\par}\n");
+  buf_printf (&b, "}\n");
+  write_file (path, &b);
+  buf_free (&b);
+  }
+
+
+/*============================================================================
+file_path
+============================================================================*/
+static char *file_path (const Options *options, const char *kind, int n,
+      const char *ext)
+  {
+  char *path;
+  asprintf (&path, "%s/%s-%03d.%s", options->dir, kind, n, ext);
+  return path;
+  }
+
+
+/*============================================================================
+main
+============================================================================*/
+int main (int argc, char **argv)
+  {
+  Options options;
+  options.count = 10;
+  options.scale = 1;
+  unsigned long seed = 1;
+  BOOL show_usage = FALSE;
+
+  static struct option long_options[] =
+   {
+     {"seed", required_argument, NULL, 's'},
+     {"count", required_argument, NULL, 'n'},
+     {"scale", required_argument, NULL, 'S'},
+     {"help", no_argument, NULL, '?'},
+     {0, 0, 0, 0}
+   };
+
+  int opt;
+  while ((opt = getopt_long (argc, argv, "?s:n:S:", long_options, NULL))
+       != -1)
+    {
+    switch (opt)
+      {
+      case 's': seed = strtoul (optarg, NULL, 0); break;
+      case 'n': options.count = atoi (optarg); break;
+      case 'S': options.scale = atoi (optarg); break;
+      default: show_usage = TRUE; break;
+      }
+    }
+
+  if (show_usage || argc - optind != 1 || options.count < 1
+       || options.scale < 1)
+    {
+    printf ("Usage %s [options] {directory}\n", argv[0]);
+    printf ("  -s, --seed N          random seed (default 1)\n");
+    printf ("  -n, --count N         files of each kind (default 10)\n");
+    printf ("  -S, --scale N         multiply all sizes by N (default 1)\n");
+    printf ("  -?                    show this message\n");
+    exit (show_usage ? 0 : -1);
+    }
+
+  options.dir = argv[optind];
+  if (mkdir (options.dir, 0755) != 0 && errno != EEXIST)
+    {
+    fprintf (stderr, "Can't create %s: %s\n", options.dir, strerror (errno));
+    exit (-1);
+    }
+
+  // Each kind of file gets its own sequence, so that changing the
+  //  count of one kind does not change the content of the others
+  int s = options.scale, i;
+  for (i = 0; i < options.count; i++)
+    {
+    char *path;
+
+    rng_state = (seed + 1) * 0x9E3779B97F4A7C15ULL + i;
+    path = file_path (&options, "epub-small", i, "epub");
+    make_epub (path, rng_range (1, 20), rng_range (0, 4), 20000, TRUE);
+    free (path);
+
+    rng_state = (seed + 2) * 0x9E3779B97F4A7C15ULL + i;
+    path = file_path (&options, "epub-huge-opf", i, "epub");
+    make_epub (path, s * rng_range (2000, 5000), 0, 0, TRUE);
+    free (path);
+
+    rng_state = (seed + 3) * 0x9E3779B97F4A7C15ULL + i;
+    path = file_path (&options, "epub-stored", i, "epub");
+    make_epub (path, rng_range (10, 200), rng_range (0, 4), 20000, FALSE);
+    free (path);
+
+    rng_state = (seed + 4) * 0x9E3779B97F4A7C15ULL + i;
+    path = file_path (&options, "epub-images", i, "epub");
+    make_epub (path, rng_range (10, 50), s * rng_range (200, 1000),
+      50000, TRUE);
+    free (path);
+
+    rng_state = (seed + 5) * 0x9E3779B97F4A7C15ULL + i;
+    path = file_path (&options, "mobi-small", i, "mobi");
+    make_mobi (path, rng_range (10, 100), rng_range (5, 20));
+    free (path);
+
+    rng_state = (seed + 6) * 0x9E3779B97F4A7C15ULL + i;
+    path = file_path (&options, "mobi-many-records", i, "mobi");
+    make_mobi (path, s * rng_range (2000, 8000), rng_range (5, 20));
+    free (path);
+
+    rng_state = (seed + 7) * 0x9E3779B97F4A7C15ULL + i;
+    path = file_path (&options, "mobi-big-exth", i, "mobi");
+    make_mobi (path, rng_range (10, 100), s * rng_range (1000, 5000));
+    free (path);
+
+    rng_state = (seed + 8) * 0x9E3779B97F4A7C15ULL + i;
+    path = file_path (&options, "rtf-info-start", i, "rtf");
+    make_rtf (path, 0, TRUE, s * rng_range (10000, 200000));
+    free (path);
+
+    rng_state = (seed + 9) * 0x9E3779B97F4A7C15ULL + i;
+    path = file_path (&options, "rtf-info-late", i, "rtf");
+    make_rtf (path, 500000 + s * rng_range (1000, 100000), TRUE, 1000);
+    free (path);
+
+    rng_state = (seed + 10) * 0x9E3779B97F4A7C15ULL + i;
+    path = file_path (&options, "rtf-no-info", i, "rtf");
+    make_rtf (path, 0, FALSE, s * rng_range (100000, 700000));
+    free (path);
+    }
+
+  return 0;
+  }
+
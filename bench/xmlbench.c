@@ -0,0 +1,413 @@
+/*============================================================================
+ * libebookinfo
+ * xmlbench.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+/*============================================================================
+Microbenchmark for the sxmlc parser on its own. Generates OPF, NCX and
+XHTML documents of increasing size, and parses each with
+XMLDoc_parse_file_DOM, XMLDoc_parse_buffer_DOM and a bare SAX parse,
+reporting throughput, heap allocations per document, and peak memory.
+Each case runs in its own process, so that its peak RSS is its own
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <ebookinfo/constants.h>
+#include "sxmlc.h"
+
+#define METHOD_FILE_DOM   0
+#define METHOD_BUFFER_DOM 1
+#define METHOD_SAX        2
+#define N_METHODS         3
+
+#define KIND_OPF   0
+#define KIND_NCX   1
+#define KIND_XHTML 2
+#define N_KINDS    3
+
+static const char *method_names[N_METHODS] =
+  { "file_dom", "buffer_dom", "sax" };
+static const char *kind_names[N_KINDS] = { "opf", "ncx", "xhtml" };
+static const size_t sizes[] =
+  { 1024, 10240, 102400, 1048576, 10485760, 0 };
+
+// Aim to parse about this much per case, so that small documents
+//  get enough iterations to time
+#define BYTES_PER_CASE (16 * 1048576)
+
+typedef struct _Doc
+  {
+  char *data;
+  size_t length;
+  size_t size;
+  } Doc;
+
+typedef struct _Result
+  {
+  int iterations;
+  double seconds;
+  uint64_t allocations;
+  uint64_t bytes_allocated;
+  size_t peak_heap;
+  long peak_rss_kb;
+  } Result;
+
+
+/*============================================================================
+Allocation counting. The parser calls malloc() and friends directly, so
+the only way to see its allocations without changing it is to replace
+them for the whole process. glibc supports this; the real allocator
+remains available as __libc_malloc() and so on
+============================================================================*/
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *p, size_t size);
+extern void __libc_free (void *p);
+
+static BOOL counting;
+static uint64_t n_allocations;
+static uint64_t n_bytes;
+static size_t live_bytes;
+static size_t peak_bytes;
+
+static void count_alloc (void *p)
+  {
+  if (!counting || !p) return;
+  size_t size = malloc_usable_size (p);
+  n_allocations++;
+  n_bytes += size;
+  live_bytes += size;
+  if (live_bytes > peak_bytes) peak_bytes = live_bytes;
+  }
+
+static void count_free (void *p)
+  {
+  if (!counting || !p) return;
+  size_t size = malloc_usable_size (p);
+  live_bytes = live_bytes > size ? live_bytes - size : 0;
+  }
+
+void *malloc (size_t size)
+  {
+  void *p = __libc_malloc (size);
+  count_alloc (p);
+  return p;
+  }
+
+void *calloc (size_t n, size_t size)
+  {
+  void *p = __libc_calloc (n, size);
+  count_alloc (p);
+  return p;
+  }
+
+void *realloc (void *old, size_t size)
+  {
+  count_free (old);
+  void *p = __libc_realloc (old, size);
+  count_alloc (p);
+  return p;
+  }
+
+void free (void *p)
+  {
+  count_free (p);
+  __libc_free (p);
+  }
+
+
+/*============================================================================
+doc_printf
+============================================================================*/
+static void doc_printf (Doc *d, const char *fmt, ...)
+  {
+  char s[1024];
+  va_list ap;
+  va_start (ap, fmt);
+  int n = vsnprintf (s, sizeof (s), fmt, ap);
+  va_end (ap);
+  if (d->length + n + 1 > d->size)
+    {
+    while (d->length + n + 1 > d->size)
+      d->size = d->size ? d->size * 2 : 4096;
+    d->data = realloc (d->data, d->size);
+    }
+  memcpy (d->data + d->length, s, n + 1);
+  d->length += n;
+  }
+
+
+/*============================================================================
+make_doc
+Generate a document of the given kind, of about the given size. The
+shapes follow real EPUBs: an OPF is mostly a long, flat manifest, an
+NCX a nested tree of navPoints, and XHTML mostly text
+============================================================================*/
+static void make_doc (Doc *d, int kind, size_t size)
+  {
+  int i = 0;
+  d->length = 0;
+  switch (kind)
+    {
+    case KIND_OPF:
+      doc_printf (d, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<package xmlns=\"http://www.idpf.org/2007/opf\" version=\"2.0\">\n"
+        "<metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\">\n"
+        "<dc:title>Benchmark</dc:title><dc:creator>Nobody</dc:creator>\n"
+        "</metadata>\n<manifest>\n");
+      while (d->length < size)
+        {
+        doc_printf (d, "<item id=\"c%d\" href=\"text/c%d.xhtml\" "
+          "media-type=\"application/xhtml+xml\"/>\n", i, i);
+        i++;
+        }
+      doc_printf (d, "</manifest>\n</package>\n");
+      break;
+
+    case KIND_NCX:
+      doc_printf (d, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\" "
+        "version=\"2005-1\">\n<navMap>\n");
+      while (d->length < size)
+        {
+        int j;
+        doc_printf (d, "<navPoint id=\"n%d\" playOrder=\"%d\">"
+          "<navLabel><text>Chapter %d</text></navLabel>"
+          "<content src=\"c%d.xhtml\"/>\n", i, i, i, i);
+        for (j = 0; j < 4; j++)
+          doc_printf (d, "  <navPoint id=\"n%d_%d\"><navLabel><text>"
+            "Section %d.%d</text></navLabel>"
+            "<content src=\"c%d.xhtml#s%d\"/></navPoint>\n",
+            i, j, i, j, i, j);
+        doc_printf (d, "</navPoint>\n");
+        i++;
+        }
+      doc_printf (d, "</navMap>\n</ncx>\n");
+      break;
+
+    case KIND_XHTML:
+      doc_printf (d, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<html xmlns=\"http://www.w3.org/1999/xhtml\">\n"
+        "<head><title>Benchmark</title></head>\n<body>\n");
+      while (d->length < size)
+        {
+        doc_printf (d, "<p class=\"para\">Paragraph %d. It was a dark and "
+          "stormy night; the rain fell in torrents, except at occasional "
+          "intervals, when it was checked by a <i>violent</i> gust of wind "
+          "which swept up the streets.</p>\n", i);
+        i++;
+        }
+      doc_printf (d, "</body>\n</html>\n");
+      break;
+    }
+  }
+
+
+/*============================================================================
+sax_start_node
+============================================================================*/
+static int sax_start_node (const XMLNode *node, SAX_Data *sd)
+  {
+  (*(int *)sd->user)++;
+  return TRUE;
+  }
+
+
+/*============================================================================
+parse_once
+============================================================================*/
+static BOOL parse_once (int method, const Doc *d, const char *filename)
+  {
+  XMLDoc doc;
+  SAX_Callbacks sax;
+  int nodes = 0;
+  BOOL ok = FALSE;
+
+  switch (method)
+    {
+    case METHOD_FILE_DOM:
+      XMLDoc_init (&doc);
+      ok = XMLDoc_parse_file_DOM (filename, &doc);
+      XMLDoc_free (&doc);
+      break;
+
+    case METHOD_BUFFER_DOM:
+      XMLDoc_init (&doc);
+      ok = XMLDoc_parse_buffer_DOM_len (d->data, d->length, "bench", &doc);
+      XMLDoc_free (&doc);
+      break;
+
+    case METHOD_SAX:
+      SAX_Callbacks_init (&sax);
+      sax.start_node = sax_start_node;
+      ok = XMLDoc_parse_buffer_SAX_len (d->data, d->length, "bench", &sax,
+        &nodes);
+      break;
+    }
+  return ok;
+  }
+
+
+/*============================================================================
+run_case
+Runs in a child process
+============================================================================*/
+static BOOL run_case (int method, const Doc *d, const char *filename,
+      Result *r)
+  {
+  struct timespec t0, t1;
+  memset (r, 0, sizeof (Result));
+  r->iterations = BYTES_PER_CASE / d->length;
+  if (r->iterations < 3) r->iterations = 3;
+
+  // One untimed parse, to fault in the input and warm the caches
+  if (!parse_once (method, d, filename)) return FALSE;
+
+  counting = TRUE;
+  clock_gettime (CLOCK_MONOTONIC, &t0);
+  int i;
+  for (i = 0; i < r->iterations; i++)
+    parse_once (method, d, filename);
+  clock_gettime (CLOCK_MONOTONIC, &t1);
+  counting = FALSE;
+
+  struct rusage ru;
+  getrusage (RUSAGE_SELF, &ru);
+  r->seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  r->allocations = n_allocations;
+  r->bytes_allocated = n_bytes;
+  r->peak_heap = peak_bytes;
+  r->peak_rss_kb = ru.ru_maxrss;
+  return TRUE;
+  }
+
+
+/*============================================================================
+report
+============================================================================*/
+static void report (BOOL json, BOOL first, int kind, size_t size,
+      int method, const Doc *d, const Result *r)
+  {
+  double mbps = d->length * (double)r->iterations / 1048576.0 / r->seconds;
+  double allocs = (double)r->allocations / r->iterations;
+  double abytes = (double)r->bytes_allocated / r->iterations;
+  if (json)
+    printf ("%s\n{\"kind\":\"%s\",\"size\":%zu,\"method\":\"%s\","
+      "\"iterations\":%d,\"mb_per_sec\":%.3f,\"allocs_per_doc\":%.1f,"
+      "\"alloc_bytes_per_doc\":%.0f,\"peak_heap_bytes\":%zu,"
+      "\"peak_rss_kb\":%ld}", first ? "" : ",", kind_names[kind], d->length,
+      method_names[method], r->iterations, mbps, allocs, abytes,
+      r->peak_heap, r->peak_rss_kb);
+  else
+    printf ("%-6s %9zu %-11s %8d %9.2f %12.1f %14.0f %12zu %10ld\n",
+      kind_names[kind], d->length, method_names[method], r->iterations, mbps,
+      allocs, abytes, r->peak_heap, r->peak_rss_kb);
+  }
+
+
+/*============================================================================
+main
+============================================================================*/
+int main (int argc, char **argv)
+  {
+  BOOL json = FALSE;
+  BOOL show_usage = FALSE;
+  size_t max_size = 10485760;
+
+  static struct option long_options[] =
+   {
+     {"json", no_argument, NULL, 'j'},
+     {"max-size", required_argument, NULL, 'm'},
+     {"help", no_argument, NULL, '?'},
+     {0, 0, 0, 0}
+   };
+
+  int opt;
+  while ((opt = getopt_long (argc, argv, "?jm:", long_options, NULL)) != -1)
+    {
+    switch (opt)
+      {
+      case 'j': json = TRUE; break;
+      case 'm': max_size = strtoul (optarg, NULL, 0); break;
+      default: show_usage = TRUE; break;
+      }
+    }
+
+  if (show_usage || optind != argc)
+    {
+    printf ("Usage %s [options]\n", argv[0]);
+    printf ("  -j, --json            write the results as JSON\n");
+    printf ("  -m, --max-size N      largest document, in bytes "
+      "(default 10485760)\n");
+    printf ("  -?                    show this message\n");
+    exit (show_usage ? 0 : -1);
+    }
+
+  char filename[] = "/tmp/xmlbench.XXXXXX";
+  int fd = mkstemp (filename);
+  if (fd < 0)
+    {
+    perror ("mkstemp");
+    exit (-1);
+    }
+  close (fd);
+
+  if (json)
+    printf ("{\"version\":\"%s\",\"results\":[", VERSION);
+  else
+    printf ("%-6s %9s %-11s %8s %9s %12s %14s %12s %10s\n", "kind", "bytes",
+      "method", "iters", "MB/s", "allocs/doc", "alloc bytes", "peak heap",
+      "peak RSS k");
+
+  Doc d;
+  memset (&d, 0, sizeof (d));
+  BOOL first = TRUE;
+  int kind, s, method;
+  for (kind = 0; kind < N_KINDS; kind++)
+    for (s = 0; sizes[s] && sizes[s] <= max_size; s++)
+      {
+      make_doc (&d, kind, sizes[s]);
+      FILE *f = fopen (filename, "w");
+      fwrite (d.data, 1, d.length, f);
+      fclose (f);
+
+      for (method = 0; method < N_METHODS; method++)
+        {
+        fflush (stdout);
+        pid_t pid = fork ();
+        if (pid == 0)
+          {
+          Result r;
+          if (!run_case (method, &d, filename, &r))
+            {
+            fprintf (stderr, "Parse failed: %s %zu %s\n", kind_names[kind],
+              d.length, method_names[method]);
+            _exit (1);
+            }
+          report (json, first, kind, sizes[s], method, &d, &r);
+          fflush (stdout);
+          _exit (0);
+          }
+        int status;
+        waitpid (pid, &status, 0);
+        if (WIFEXITED (status) && WEXITSTATUS (status) == 0) first = FALSE;
+        }
+      }
+
+  if (json) printf ("\n]}\n");
+  unlink (filename);
+  free (d.data);
+  return 0;
+  }
+
@@ -0,0 +1,61 @@
+/*============================================================================
+ * libebookinfo
+ * allocator.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+
+/*============================================================================
+Every allocation the library makes for its own objects -- books,
+meta-data, parser trees, inflated ZIP entries -- goes through the
+current allocator, which by default is malloc(). Memory handed to the
+caller to free() (error strings, and the result of
+ebookhtmltext_convert()) always comes from malloc(), whatever the
+allocator.
+
+ebook_set_allocator() must be called when no library objects exist,
+typically once at start-up; passing NULL restores malloc(). All three
+functions must be set, and must be safe to call from any thread that
+uses the library.
+============================================================================*/
+typedef struct _EBookAllocator
+  {
+  void *(*malloc) (size_t size, void *user);
+  void *(*realloc) (void *p, size_t size, void *user);
+  void (*free) (void *p, void *user);
+  void *user;
+  } EBookAllocator;
+
+/*============================================================================
+Counters kept by the counting allocator, per thread, since the last
+reset. live and peak are in bytes requested, not counting allocator 
+overhead, and only include blocks allocated since the reset
+============================================================================*/
+typedef struct _EBookAllocStats
+  {
+  unsigned long allocations;
+  unsigned long long bytes;
+  size_t live;
+  size_t peak;
+  } EBookAllocStats;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+void                  ebook_set_allocator (const EBookAllocator *allocator);
+
+// An allocator, on top of malloc(), that counts the calling thread's
+//  allocations. To measure one call -- ebook_get_metadata(), say --
+//  reset the counters, make the call, and read them back
+const EBookAllocator *ebook_counting_allocator (void);
+void                  ebook_alloc_stats_reset (void);
+void                  ebook_alloc_stats_get (EBookAllocStats *stats);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
@@ -6,24 +6,86 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <ebookinfo/ebookmetadata.h>
+#include <ebookinfo/stringpool.h>
 
 struct _EBook;
 typedef struct _EBook EBook;
 
+#define EBOOK_TYPE_UNKNOWN -1
 #define EBOOK_TYPE_EPUB 0
 #define EBOOK_TYPE_MOBI 1
 #define EBOOK_TYPE_RTF  2
 
+// How sure ebook_probe() is of its answer
+#define EBOOK_CONFIDENCE_NONE   0
+#define EBOOK_CONFIDENCE_LOW    1
+#define EBOOK_CONFIDENCE_MEDIUM 2
+#define EBOOK_CONFIDENCE_HIGH   3
+
+// Limits on the work done for one book, for callers that can't let a
+//  hostile or corrupt file hold a thread for long. deadline is a time
+//  on the CLOCK_MONOTONIC clock in nanoseconds, as from ebook_deadline(),
+//  or 0 for none. cancel, if not NULL, points to a flag that another
+//  thread may set nonzero to abandon the work. Both are checked in the
+//  loops whose length depends on the file -- inflating ZIP entries,
+//  parsing XML, walking MOBI records -- so a book is abandoned soon
+//  after either is hit, with an error saying which
+typedef struct _EBookLimits
+  {
+  unsigned long long deadline;
+  const volatile int *cancel;
+  } EBookLimits;
+
 #ifdef __CPLUSPLUS
 extern "C" {
 #endif
 
 EBook         *ebook_open (const char *filename, char **error);
+// The caller keeps ownership of fd, and may close it once this returns
+EBook         *ebook_open_fd (int fd, char **error);
+// buf is used in place, and must remain valid until ebook_close()
+EBook         *ebook_open_memory (const void *buf, size_t length, 
+                 char **error);
 void          ebook_close (EBook *self);
 int           ebook_get_type (const EBook *self);
 EBookMetadata *ebook_get_metadata (const EBook *self, char **error);
 
+// Only the keys in fields (a mask of EBOOK_FIELD() values) are read;
+//  others may be skipped, or may come back anyway if the book has 
+//  already read them. Reading may stop as soon as every requested key
+//  has a value, so keys other than EBOOK_KEY_CREATOR, EBOOK_KEY_SUBJECT
+//  and EBOOK_KEY_IDENTIFIER may come back with only their first value
+EBookMetadata *ebook_get_metadata_fields (const EBook *self, 
+                 unsigned int fields, char **error);
+
+// As ebook_open() and ebook_get_metadata_fields(), within limits, 
+//  which may be NULL for none
+EBook         *ebook_open_ex (const char *filename, 
+                 const EBookLimits *limits, char **error);
+EBookMetadata *ebook_get_metadata_ex (const EBook *self, 
+                 unsigned int fields, const EBookLimits *limits, 
+                 char **error);
+// The deadline ms milliseconds from now
+unsigned long long ebook_deadline (unsigned int ms);
+
+// Metadata read from the book from now on is built with its repeating
+//  strings in pool (see stringpool.h), shared with every other book 
+//  read through the same pool; NULL stops this. Metadata the book has 
+//  already read is not changed, so set the pool before reading any
+void          ebook_set_string_pool (EBook *self, EBookStringPool *pool);
+
+// Identify the format from the first few bytes of the file, without 
+//  opening the book. Returns EBOOK_TYPE_UNKNOWN if the format is not 
+//  recognized or the file can't be read; only the latter sets *error.
+//  ebook_probe_fd() does not move the file offset, so fd must be 
+//  seekable
+int           ebook_probe (const char *filename, int *confidence, 
+                char **error);
+int           ebook_probe_fd (int fd, int *confidence, char **error);
+const char   *ebook_type_name (int type);
+
 // Internal use only
 void     *ebook_get_data (const EBook *self);
 void     ebook_set_data (EBook *self, void *data);
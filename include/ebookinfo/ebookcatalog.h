@@ -0,0 +1,94 @@
+/*============================================================================
+ * libebookinfo
+ * ebookcatalog.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebookmetadata.h>
+#include <ebookinfo/ebookrecord.h>
+
+/*============================================================================
+A catalog is the metadata of many books in one file, laid out to be
+used straight from a mapping: opening one reads the header and
+nothing else, however many books it holds. The file has
+
+  - a header, of fixed size, giving where each section is
+  - a string table, of NUL-terminated strings, each stored once
+  - the books: a fixed-size entry per book, with its filename, title,
+    author and year as offsets into the string table, its format, and
+    where its full metadata record is
+  - for each index -- author, title and year -- the numbers of the
+    books that have that field, sorted by it. Strings are sorted
+    ignoring case
+  - the full metadata of each book, as records (see ebookrecord.h)
+
+All numbers are little-endian. Lookups are binary searches of an
+index, touching only the pages they need.
+
+A writer collects books in memory and writes the file at the end. It
+is not safe to add to one writer from more than one thread at once
+============================================================================*/
+
+#define EBOOK_CATALOG_BY_AUTHOR 0
+#define EBOOK_CATALOG_BY_TITLE  1
+#define EBOOK_CATALOG_BY_YEAR   2
+#define EBOOK_CATALOG_N_INDEXES 3
+
+struct _EBookCatalog;
+typedef struct _EBookCatalog EBookCatalog;
+struct _EBookCatalogWriter;
+typedef struct _EBookCatalogWriter EBookCatalogWriter;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+EBookCatalogWriter *ebookcatalog_writer_create (void);
+void           ebookcatalog_writer_destroy (EBookCatalogWriter *self);
+void           ebookcatalog_writer_add (EBookCatalogWriter *self,
+                 const char *filename, int type,
+                 const EBookMetadata *metadata);
+BOOL           ebookcatalog_writer_write (EBookCatalogWriter *self,
+                 const char *filename, char **error);
+
+EBookCatalog  *ebookcatalog_open (const char *filename, char **error);
+void           ebookcatalog_close (EBookCatalog *self);
+
+// Books are numbered from 0, in the order they were added. Fields a
+//  book does not have are NULL, or 0 for the year
+int            ebookcatalog_count (const EBookCatalog *self);
+const char    *ebookcatalog_get_filename (const EBookCatalog *self,
+                 int book);
+int            ebookcatalog_get_type (const EBookCatalog *self, int book);
+const char    *ebookcatalog_get_title (const EBookCatalog *self, int book);
+const char    *ebookcatalog_get_author (const EBookCatalog *self, int book);
+int            ebookcatalog_get_year (const EBookCatalog *self, int book);
+// A view of the book's full metadata, in place in the catalog
+BOOL           ebookcatalog_get_record (const EBookCatalog *self, int book,
+                 EBookRecord *record, char **error);
+
+// An index lists the books that have its field, in order.
+//  ebookcatalog_find() gives the positions in the index of the books
+//  whose field lies between from and to, inclusive, as *first and a
+//  count. For the string indexes, from and to are compared ignoring
+//  case, and to may be NULL for the same as from; a from ending in
+//  '*' matches every string that begins with the rest. For the year,
+//  from and to are numbers
+int            ebookcatalog_index_count (const EBookCatalog *self,
+                 int index);
+int            ebookcatalog_index_book (const EBookCatalog *self,
+                 int index, int position);
+int            ebookcatalog_find (const EBookCatalog *self, int index,
+                 const char *from, const char *to, int *first);
+// Whether a book's field matches, as ebookcatalog_find() would match
+//  it, for filtering the books found by one index on another field
+BOOL           ebookcatalog_matches (const EBookCatalog *self, int index,
+                 int book, const char *from, const char *to);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
@@ -9,4 +9,11 @@
 #include <ebookinfo/ebook.h>
 #include <ebookinfo/constants.h>
 #include <ebookinfo/ebookmetadata.h>
+#include <ebookinfo/ebookrecord.h>
+#include <ebookinfo/ebookcatalog.h>
+#include <ebookinfo/stringpool.h>
+#include <ebookinfo/htmltext.h>
+#include <ebookinfo/allocator.h>
+#include <ebookinfo/stats.h>
+#include <ebookinfo/trace.h>
 
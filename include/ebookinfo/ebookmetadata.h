@@ -1,33 +1,108 @@
 /*============================================================================
  * libebookinfo
- * ebook.h
+ * ebookmetadata.h
  * Copyright (c)2017 Kevin Boone. GPLv3.0
 ============================================================================*/
 
 #pragma once
 
+#include <ebookinfo/constants.h>
+
 struct _EBookMetadata;
 typedef struct _EBookMetadata EBookMetadata;
 
+/*============================================================================
+Beyond the five classic fields, metadata holds any number of values
+for each of a fixed set of keys, in the order the book gives them.
+A value may have a qualifier: the role of a creator ("aut", "ill", 
+"edt"...), or the scheme of an identifier ("ISBN", "ASIN", "UUID"...).
+The first date is also parsed, and its value is given in ISO 8601
+form, as far as the book specifies it: "1837", "1837-03", or 
+"1837-03-31". Looking up a key is a single index; nothing is parsed 
+or split when the metadata is read.
+
+The classic fields are derived from these: the title and comment are
+the first title and description, the author is the first creator with
+no role or the "aut" role, the genre is the subjects joined with 
+commas, and the year is the year of the date
+============================================================================*/
+
+#define EBOOK_KEY_TITLE        0
+#define EBOOK_KEY_CREATOR      1
+#define EBOOK_KEY_SUBJECT      2
+#define EBOOK_KEY_DESCRIPTION  3
+#define EBOOK_KEY_DATE         4
+#define EBOOK_KEY_LANGUAGE     5
+#define EBOOK_KEY_PUBLISHER    6
+#define EBOOK_KEY_IDENTIFIER   7
+#define EBOOK_KEY_SERIES       8
+#define EBOOK_KEY_SERIES_INDEX 9
+#define EBOOK_N_KEYS           10
+
+// Masks of keys, for ebook_get_metadata_fields(). The classic fields
+//  come from the keys above: author from EBOOK_KEY_CREATOR, genre 
+//  from EBOOK_KEY_SUBJECT, year from EBOOK_KEY_DATE, and comment from 
+//  EBOOK_KEY_DESCRIPTION
+#define EBOOK_FIELD(key)       (1u << (key))
+#define EBOOK_FIELDS_ALL       ((1u << EBOOK_N_KEYS) - 1)
+
 #ifdef __CPLUSPLUS
 extern "C" {
 #endif
 
+// Metadata is reference-counted. ebook_get_metadata() returns a
+//  reference to an object that the book, and any number of threads,
+//  may share; treat it as read-only, and use ebookmetadata_clone()
+//  for a copy that can be changed with the setters. The setters 
+//  refuse to change an object that has more than one reference, 
+//  returning FALSE. ebookmetadata_destroy() drops a reference, and
+//  frees the object when the last one goes
 EBookMetadata *ebookmetadata_create (const char *title, const char *author,
                  const char *year, const char *genre, const char *comment);
+// Metadata from a list of values, as from ebookmetadata_count() and
+//  ebookmetadata_get(): the i'th value has key keys[i] and qualifier
+//  qualifiers[i], which may be NULL, as may qualifiers itself. The 
+//  classic fields are derived from the values as usual
+EBookMetadata *ebookmetadata_create_values (int n, const int *keys,
+                 const char *const *values, const char *const *qualifiers);
 EBookMetadata *ebookmetadata_clone (const EBookMetadata *self);
+EBookMetadata *ebookmetadata_retain (EBookMetadata *self);
 void           ebookmetadata_destroy (EBookMetadata *self);
 
 const char    *ebookmetadata_get_title (const EBookMetadata *self);
-void           ebookmetadata_set_title (EBookMetadata *self, const char *title);
+BOOL           ebookmetadata_set_title (EBookMetadata *self, const char *title);
 const char    *ebookmetadata_get_author (const EBookMetadata *self);
-void           ebookmetadata_set_author (EBookMetadata *self, const char *author);
+BOOL           ebookmetadata_set_author (EBookMetadata *self, const char *author);
 const char    *ebookmetadata_get_year (const EBookMetadata *self);
-void           ebookmetadata_set_year (EBookMetadata *self, const char *year);
+BOOL           ebookmetadata_set_year (EBookMetadata *self, const char *year);
 const char    *ebookmetadata_get_genre (const EBookMetadata *self);
-void           ebookmetadata_set_genre (EBookMetadata *self, const char *genre);
+BOOL           ebookmetadata_set_genre (EBookMetadata *self, const char *genre);
 const char    *ebookmetadata_get_comment (const EBookMetadata *self);
-void           ebookmetadata_set_comment (EBookMetadata *self, const char *comment);
+BOOL           ebookmetadata_set_comment (EBookMetadata *self, const char *comment);
+
+// Sort keys for the author and title, or NULL if there is no author
+//  or title. They are lower case, without accents or punctuation, so
+//  strcmp() orders them. The author key is "last, first", as 
+//  "dickens, charles"; the title key has no leading article, in the
+//  book's language, as "pickwick papers". Setting the author or title
+//  sets its key too
+const char    *ebookmetadata_get_author_sort (const EBookMetadata *self);
+const char    *ebookmetadata_get_title_sort (const EBookMetadata *self);
+
+// The setters above change only the classic fields, not the values
+//  below
+int            ebookmetadata_count (const EBookMetadata *self, int key);
+const char    *ebookmetadata_get (const EBookMetadata *self, int key, int i);
+const char    *ebookmetadata_get_qualifier (const EBookMetadata *self, 
+                 int key, int i);
+// Any part of the date that the book does not give is 0. Returns FALSE
+//  if there is no date that could be parsed
+BOOL           ebookmetadata_get_date (const EBookMetadata *self, 
+                 int *year, int *month, int *day);
+// Key names are lower case, as "series-index". ebookmetadata_key() 
+//  returns -1 for a name that is not a key
+int            ebookmetadata_key (const char *name);
+const char    *ebookmetadata_key_name (int key);
  
 #ifdef __CPLUSPLUS
 }
@@ -0,0 +1,84 @@
+/*============================================================================
+ * libebookinfo
+ * ebookrecord.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebookmetadata.h>
+
+/*============================================================================
+A compact binary form of EBookMetadata, for caches, for passing
+between processes, and for catalog files. A record is encoded into a
+buffer that the caller supplies, and read back through an EBookRecord,
+which is a view of the bytes where they lie -- in a buffer, or a
+mapped file -- and copies nothing. Strings come back as pointers into
+the record, so they last as long as the bytes do.
+
+The layout is byte-oriented, with no alignment or byte order to worry
+about. Numbers are unsigned LEB128 varints, and a string is a varint
+holding its length plus one (0 for none), then its bytes and a NUL.
+
+  "EBR" version          4 bytes; the version is EBOOK_RECORD_VERSION
+  body length            varint: the number of bytes that follow
+  number of keys         varint
+  per key:
+    count                varint: the number of values
+    offset               varint: of the first, from the start of values
+  edited                 varint: a mask of the classic fields set by
+                         hand, with ebookmetadata_set_title() and the
+                         rest, in the order title, author, year, genre,
+                         comment
+  per bit in edited:     string
+  values, grouped by key: string value, string qualifier
+
+A reader ignores keys beyond the ones it knows, so keys can be added
+without a new version. A record can be skipped, without looking
+inside it, by its body length
+============================================================================*/
+
+#define EBOOK_RECORD_VERSION 1
+
+// The members are private; this is public only so that a view can be
+//  made on the stack
+typedef struct _EBookRecord
+  {
+  const unsigned char *values;
+  size_t size;
+  unsigned int edited;
+  const char *fields[5];
+  int count[EBOOK_N_KEYS];
+  size_t offset[EBOOK_N_KEYS];
+  } EBookRecord;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+// Returns the size of the record. The record is written to buffer only
+//  if it fits in size bytes, so a call with size 0 finds how much room
+//  is needed
+size_t         ebookmetadata_encode (const EBookMetadata *self,
+                 void *buffer, size_t size);
+
+// Checks the record at the start of data, which may run on into others,
+//  and makes self a view of it. Every string is checked here, so the
+//  getters need not check anything
+BOOL           ebookrecord_open (EBookRecord *self, const void *data,
+                 size_t length, char **error);
+// The number of bytes that the record takes, header and all
+size_t         ebookrecord_size (const EBookRecord *self);
+int            ebookrecord_count (const EBookRecord *self, int key);
+const char    *ebookrecord_get (const EBookRecord *self, int key, int i);
+const char    *ebookrecord_get_qualifier (const EBookRecord *self,
+                 int key, int i);
+// A copy of the record, as metadata that no longer needs the bytes
+EBookMetadata *ebookrecord_to_metadata (const EBookRecord *self);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
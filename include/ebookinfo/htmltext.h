@@ -0,0 +1,42 @@
+/*============================================================================
+ * libebookinfo
+ * htmltext.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+
+/*============================================================================
+A streaming HTML-to-text converter, for the description fields that
+many e-books carry as HTML. Tags are removed, entities decoded, and
+runs of whitespace collapsed to a single space; block-level elements
+become line or paragraph breaks. Input can be fed in pieces of any
+size, and text is passed to the sink as it is produced. The input is
+assumed to be UTF-8, or at least ASCII-compatible.
+============================================================================*/
+struct _EBookHTMLText;
+typedef struct _EBookHTMLText EBookHTMLText;
+
+typedef void (*EBookTextSink) (const char *text, size_t length, void *user);
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+EBookHTMLText *ebookhtmltext_create (EBookTextSink sink, void *user);
+void           ebookhtmltext_feed (EBookHTMLText *self, const char *html, 
+                 size_t length);
+void           ebookhtmltext_finish (EBookHTMLText *self);
+void           ebookhtmltext_destroy (EBookHTMLText *self);
+
+// Convert a whole string in one go. The result must be freed by the
+//  caller
+char          *ebookhtmltext_convert (const char *html);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
+
@@ -0,0 +1,61 @@
+/*============================================================================
+ * libebookinfo
+ * stats.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <ebookinfo/constants.h>
+
+/*============================================================================
+Cumulative counters, kept per format, for finding out where the time
+goes in a scan. They are off by default; when enabled, each thread
+counts into its own block, and ebook_stats_get() adds the blocks up,
+so counting takes no locks. Counts made by a thread that has exited
+are kept.
+============================================================================*/
+
+// The phases of reading a book. Sniffing is identifying the format,
+//  whether by ebook_probe() or as part of opening
+#define EBOOK_PHASE_SNIFF    0
+#define EBOOK_PHASE_OPEN     1
+#define EBOOK_PHASE_METADATA 2
+#define EBOOK_PHASE_CLOSE    3
+#define EBOOK_N_PHASES       4
+
+// Counters are indexed by EBOOK_TYPE_ constant. Files whose format
+//  could not be identified are counted in EBOOK_STATS_UNKNOWN
+#define EBOOK_STATS_FORMATS  8
+#define EBOOK_STATS_UNKNOWN  (EBOOK_STATS_FORMATS - 1)
+
+typedef struct _EBookFormatStats
+  {
+  unsigned long long files_opened;
+  unsigned long long bytes_read;       // Size of the books opened
+  unsigned long long syscalls;         // File system calls made
+  unsigned long long xml_nodes;        // Elements built by the XML parser
+  unsigned long long entries_inflated; // Compressed container entries
+  unsigned long long bytes_inflated;
+  unsigned long long phase_calls[EBOOK_N_PHASES];
+  unsigned long long phase_ns[EBOOK_N_PHASES];  // Wall time
+  } EBookFormatStats;
+
+typedef struct _EBookStats
+  {
+  EBookFormatStats formats[EBOOK_STATS_FORMATS];
+  } EBookStats;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+void ebook_stats_enable (BOOL enable);
+void ebook_stats_get (EBookStats *stats);
+void ebook_stats_reset (void);
+const char *ebook_phase_name (int phase);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
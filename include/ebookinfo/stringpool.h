@@ -0,0 +1,60 @@
+/*============================================================================
+ * libebookinfo
+ * stringpool.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebookmetadata.h>
+
+/*============================================================================
+A string pool holds one copy of each distinct string put into it, for
+a batch of books whose metadata is to be kept together -- a catalog
+held in memory, say. Metadata interned in a pool shares the strings
+that repeat from book to book: creators, subjects, languages,
+publishers, series, and the qualifiers of every key (roles and
+identifier schemes), as well as the author, genre and year made from
+them. Two such strings interned in the same pool are equal if and
+only if their pointers are.
+
+To build metadata into a pool as it is read, give the pool to each 
+book with ebook_set_string_pool(). ebookmetadata_intern() is for 
+metadata that was made some other way.
+
+Strings are stored in large blocks, and are only freed, all at once,
+when the pool is destroyed; so a pool must outlive every metadata
+object interned in it. Any number of threads may use a pool at once
+============================================================================*/
+
+struct _EBookStringPool;
+typedef struct _EBookStringPool EBookStringPool;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+EBookStringPool *ebookstringpool_create (void);
+void           ebookstringpool_destroy (EBookStringPool *self);
+
+// The pool's copy of the first length characters of s, stopping at a
+//  NUL; length may be -1 for the whole string
+const char    *ebookstringpool_intern (EBookStringPool *self,
+                 const char *s, size_t length);
+
+// The number of distinct strings, and the bytes of memory the pool
+//  has taken for them
+void           ebookstringpool_get_stats (EBookStringPool *self,
+                 size_t *strings, size_t *bytes);
+
+// A copy of self whose repeating strings are in the pool, and which
+//  is correspondingly smaller; for metadata not read through the pool
+EBookMetadata *ebookmetadata_intern (const EBookMetadata *self,
+                 EBookStringPool *pool);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
@@ -0,0 +1,40 @@
+/*============================================================================
+ * libebookinfo
+ * trace.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <ebookinfo/constants.h>
+
+/*============================================================================
+Event tracing, for looking at individual slow files rather than
+averages. When enabled, the library records a span for each phase of
+reading a book -- recognizing the format, opening, reading container
+entries, parsing XML, reading meta-data, closing -- and applications
+can add spans of their own. Each thread records into its own buffer,
+without locks. ebook_trace_write() writes everything recorded so far
+in the Chrome trace-event format, which chrome://tracing and Perfetto
+can display as a timeline per thread.
+============================================================================*/
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+void ebook_trace_enable (BOOL enable);
+
+// Spans must nest properly within a thread. name must be a string
+//  that outlives the trace, such as a literal; arg, which may be NULL,
+//  is copied
+void ebook_trace_begin (const char *name, const char *arg);
+void ebook_trace_end (void);
+
+// Call only when no other thread is recording
+BOOL ebook_trace_write (const char *filename, char **error);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
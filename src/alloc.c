@@ -0,0 +1,187 @@
+/*============================================================================
+ * libebookinfo
+ * alloc.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/allocator.h>
+#include "alloc.h"
+
+// NULL means plain malloc(), which is the usual case, and costs only
+//  a test per call
+static const EBookAllocator *allocator;
+
+// The counting allocator keeps the size of each block in a header, so
+//  that free() can account for it. The header is big enough to keep
+//  the block suitably aligned for anything
+#define HEADER_SIZE 16
+
+static __thread EBookAllocStats stats;
+
+
+/*============================================================================
+ebook_set_allocator
+============================================================================*/
+void ebook_set_allocator (const EBookAllocator *a)
+  {
+  allocator = a;
+  }
+
+
+/*============================================================================
+ebi_malloc
+============================================================================*/
+void *ebi_malloc (size_t size)
+  {
+  if (allocator) return allocator->malloc (size, allocator->user);
+  return malloc (size);
+  }
+
+
+/*============================================================================
+ebi_calloc
+============================================================================*/
+void *ebi_calloc (size_t n, size_t size)
+  {
+  if (!allocator) return calloc (n, size);
+  if (size && n > (size_t)-1 / size) return NULL;
+  void *p = allocator->malloc (n * size, allocator->user);
+  if (p) memset (p, 0, n * size);
+  return p;
+  }
+
+
+/*============================================================================
+ebi_realloc
+============================================================================*/
+void *ebi_realloc (void *p, size_t size)
+  {
+  if (allocator) return allocator->realloc (p, size, allocator->user);
+  return realloc (p, size);
+  }
+
+
+/*============================================================================
+ebi_free
+============================================================================*/
+void ebi_free (void *p)
+  {
+  if (allocator)
+    allocator->free (p, allocator->user);
+  else
+    free (p);
+  }
+
+
+/*============================================================================
+ebi_strdup
+============================================================================*/
+char *ebi_strdup (const char *s)
+  {
+  size_t len = strlen (s) + 1;
+  char *ret = ebi_malloc (len);
+  if (ret) memcpy (ret, s, len);
+  return ret;
+  }
+
+
+/*============================================================================
+ebi_strndup
+============================================================================*/
+char *ebi_strndup (const char *s, size_t n)
+  {
+  size_t len = strnlen (s, n);
+  char *ret = ebi_malloc (len + 1);
+  if (ret)
+    {
+    memcpy (ret, s, len);
+    ret[len] = 0;
+    }
+  return ret;
+  }
+
+
+/*============================================================================
+count_malloc
+============================================================================*/
+static void *count_malloc (size_t size, void *user)
+  {
+  char *p = malloc (size + HEADER_SIZE);
+  if (!p) return NULL;
+  *(size_t *)p = size;
+  stats.allocations++;
+  stats.bytes += size;
+  stats.live += size;
+  if (stats.live > stats.peak) stats.peak = stats.live;
+  return p + HEADER_SIZE;
+  }
+
+
+/*============================================================================
+count_free
+Blocks may be freed by a different thread from the one that allocated
+them, or before the counters were reset, so live can't be allowed to
+go below zero
+============================================================================*/
+static void count_free (void *p, void *user)
+  {
+  if (!p) return;
+  char *block = (char *)p - HEADER_SIZE;
+  size_t size = *(size_t *)block;
+  stats.live = stats.live > size ? stats.live - size : 0;
+  free (block);
+  }
+
+
+/*============================================================================
+count_realloc
+============================================================================*/
+static void *count_realloc (void *p, size_t size, void *user)
+  {
+  if (!p) return count_malloc (size, user);
+  char *block = (char *)p - HEADER_SIZE;
+  size_t old = *(size_t *)block;
+  block = realloc (block, size + HEADER_SIZE);
+  if (!block) return NULL;
+  *(size_t *)block = size;
+  stats.allocations++;
+  stats.bytes += size;
+  stats.live = (stats.live > old ? stats.live - old : 0) + size;
+  if (stats.live > stats.peak) stats.peak = stats.live;
+  return block + HEADER_SIZE;
+  }
+
+
+/*============================================================================
+ebook_counting_allocator
+============================================================================*/
+const EBookAllocator *ebook_counting_allocator (void)
+  {
+  static const EBookAllocator counting =
+    { count_malloc, count_realloc, count_free, NULL };
+  return &counting;
+  }
+
+
+/*============================================================================
+ebook_alloc_stats_reset
+============================================================================*/
+void ebook_alloc_stats_reset (void)
+  {
+  memset (&stats, 0, sizeof (stats));
+  }
+
+
+/*============================================================================
+ebook_alloc_stats_get
+============================================================================*/
+void ebook_alloc_stats_get (EBookAllocStats *s)
+  {
+  *s = stats;
+  }
+
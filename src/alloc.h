@@ -0,0 +1,32 @@
+/*============================================================================
+ * libebookinfo
+ * alloc.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <ebookinfo/allocator.h>
+
+/*============================================================================
+The library's allocation functions. Everything allocated with these
+must be released with ebi_free(), and nothing else may be; see
+allocator.h for what stays on malloc()
+============================================================================*/
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+void *ebi_malloc (size_t size);
+void *ebi_calloc (size_t n, size_t size);
+void *ebi_realloc (void *p, size_t size);
+void  ebi_free (void *p);
+char *ebi_strdup (const char *s);
+char *ebi_strndup (const char *s, size_t n);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
@@ -0,0 +1,100 @@
+/*============================================================================
+ * libebookinfo
+ * cancel.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebook.h>
+#include "cancel.h"
+
+// Reading the clock costs more than a trip round most of the loops
+//  that check, so the deadline is only looked at every so often
+#define DEADLINE_INTERVAL 64
+
+#define LIMIT_NONE      0
+#define LIMIT_DEADLINE  1
+#define LIMIT_CANCELLED 2
+
+__thread const EBookLimits *ebi_limits;
+
+static __thread int hit;
+static __thread int countdown;
+
+
+/*============================================================================
+now
+============================================================================*/
+static unsigned long long now (void)
+  {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+
+/*============================================================================
+ebi_limits_set
+Install limits (or NULL) for this thread, returning the previous ones
+============================================================================*/
+const EBookLimits *ebi_limits_set (const EBookLimits *limits)
+  {
+  const EBookLimits *old = ebi_limits;
+  ebi_limits = limits;
+  hit = LIMIT_NONE;
+  countdown = 0;
+  return old;
+  }
+
+
+/*============================================================================
+ebi_limits_check
+TRUE if the installed limits have been hit. Use EBI_CANCELLED() rather
+than calling this directly
+============================================================================*/
+BOOL ebi_limits_check (void)
+  {
+  if (hit) return TRUE;
+  if (ebi_limits->cancel && *ebi_limits->cancel)
+    hit = LIMIT_CANCELLED;
+  else if (ebi_limits->deadline && --countdown <= 0)
+    {
+    countdown = DEADLINE_INTERVAL;
+    if (now () >= ebi_limits->deadline) hit = LIMIT_DEADLINE;
+    }
+  return hit != LIMIT_NONE;
+  }
+
+
+/*============================================================================
+ebi_limits_exceeded
+If a limit was hit, set an error that says so and return TRUE. If the
+work failed -- most likely because it gave up -- its own error is
+replaced. Limits are checked once more here, so that work that
+finished after its deadline fails too
+============================================================================*/
+BOOL ebi_limits_exceeded (BOOL failed, char **error)
+  {
+  if (!ebi_limits) return FALSE;
+  countdown = 0;
+  if (!ebi_limits_check ()) return FALSE;
+  if (failed) free (*error);
+  if (hit == LIMIT_CANCELLED)
+    asprintf (error, "Cancelled");
+  else
+    asprintf (error, "Deadline exceeded");
+  return TRUE;
+  }
+
+
+/*============================================================================
+ebook_deadline
+============================================================================*/
+unsigned long long ebook_deadline (unsigned int ms)
+  {
+  return now () + ms * 1000000ULL;
+  }
+
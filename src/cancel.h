@@ -0,0 +1,36 @@
+/*============================================================================
+ * libebookinfo
+ * cancel.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebook.h>
+
+/*============================================================================
+Internal side of EBookLimits. ebook.c installs the caller's limits for
+the calling thread around ebook_open_ex() and ebook_get_metadata_ex();
+loops whose length depends on the file test EBI_CANCELLED() and give 
+up when it is TRUE. Once a limit is hit it stays hit, so every loop on
+the way out stops too. With no limits installed, the test is a single
+load
+============================================================================*/
+
+extern __thread const EBookLimits *ebi_limits;
+
+#define EBI_CANCELLED() (ebi_limits && ebi_limits_check ())
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+const EBookLimits *ebi_limits_set (const EBookLimits *limits);
+BOOL               ebi_limits_check (void);
+BOOL               ebi_limits_exceeded (BOOL failed, char **error);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
@@ -19,6 +19,7 @@ Copyright (c)2017 Kevin Boone, GPLv3.0
 #include <ctype.h>
 #include <ebookinfo/constants.h>
 #include "ebistring.h"
+#include "alloc.h"
 
 struct _EBIString
   {
@@ -40,8 +41,8 @@ ebistring_create
 *==========================================================================*/
 EBIString *ebistring_create (const char *s)
   {
-  EBIString *self = malloc (sizeof (EBIString));
-  self->str = strdup (s);
+  EBIString *self = ebi_malloc (sizeof (EBIString));
+  self->str = ebi_strdup (s);
   return self;
   }
 
@@ -53,9 +54,9 @@ void ebistring_destroy (EBIString *self)
   {
   if (self)
     {
-    if (self->str) free (self->str);
+    if (self->str) ebi_free (self->str);
     }
-  free (self);
+  ebi_free (self);
   }
 
 
@@ -91,9 +92,9 @@ ebistring_append
 void ebistring_append (EBIString *self, const char *s) 
   {
   if (!s) return;
-  if (self->str == NULL) self->str = strdup ("");
+  if (self->str == NULL) self->str = ebi_strdup ("");
   int newlen = strlen (self->str) + strlen (s) + 2;
-  self->str = realloc (self->str, newlen);
+  self->str = ebi_realloc (self->str, newlen);
   strcat (self->str, s);
   }
 
@@ -104,14 +105,14 @@ ebistring_prepend
 void ebistring_prepend (EBIString *self, const char *s) 
   {
   if (!s) return;
-  if (self->str == NULL) self->str = strdup ("");
+  if (self->str == NULL) self->str = ebi_strdup ("");
   int newlen = strlen (self->str) + strlen (s) + 2;
-  char *temp = strdup (self->str); 
-  free (self->str);
-  self->str = malloc (newlen);
+  char *temp = ebi_strdup (self->str); 
+  ebi_free (self->str);
+  self->str = ebi_malloc (newlen);
   strcpy (self->str, s);
   strcat (self->str, temp);
-  free (temp);
+  ebi_free (temp);
   }
 
 
@@ -120,7 +121,7 @@ ebistring_append_printf
 *==========================================================================*/
 void ebistring_append_printf (EBIString *self, const char *fmt,...) 
   {
-  if (self->str == NULL) self->str = strdup ("");
+  if (self->str == NULL) self->str = ebi_strdup ("");
   va_list ap;
   va_start (ap, fmt);
   char *s;
@@ -178,10 +179,10 @@ void ebistring_delete (EBIString *self, const int pos, const int len)
     ebistring_delete (self, pos, strlen(str) - len);
   else
     {
-    char *buff = malloc (strlen (str) - len + 2);
+    char *buff = ebi_malloc (strlen (str) - len + 2);
     strncpy (buff, str, pos); 
     strcpy (buff + pos, str + pos + len);
-    free (self->str);
+    ebi_free (self->str);
     self->str = buff;
     }
   }
@@ -193,13 +194,13 @@ ebistring_insert
 void ebistring_insert (EBIString *self, const int pos, 
     const char *replace)
   {
-  char *buff = malloc (strlen (self->str) + strlen (replace) + 2);
+  char *buff = ebi_malloc (strlen (self->str) + strlen (replace) + 2);
   char *str = self->str;
   strncpy (buff, str, pos);
   buff[pos] = 0;
   strcat (buff, replace);
   strcat (buff, str + pos); 
-  free (self->str);
+  ebi_free (self->str);
   self->str = buff;
   }
 
@@ -239,11 +240,11 @@ BOOL ebistring_create_from_utf8_file (const char *filename,
   int f = open (filename, O_RDONLY);
   if (f > 0)
     {
-    self = malloc (sizeof (EBIString));
+    self = ebi_malloc (sizeof (EBIString));
     struct stat sb;
     fstat (f, &sb);
     int64_t size = sb.st_size;
-    char *buff = malloc (size + 2);
+    char *buff = ebi_malloc (size + 2);
     read (f, buff, size);
     self->str = buff; 
     self->str[size] = 0;
@@ -275,7 +276,7 @@ EBIString *ebistring_encode_url (const char *str)
   {
   if (!str) return ebistring_create_empty();;
   const char *pstr = str; 
-  char *buf = malloc(strlen(str) * 3 + 1), *pbuf = buf;
+  char *buf = ebi_malloc (strlen(str) * 3 + 1), *pbuf = buf;
   while (*pstr)
     {
     if (isalnum(*pstr) || *pstr == '-' || *pstr == '_'
@@ -290,7 +291,7 @@ EBIString *ebistring_encode_url (const char *str)
     }
   *pbuf = '\0';
   EBIString *result = ebistring_create (buf);
-  free (buf);
+  ebi_free (buf);
   return (result);
   }
 
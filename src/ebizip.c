@@ -0,0 +1,295 @@
+/*============================================================================
+ * libebookinfo
+ * ebizip.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+ * A minimal, read-only ZIP reader that works on an archive held in
+ * memory. It does not copy the archive: stored entries are returned
+ * in place, and only deflated entries are inflated into a buffer.
+ * ZIP64 archives and encrypted entries are not supported.
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include <zlib.h>
+#include <ebookinfo/constants.h>
+#include "ebizip.h"
+#include "alloc.h"
+#include "stats.h"
+#include "cancel.h"
+
+#define ZIP_LOCAL_SIG   0x04034b50
+#define ZIP_CENTRAL_SIG 0x02014b50
+#define ZIP_END_SIG     0x06054b50
+#define ZIP_LOCAL_LEN   30
+#define ZIP_CENTRAL_LEN 46
+#define ZIP_END_LEN     22
+
+#define ZIP_STORED      0
+#define ZIP_DEFLATED    8
+
+// Output bytes inflated between checks of the caller's limits
+#define INFLATE_CHUNK   (256 * 1024)
+// Deflate can expand its input at most about 1032 times; a claimed size
+//  beyond that, plus a little for very short streams, is a lie
+#define MAX_DEFLATE_RATIO  1032
+#define DEFLATE_SLACK      1024
+
+struct _EBIZip
+  {
+  const unsigned char *data;
+  size_t length;
+  size_t cd_offset;
+  size_t cd_size;
+  int n_entries;
+  };
+
+
+/*============================================================================
+get16, get32
+ZIP integers are little-endian
+============================================================================*/
+static unsigned int get16 (const unsigned char *p)
+  {
+  return p[0] | (p[1] << 8);
+  }
+
+static uint32_t get32 (const unsigned char *p)
+  {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+
+/*============================================================================
+ebizip_open
+Locate the end-of-central-directory record, which is the last thing
+in the archive apart from an optional comment of up to 64k
+============================================================================*/
+EBIZip *ebizip_open (const unsigned char *data, size_t length, char **error)
+  {
+  if (length < ZIP_END_LEN)
+    {
+    asprintf (error, "ZIP archive is truncated");
+    return NULL;
+    }
+
+  size_t limit = length > ZIP_END_LEN + 65535 
+    ? length - ZIP_END_LEN - 65535 : 0;
+  size_t i = length - ZIP_END_LEN;
+  const unsigned char *end = NULL;
+  while (1)
+    {
+    if (get32 (data + i) == ZIP_END_SIG)
+      {
+      end = data + i;
+      break;
+      }
+    if (i == limit) break;
+    i--;
+    }
+
+  if (!end)
+    {
+    asprintf (error, "ZIP archive has no central directory");
+    return NULL;
+    }
+
+  size_t cd_size = get32 (end + 12);
+  size_t cd_offset = get32 (end + 16);
+  if (cd_offset == 0xFFFFFFFF || get16 (end + 10) == 0xFFFF)
+    {
+    asprintf (error, "ZIP64 archives are not supported");
+    return NULL;
+    }
+  if (cd_offset + cd_size > length)
+    {
+    asprintf (error, "ZIP central directory lies outside the archive");
+    return NULL;
+    }
+
+  EBIZip *self = ebi_malloc (sizeof (EBIZip));
+  self->data = data;
+  self->length = length;
+  self->cd_offset = cd_offset;
+  self->cd_size = cd_size;
+  self->n_entries = get16 (end + 10);
+  return self;
+  }
+
+
+/*============================================================================
+ebizip_close
+============================================================================*/
+void ebizip_close (EBIZip *self)
+  {
+  if (self) ebi_free (self);
+  }
+
+
+/*============================================================================
+ebizip_find
+Walk the central directory looking for an entry called name. The walk
+allocates nothing, and stops at the first match
+============================================================================*/
+BOOL ebizip_find (const EBIZip *self, const char *name, EBIZipEntry *entry)
+  {
+  int name_length = strlen (name);
+  const unsigned char *p = self->data + self->cd_offset;
+  const unsigned char *end = p + self->cd_size;
+  int i;
+  for (i = 0; i < self->n_entries; i++)
+    {
+    if (p + ZIP_CENTRAL_LEN > end || get32 (p) != ZIP_CENTRAL_SIG) break;
+    int n = get16 (p + 28);
+    int extra = get16 (p + 30);
+    int comment = get16 (p + 32);
+    if (p + ZIP_CENTRAL_LEN + n > end) break;
+    if (n == name_length 
+        && memcmp (p + ZIP_CENTRAL_LEN, name, name_length) == 0)
+      {
+      entry->name = (const char *)p + ZIP_CENTRAL_LEN;
+      entry->name_length = n;
+      entry->method = get16 (p + 10);
+      entry->compressed_size = get32 (p + 20);
+      entry->size = get32 (p + 24);
+      entry->local_offset = get32 (p + 42);
+      return TRUE;
+      }
+    p += ZIP_CENTRAL_LEN + n + extra + comment;
+    }
+  return FALSE;
+  }
+
+
+/*============================================================================
+zip_alloc, zip_free
+Let zlib allocate its inflate state through the library's allocator
+============================================================================*/
+static voidpf zip_alloc (voidpf opaque, uInt items, uInt size)
+  {
+  return ebi_calloc (items, size);
+  }
+
+static void zip_free (voidpf opaque, voidpf p)
+  {
+  ebi_free (p);
+  }
+
+
+/*============================================================================
+ebizip_read
+Get the contents of an entry. On success, *data and *length describe 
+the contents. If the entry had to be inflated, *buffer is set to 
+the memory that holds it, which the caller must ebi_free(); otherwise
+*data points into the archive and *buffer is NULL. Inflated contents
+are followed by a null, which is not counted in *length
+============================================================================*/
+BOOL ebizip_read (const EBIZip *self, const EBIZipEntry *entry,
+      const unsigned char **data, size_t *length, unsigned char **buffer, 
+      char **error)
+  {
+  *buffer = NULL;
+
+  size_t o = entry->local_offset;
+  if (o + ZIP_LOCAL_LEN > self->length 
+      || get32 (self->data + o) != ZIP_LOCAL_SIG)
+    {
+    asprintf (error, "ZIP entry %.*s has a bad local header", 
+      entry->name_length, entry->name);
+    return FALSE;
+    }
+
+  const unsigned char *local = self->data + o;
+  size_t start = o + ZIP_LOCAL_LEN + get16 (local + 26) + get16 (local + 28);
+  if (start > self->length 
+      || entry->compressed_size > self->length - start)
+    {
+    asprintf (error, "ZIP entry %.*s lies outside the archive", 
+      entry->name_length, entry->name);
+    return FALSE;
+    }
+  if (get16 (local + 6) & 0x0001)
+    {
+    asprintf (error, "ZIP entry %.*s is encrypted", 
+      entry->name_length, entry->name);
+    return FALSE;
+    }
+
+  if (entry->method == ZIP_STORED)
+    {
+    *data = self->data + start;
+    *length = entry->compressed_size;
+    return TRUE;
+    }
+
+  if (entry->method != ZIP_DEFLATED)
+    {
+    asprintf (error, "ZIP entry %.*s uses unsupported method %d", 
+      entry->name_length, entry->name, entry->method);
+    return FALSE;
+    }
+
+  if (entry->size > entry->compressed_size * MAX_DEFLATE_RATIO 
+      + DEFLATE_SLACK)
+    {
+    asprintf (error, "ZIP entry %.*s is corrupt: it claims to inflate to "
+      "%zu bytes from %zu", entry->name_length, entry->name, 
+      entry->size, entry->compressed_size);
+    return FALSE;
+    }
+
+  unsigned char *out = ebi_malloc (entry->size + 1);
+  if (!out)
+    {
+    asprintf (error, "Out of memory inflating ZIP entry %.*s", 
+      entry->name_length, entry->name);
+    return FALSE;
+    }
+
+  z_stream z;
+  memset (&z, 0, sizeof (z));
+  z.zalloc = zip_alloc;
+  z.zfree = zip_free;
+  if (inflateInit2 (&z, -MAX_WBITS) != Z_OK)
+    {
+    asprintf (error, "Can't start inflating ZIP entry %.*s: %s", 
+      entry->name_length, entry->name, z.msg ? z.msg : "out of memory");
+    ebi_free (out);
+    return FALSE;
+    }
+  z.next_in = (unsigned char *)self->data + start;
+  z.avail_in = entry->compressed_size;
+  z.next_out = out;
+
+  // Inflate a piece at a time, so that a huge entry can be abandoned
+  //  part-way. zlib reports Z_BUF_ERROR once it can make no progress,
+  //  which here means the entry is bigger than it claims
+  int r = Z_OK;
+  while (r == Z_OK)
+    {
+    if (EBI_CANCELLED ()) break;
+    size_t room = entry->size - z.total_out;
+    z.avail_out = room < INFLATE_CHUNK ? room : INFLATE_CHUNK;
+    r = inflate (&z, Z_NO_FLUSH);
+    }
+  size_t n = z.total_out;
+  inflateEnd (&z);
+
+  if (r != Z_STREAM_END)
+    {
+    asprintf (error, "ZIP entry %.*s is corrupt", 
+      entry->name_length, entry->name);
+    ebi_free (out);
+    return FALSE;
+    }
+
+  EBI_STATS_COUNT (entries_inflated, 1);
+  EBI_STATS_COUNT (bytes_inflated, n);
+  out[n] = 0;
+  *buffer = out;
+  *data = out;
+  *length = n;
+  return TRUE;
+  }
+
+
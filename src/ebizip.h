@@ -0,0 +1,47 @@
+/*============================================================================
+ * libebookinfo
+ * ebizip.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ebookinfo/constants.h>
+
+struct _EBIZip;
+typedef struct _EBIZip EBIZip;
+
+/*============================================================================
+A ZIP entry, as described by the central directory. name points into
+the archive, and is not null-terminated
+============================================================================*/
+typedef struct _EBIZipEntry
+  {
+  const char *name;
+  int name_length;
+  int method;
+  size_t compressed_size;
+  size_t size;
+  size_t local_offset;
+  } EBIZipEntry;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+EBIZip *ebizip_open (const unsigned char *data, size_t length, 
+          char **error);
+void    ebizip_close (EBIZip *self);
+BOOL    ebizip_find (const EBIZip *self, const char *name, 
+          EBIZipEntry *entry);
+BOOL    ebizip_read (const EBIZip *self, const EBIZipEntry *entry,
+          const unsigned char **data, size_t *length, 
+          unsigned char **buffer, char **error);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
+
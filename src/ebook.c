@@ -9,85 +9,176 @@
 #include <string.h>
 #include <unistd.h>
 #include <malloc.h>
+#include <fcntl.h>
 #include <ebookinfo/ebook.h>
 #include <ebookinfo/ebookmetadata.h>
-#include "mobi.h" 
-#include "epub.h" 
-#include "rtf.h" 
+#include "format.h" 
+#include "metadata.h"
+#include "source.h" 
+#include "alloc.h"
+#include "stats.h"
+#include "trace.h"
+#include "probes.h"
+#include "cancel.h"
 
 /*============================================================================
 private struct ebook
 ============================================================================*/
 struct _EBook
   {
-  int type;
+  const EBookFormat *format;
+  EBookSource source;
   void *data;
+  EBookStringPool *pool;
   };
 
 /*============================================================================
-ebook_open
+read_sniff
+Read the first EBOOK_SNIFF_SIZE bytes of the file (or as many as it
+has) into buff, and return the number read, or -1 on error
 ============================================================================*/
-EBook *ebook_open (const char *filename, char **error)
+static int read_sniff (const char *filename, unsigned char *buff)
+  {
+  int f = open (filename, O_RDONLY);
+  if (f < 0) return -1;
+  int n = pread (f, buff, EBOOK_SNIFF_SIZE, 0);
+  int e = errno;
+  close (f);
+  errno = e;
+  return n;
+  }
+
+/*============================================================================
+count_open
+============================================================================*/
+static void count_open (int type, const EBookSource *source)
+  {
+  if (!ebi_stats_enabled) return;
+  EBookFormatStats *s = ebi_stats_for (type);
+  s->files_opened++;
+  s->bytes_read += source->length;
+  s->syscalls += source->syscalls;
+  }
+
+
+/*============================================================================
+open_source
+Identify the format of an opened source, and hand it to the format's
+open function. The new EBook takes over the source; on failure, the
+source is closed. start is when opening the source began, for the stats
+============================================================================*/
+static EBook *open_source (EBookSource *source, unsigned long long start,
+       char **error)
   {
   EBook *self = NULL;
 
-  if (access (filename, R_OK) == 0)
+  unsigned long long sniff_start = ebi_stats_now ();
+  EBI_TRACE_BEGIN ("recognize", NULL);
+  int n = source->length < EBOOK_SNIFF_SIZE 
+    ? source->length : EBOOK_SNIFF_SIZE;
+  const EBookFormat *format = ebookformat_sniff (source->data, n, NULL);
+  int type = format ? format->type : EBOOK_TYPE_UNKNOWN;
+  EBI_TRACE_END ();
+  EBI_PROBE3 (recognize, source->name, type, n);
+  ebi_stats_phase (type, EBOOK_PHASE_SNIFF, sniff_start);
+  count_open (type, source);
+
+  // The open phase is everything but the sniff
+  if (start) start += ebi_stats_now () - sniff_start;
+
+  if (format)
     {
-    if (mobi_recognize (filename))
-      {
-      self = malloc (sizeof (EBook));
-      memset (self, 0, sizeof (EBook));
-      self->type = EBOOK_TYPE_MOBI;
-      if (mobi_open (self, filename, error))
-        {
-        }
-      else
-        {
-        mobi_close (self);
-        free (self);
-        self = NULL;
-        }
-      } 
-    else if (epub_recognize (filename))
+    int old_type = ebi_stats_format ();
+    ebi_stats_set_format (type);
+    self = ebi_malloc (sizeof (EBook));
+    memset (self, 0, sizeof (EBook));
+    self->format = format;
+    self->source = *source;
+    if (!format->open (self, &self->source, error))
       {
-      self = malloc (sizeof (EBook));
-      memset (self, 0, sizeof (EBook));
-      self->type = EBOOK_TYPE_EPUB;
-      if (epub_open (self, filename, error))
-        {
-        }
-      else
-        {
-        epub_close (self);
-        free (self);
-        self = NULL;
-        }
+      format->close (self);
+      ebooksource_close (&self->source);
+      ebi_free (self);
+      self = NULL;
       }
-    else if (rtf_recognize (filename))
-      {
-      self = malloc (sizeof (EBook));
-      memset (self, 0, sizeof (EBook));
-      self->type = EBOOK_TYPE_RTF;
-      if (rtf_open (self, filename, error))
-        {
-        }
-      else
-        {
-        rtf_close (self);
-        free (self);
-        self = NULL;
-        }
-      }
-    else
-      {
-      asprintf (error, "Book format not recognized"); 
-      }
-   
-    }  
+    ebi_stats_set_format (old_type);
+    }
   else
     {
-    asprintf (error, strerror (errno)); 
+    asprintf (error, "Book format not recognized"); 
+    ebooksource_close (source);
+    }
+
+  ebi_stats_phase (type, EBOOK_PHASE_OPEN, start);
+  EBI_PROBE4 (open__done, self ? self->source.name : NULL, type, 
+    self ? self->source.length : 0, self);
+  return self;
+  }
+
+/*============================================================================
+ebook_open
+============================================================================*/
+EBook *ebook_open (const char *filename, char **error)
+  {
+  EBook *self = NULL;
+  EBookSource source;
+  EBI_TRACE_BEGIN ("open", NULL);
+  EBI_PROBE1 (open__start, filename);
+  unsigned long long start = ebi_stats_now ();
+  if (ebooksource_open_file (&source, filename, error))
+    self = open_source (&source, start, error);
+  EBI_TRACE_END ();
+  return self;
+  }
+
+
+/*============================================================================
+ebook_open_ex
+============================================================================*/
+EBook *ebook_open_ex (const char *filename, const EBookLimits *limits,
+         char **error)
+  {
+  const EBookLimits *old = ebi_limits_set (limits);
+  EBook *self = ebook_open (filename, error);
+  if (ebi_limits_exceeded (self == NULL, error) && self)
+    {
+    ebook_close (self);
+    self = NULL;
     }
+  ebi_limits_set (old);
+  return self;
+  }
+
+
+/*============================================================================
+ebook_open_fd
+============================================================================*/
+EBook *ebook_open_fd (int fd, char **error)
+  {
+  EBook *self = NULL;
+  EBookSource source;
+  EBI_TRACE_BEGIN ("open", NULL);
+  EBI_PROBE1 (open__start, NULL);
+  unsigned long long start = ebi_stats_now ();
+  if (ebooksource_open_fd (&source, fd, error))
+    self = open_source (&source, start, error);
+  EBI_TRACE_END ();
+  return self;
+  }
+
+
+/*============================================================================
+ebook_open_memory
+============================================================================*/
+EBook *ebook_open_memory (const void *buf, size_t length, char **error)
+  {
+  EBookSource source;
+  EBI_TRACE_BEGIN ("open", NULL);
+  EBI_PROBE1 (open__start, NULL);
+  unsigned long long start = ebi_stats_now ();
+  ebooksource_open_memory (&source, buf, length);
+  EBook *self = open_source (&source, start, error);
+  EBI_TRACE_END ();
   return self;
   }
 
@@ -99,29 +190,98 @@ void ebook_close (EBook *self)
   {
   if (self)
     {
-    switch (self->type)
-      {
-      case EBOOK_TYPE_EPUB:
-        epub_close (self);
-        break;
-      case EBOOK_TYPE_MOBI:
-        mobi_close (self);
-        break;
-      case EBOOK_TYPE_RTF:
-        rtf_close (self);
-        break;
-      }
-    free (self);
+    EBI_TRACE_BEGIN ("close", NULL);
+    unsigned long long start = ebi_stats_now ();
+    int type = self->format->type, old_type = ebi_stats_format ();
+    ebi_stats_set_format (type);
+    self->format->close (self);
+    ebooksource_close (&self->source);
+    ebi_free (self);
+    ebi_stats_set_format (old_type);
+    ebi_stats_phase (type, EBOOK_PHASE_CLOSE, start);
+    EBI_TRACE_END ();
     }
   }
 
 
+/*============================================================================
+ebook_probe_fd
+============================================================================*/
+int ebook_probe_fd (int fd, int *confidence, char **error)
+  {
+  int ret = EBOOK_TYPE_UNKNOWN;
+  if (confidence) *confidence = EBOOK_CONFIDENCE_NONE;
+
+  EBI_TRACE_BEGIN ("recognize", NULL);
+  unsigned long long start = ebi_stats_now ();
+  unsigned char sniff[EBOOK_SNIFF_SIZE];
+  int n = pread (fd, sniff, EBOOK_SNIFF_SIZE, 0);
+  if (n >= 0)
+    {
+    const EBookFormat *format = ebookformat_sniff (sniff, n, confidence);
+    if (format) ret = format->type;
+    }
+  else
+    {
+    if (error) asprintf (error, "%s", strerror (errno)); 
+    }
+  if (ebi_stats_enabled) ebi_stats_for (ret)->syscalls++;
+  ebi_stats_phase (ret, EBOOK_PHASE_SNIFF, start);
+  EBI_TRACE_END ();
+  EBI_PROBE3 (recognize, NULL, ret, n);
+  return ret;
+  }
+
+
+/*============================================================================
+ebook_probe
+============================================================================*/
+int ebook_probe (const char *filename, int *confidence, char **error)
+  {
+  int ret = EBOOK_TYPE_UNKNOWN;
+  if (confidence) *confidence = EBOOK_CONFIDENCE_NONE;
+
+  EBI_TRACE_BEGIN ("recognize", NULL);
+  unsigned long long start = ebi_stats_now ();
+  unsigned char sniff[EBOOK_SNIFF_SIZE];
+  int n = read_sniff (filename, sniff);
+  if (n >= 0)
+    {
+    const EBookFormat *format = ebookformat_sniff (sniff, n, confidence);
+    if (format) ret = format->type;
+    }
+  else
+    {
+    if (error) asprintf (error, "%s", strerror (errno)); 
+    }
+  // open, pread and close
+  if (ebi_stats_enabled) ebi_stats_for (ret)->syscalls += 3;
+  ebi_stats_phase (ret, EBOOK_PHASE_SNIFF, start);
+  EBI_TRACE_END ();
+  EBI_PROBE3 (recognize, filename, ret, n);
+  return ret;
+  }
+
+
+/*============================================================================
+ebook_type_name
+============================================================================*/
+const char *ebook_type_name (int type)
+  {
+  const EBookFormat *format = ebookformat_for_type (type);
+  if (format)
+    return format->name;
+  else
+    return "unknown";
+  }
+
+
 /*============================================================================
 ebook_get_type
 ============================================================================*/
 int ebook_get_type (const EBook *self)
   {
-  return self->type;
+  return self->format->type;
   }
 
 
@@ -134,6 +294,15 @@ void *ebook_get_data (const EBook *self)
   }
 
 
+/*============================================================================
+ebook_get_source
+============================================================================*/
+const EBookSource *ebook_get_source (const EBook *self)
+  {
+  return &self->source;
+  }
+
+
 /*============================================================================
 ebook_set_data
 ============================================================================*/
@@ -144,29 +313,37 @@ void ebook_set_data (EBook *self, void *data)
 
 
 /*============================================================================
-ebook_get_metadata
+ebook_set_string_pool
 ============================================================================*/
-EBookMetadata *ebook_get_metadata (const EBook *self, char **error)
+void ebook_set_string_pool (EBook *self, EBookStringPool *pool)
+  {
+  self->pool = pool;
+  }
+
+
+/*============================================================================
+ebook_get_metadata_fields
+The book's string pool, if any, is made the thread's current pool for
+the handler's call, so that the metadata it builds goes into the pool
+============================================================================*/
+EBookMetadata *ebook_get_metadata_fields (const EBook *self, 
+         unsigned int fields, char **error)
   {
   EBookMetadata *ret = NULL;
 
   if (self)
     {
-    switch (self->type)
-      {
-      case EBOOK_TYPE_EPUB:
-        ret = epub_get_metadata (self, error);
-        break;
-      case EBOOK_TYPE_MOBI:
-        ret = mobi_get_metadata (self, error);
-        break;
-      case EBOOK_TYPE_RTF:
-        ret = rtf_get_metadata (self, error);
-        break;
-      default:
-        asprintf (error, 
-           "Internal error: unknown book type %d", self->type);
-      }
+    EBI_TRACE_BEGIN ("metadata", NULL);
+    unsigned long long start = ebi_stats_now ();
+    int type = self->format->type, old_type = ebi_stats_format ();
+    ebi_stats_set_format (type);
+    EBookStringPool *old_pool = ebi_metadata_set_pool (self->pool);
+    ret = self->format->get_metadata (self, fields, error);
+    ebi_metadata_set_pool (old_pool);
+    ebi_stats_set_format (old_type);
+    ebi_stats_phase (type, EBOOK_PHASE_METADATA, start);
+    EBI_TRACE_END ();
+    EBI_PROBE2 (metadata__done, type, ret);
     }
   else
     {
@@ -176,5 +353,32 @@ EBookMetadata *ebook_get_metadata (const EBook *self, char **error)
   }
 
 
+/*============================================================================
+ebook_get_metadata
+============================================================================*/
+EBookMetadata *ebook_get_metadata (const EBook *self, char **error)
+  {
+  return ebook_get_metadata_fields (self, EBOOK_FIELDS_ALL, error);
+  }
+
+
+/*============================================================================
+ebook_get_metadata_ex
+============================================================================*/
+EBookMetadata *ebook_get_metadata_ex (const EBook *self, 
+         unsigned int fields, const EBookLimits *limits, char **error)
+  {
+  const EBookLimits *old = ebi_limits_set (limits);
+  EBookMetadata *ret = ebook_get_metadata_fields (self, fields, error);
+  if (ebi_limits_exceeded (ret == NULL, error) && ret)
+    {
+    ebookmetadata_destroy (ret);
+    ret = NULL;
+    }
+  ebi_limits_set (old);
+  return ret;
+  }
+
+
 
 
@@ -0,0 +1,686 @@
+/*============================================================================
+ * libebookinfo
+ * ebookcatalog.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebook.h>
+#include <ebookinfo/ebookmetadata.h>
+#include <ebookinfo/ebookrecord.h>
+#include <ebookinfo/ebookcatalog.h>
+#include "source.h"
+#include "alloc.h"
+
+#define MAGIC "EBOOKCAT"
+#define VERSION_1 1
+
+// The header
+#define H_VERSION       8
+#define H_N_BOOKS       12
+#define H_BOOK_SIZE     16
+#define H_BOOKS         24
+#define H_STRINGS       32
+#define H_STRINGS_SIZE  40
+#define H_RECORDS       48
+#define H_RECORDS_SIZE  56
+#define H_INDEX         64   // An offset per index
+#define H_INDEX_COUNT   88   // A count per index
+#define HEADER_SIZE     104
+
+// A book
+#define B_FILENAME      0
+#define B_TITLE         4
+#define B_AUTHOR        8
+#define B_YEAR          12
+#define B_TYPE          16
+#define B_RECORD_SIZE   20
+#define B_RECORD        24
+#define BOOK_SIZE       32
+
+typedef struct _Buffer
+  {
+  unsigned char *data;
+  size_t length;
+  size_t size;
+  } Buffer;
+
+struct _EBookCatalogWriter
+  {
+  Buffer strings;
+  Buffer books;
+  Buffer records;
+  uint32_t *hash;        // String offsets, or 0 for an empty slot
+  size_t hash_size;
+  size_t n_strings;
+  int n_books;
+  BOOL too_big;
+  };
+
+struct _EBookCatalog
+  {
+  EBookSource source;
+  const unsigned char *books;
+  const unsigned char *strings;
+  size_t strings_size;
+  const unsigned char *records;
+  size_t records_size;
+  const unsigned char *index[EBOOK_CATALOG_N_INDEXES];
+  int index_count[EBOOK_CATALOG_N_INDEXES];
+  int n_books;
+  size_t book_size;
+  };
+
+
+/*============================================================================
+get32
+============================================================================*/
+static uint32_t get32 (const unsigned char *p)
+  {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+
+/*============================================================================
+get64
+============================================================================*/
+static uint64_t get64 (const unsigned char *p)
+  {
+  return get32 (p) | ((uint64_t)get32 (p + 4) << 32);
+  }
+
+
+/*============================================================================
+put32
+============================================================================*/
+static void put32 (unsigned char *p, uint32_t v)
+  {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+  }
+
+
+/*============================================================================
+put64
+============================================================================*/
+static void put64 (unsigned char *p, uint64_t v)
+  {
+  put32 (p, v);
+  put32 (p + 4, v >> 32);
+  }
+
+
+/*============================================================================
+buffer_grow
+Make room for n more bytes, returning where they start
+============================================================================*/
+static unsigned char *buffer_grow (Buffer *b, size_t n)
+  {
+  if (b->length + n > b->size)
+    {
+    b->size = b->size ? b->size * 2 : 65536;
+    while (b->length + n > b->size) b->size *= 2;
+    b->data = ebi_realloc (b->data, b->size);
+    }
+  unsigned char *p = b->data + b->length;
+  b->length += n;
+  return p;
+  }
+
+
+/*============================================================================
+hash_string
+FNV-1a
+============================================================================*/
+static uint32_t hash_string (const char *s)
+  {
+  uint32_t h = 2166136261u;
+  for (; *s; s++)
+    {
+    h ^= (unsigned char)*s;
+    h *= 16777619u;
+    }
+  return h;
+  }
+
+
+/*============================================================================
+rehash
+============================================================================*/
+static void rehash (EBookCatalogWriter *self)
+  {
+  size_t old_size = self->hash_size, i;
+  uint32_t *old = self->hash;
+  self->hash_size = old_size ? old_size * 2 : 1024;
+  self->hash = ebi_calloc (self->hash_size, sizeof (uint32_t));
+  for (i = 0; i < old_size; i++)
+    {
+    if (!old[i]) continue;
+    const char *s = (const char *)self->strings.data + old[i];
+    size_t j = hash_string (s) & (self->hash_size - 1);
+    while (self->hash[j]) j = (j + 1) & (self->hash_size - 1);
+    self->hash[j] = old[i];
+    }
+  if (old) ebi_free (old);
+  }
+
+
+/*============================================================================
+add_string
+The offset of a string in the string table, adding it if it is not
+there already. NULL and "" are both offset 0
+============================================================================*/
+static uint32_t add_string (EBookCatalogWriter *self, const char *s)
+  {
+  if (!s || !*s) return 0;
+  if (2 * (self->n_strings + 1) > self->hash_size) rehash (self);
+  size_t j = hash_string (s) & (self->hash_size - 1);
+  while (self->hash[j])
+    {
+    if (strcmp ((const char *)self->strings.data + self->hash[j], s) == 0)
+      return self->hash[j];
+    j = (j + 1) & (self->hash_size - 1);
+    }
+  size_t length = strlen (s) + 1;
+  size_t offset = self->strings.length;
+  if (offset + length > UINT32_MAX)
+    {
+    self->too_big = TRUE;
+    return 0;
+    }
+  memcpy (buffer_grow (&self->strings, length), s, length);
+  self->hash[j] = offset;
+  self->n_strings++;
+  return offset;
+  }
+
+
+/*============================================================================
+ebookcatalog_writer_create
+============================================================================*/
+EBookCatalogWriter *ebookcatalog_writer_create (void)
+  {
+  EBookCatalogWriter *self = ebi_calloc (1, sizeof (EBookCatalogWriter));
+  // Offset 0 is the empty string, standing for none
+  *buffer_grow (&self->strings, 1) = 0;
+  return self;
+  }
+
+
+/*============================================================================
+ebookcatalog_writer_destroy
+============================================================================*/
+void ebookcatalog_writer_destroy (EBookCatalogWriter *self)
+  {
+  if (!self) return;
+  if (self->strings.data) ebi_free (self->strings.data);
+  if (self->books.data) ebi_free (self->books.data);
+  if (self->records.data) ebi_free (self->records.data);
+  if (self->hash) ebi_free (self->hash);
+  ebi_free (self);
+  }
+
+
+/*============================================================================
+ebookcatalog_writer_add
+============================================================================*/
+void ebookcatalog_writer_add (EBookCatalogWriter *self, const char *filename,
+       int type, const EBookMetadata *metadata)
+  {
+  const char *year = ebookmetadata_get_year (metadata);
+  size_t record_size = ebookmetadata_encode (metadata, NULL, 0);
+  size_t record = self->records.length;
+  ebookmetadata_encode (metadata, buffer_grow (&self->records, record_size),
+    record_size);
+
+  unsigned char *b = buffer_grow (&self->books, BOOK_SIZE);
+  put32 (b + B_FILENAME, add_string (self, filename));
+  put32 (b + B_TITLE, add_string (self, ebookmetadata_get_title (metadata)));
+  put32 (b + B_AUTHOR,
+    add_string (self, ebookmetadata_get_author (metadata)));
+  put32 (b + B_YEAR, year ? atoi (year) : 0);
+  put32 (b + B_TYPE, type);
+  put32 (b + B_RECORD_SIZE, record_size);
+  put64 (b + B_RECORD, record);
+  self->n_books++;
+  }
+
+
+/*============================================================================
+compare_books
+For sorting an index, with qsort_r(). The argument is the field's
+offset in a book, and the writer
+============================================================================*/
+typedef struct _SortBy
+  {
+  const EBookCatalogWriter *writer;
+  int field;
+  } SortBy;
+
+static int compare_books (const void *a, const void *b, void *arg)
+  {
+  const SortBy *by = arg;
+  uint32_t book_a = *(const uint32_t *)a, book_b = *(const uint32_t *)b;
+  const unsigned char *books = by->writer->books.data;
+  uint32_t va = get32 (books + book_a * BOOK_SIZE + by->field);
+  uint32_t vb = get32 (books + book_b * BOOK_SIZE + by->field);
+  int c;
+  if (by->field == B_YEAR)
+    c = (va > vb) - (va < vb);
+  else
+    {
+    const char *strings = (const char *)by->writer->strings.data;
+    c = strcasecmp (strings + va, strings + vb);
+    }
+  // Books that compare equal stay in the order they were added
+  return c ? c : (book_a > book_b) - (book_a < book_b);
+  }
+
+
+/*============================================================================
+write_section
+Write data at the current position, padded to a multiple of 8 bytes.
+Updates *offset to the position after the padding
+============================================================================*/
+static BOOL write_section (FILE *f, const void *data, size_t length,
+       uint64_t *offset)
+  {
+  static const char zeros[8];
+  size_t pad = (8 - (length & 7)) & 7;
+  if (length && fwrite (data, 1, length, f) != length) return FALSE;
+  if (pad && fwrite (zeros, 1, pad, f) != pad) return FALSE;
+  *offset += length + pad;
+  return TRUE;
+  }
+
+
+/*============================================================================
+ebookcatalog_writer_write
+============================================================================*/
+BOOL ebookcatalog_writer_write (EBookCatalogWriter *self,
+       const char *filename, char **error)
+  {
+  static const int fields[EBOOK_CATALOG_N_INDEXES] =
+    { B_AUTHOR, B_TITLE, B_YEAR };
+
+  if (self->too_big)
+    {
+    asprintf (error, "Can't write catalog %s: too many strings", filename);
+    return FALSE;
+    }
+
+  // The indexes list only the books that have the field
+  uint32_t *index[EBOOK_CATALOG_N_INDEXES];
+  size_t count[EBOOK_CATALOG_N_INDEXES];
+  int i, n;
+  for (i = 0; i < EBOOK_CATALOG_N_INDEXES; i++)
+    {
+    index[i] = ebi_malloc ((self->n_books + 1) * sizeof (uint32_t));
+    count[i] = 0;
+    for (n = 0; n < self->n_books; n++)
+      if (get32 (self->books.data + n * BOOK_SIZE + fields[i]))
+        index[i][count[i]++] = n;
+    SortBy by = { self, fields[i] };
+    qsort_r (index[i], count[i], sizeof (uint32_t), compare_books, &by);
+    for (n = 0; n < count[i]; n++)
+      put32 ((unsigned char *)&index[i][n], index[i][n]);
+    }
+
+  unsigned char header[HEADER_SIZE];
+  memset (header, 0, sizeof (header));
+  memcpy (header, MAGIC, 8);
+  put32 (header + H_VERSION, VERSION_1);
+  put32 (header + H_N_BOOKS, self->n_books);
+  put32 (header + H_BOOK_SIZE, BOOK_SIZE);
+  uint64_t offset = HEADER_SIZE;
+  put64 (header + H_BOOKS, offset);
+  offset += self->books.length;
+  put64 (header + H_STRINGS, offset);
+  put64 (header + H_STRINGS_SIZE, self->strings.length);
+  offset += (self->strings.length + 7) & ~7;
+  for (i = 0; i < EBOOK_CATALOG_N_INDEXES; i++)
+    {
+    put64 (header + H_INDEX + 8 * i, offset);
+    put32 (header + H_INDEX_COUNT + 4 * i, count[i]);
+    offset += (count[i] * sizeof (uint32_t) + 7) & ~7;
+    }
+  put64 (header + H_RECORDS, offset);
+  put64 (header + H_RECORDS_SIZE, self->records.length);
+
+  BOOL ok = FALSE;
+  FILE *f = fopen (filename, "w");
+  if (f)
+    {
+    offset = 0;
+    ok = write_section (f, header, HEADER_SIZE, &offset)
+      && write_section (f, self->books.data, self->books.length, &offset)
+      && write_section (f, self->strings.data, self->strings.length,
+           &offset);
+    for (i = 0; ok && i < EBOOK_CATALOG_N_INDEXES; i++)
+      ok = write_section (f, index[i], count[i] * sizeof (uint32_t),
+        &offset);
+    ok = ok && write_section (f, self->records.data, self->records.length,
+      &offset);
+    if (fclose (f) != 0) ok = FALSE;
+    }
+  if (!ok)
+    asprintf (error, "Can't write catalog %s: %s", filename,
+      strerror (errno));
+
+  for (i = 0; i < EBOOK_CATALOG_N_INDEXES; i++)
+    ebi_free (index[i]);
+  return ok;
+  }
+
+
+/*============================================================================
+section
+Where a section of the file starts, or NULL if it does not lie within
+the file
+============================================================================*/
+static const unsigned char *section (const EBookSource *source,
+       uint64_t offset, uint64_t length)
+  {
+  if (offset > source->length || length > source->length - offset)
+    return NULL;
+  return source->data + offset;
+  }
+
+
+/*============================================================================
+ebookcatalog_open
+Only the header is read, and the sections checked to lie within the
+file. Offsets within the sections are checked as they are used
+============================================================================*/
+EBookCatalog *ebookcatalog_open (const char *filename, char **error)
+  {
+  EBookCatalog *self = ebi_calloc (1, sizeof (EBookCatalog));
+  if (!ebooksource_open_file (&self->source, filename, error))
+    {
+    ebi_free (self);
+    return NULL;
+    }
+
+  const unsigned char *h = self->source.data;
+  BOOL ok = self->source.length >= HEADER_SIZE
+    && memcmp (h, MAGIC, 8) == 0;
+  if (ok && get32 (h + H_VERSION) != VERSION_1)
+    {
+    asprintf (error, "%s: unsupported catalog version %u", filename,
+      get32 (h + H_VERSION));
+    ebookcatalog_close (self);
+    return NULL;
+    }
+  if (ok)
+    {
+    self->n_books = get32 (h + H_N_BOOKS);
+    self->book_size = get32 (h + H_BOOK_SIZE);
+    self->strings_size = get64 (h + H_STRINGS_SIZE);
+    self->records_size = get64 (h + H_RECORDS_SIZE);
+    self->books = section (&self->source, get64 (h + H_BOOKS),
+      (uint64_t)self->n_books * self->book_size);
+    self->strings = section (&self->source, get64 (h + H_STRINGS),
+      self->strings_size);
+    self->records = section (&self->source, get64 (h + H_RECORDS),
+      self->records_size);
+    ok = self->n_books >= 0 && self->book_size >= BOOK_SIZE
+      && self->books && self->strings && self->records
+      && self->strings_size > 0 && self->strings_size <= UINT32_MAX
+      && self->strings[self->strings_size - 1] == 0;
+    int i;
+    for (i = 0; ok && i < EBOOK_CATALOG_N_INDEXES; i++)
+      {
+      self->index_count[i] = get32 (h + H_INDEX_COUNT + 4 * i);
+      self->index[i] = section (&self->source, get64 (h + H_INDEX + 8 * i),
+        (uint64_t)self->index_count[i] * sizeof (uint32_t));
+      ok = self->index[i] && self->index_count[i] >= 0
+        && self->index_count[i] <= self->n_books;
+      }
+    }
+  if (!ok)
+    {
+    asprintf (error, "%s: not a catalog, or damaged", filename);
+    ebookcatalog_close (self);
+    return NULL;
+    }
+  return self;
+  }
+
+
+/*============================================================================
+ebookcatalog_close
+============================================================================*/
+void ebookcatalog_close (EBookCatalog *self)
+  {
+  if (!self) return;
+  ebooksource_close (&self->source);
+  ebi_free (self);
+  }
+
+
+/*============================================================================
+ebookcatalog_count
+============================================================================*/
+int ebookcatalog_count (const EBookCatalog *self)
+  {
+  return self->n_books;
+  }
+
+
+/*============================================================================
+book_field
+============================================================================*/
+static uint32_t book_field (const EBookCatalog *self, int book, int field)
+  {
+  if (book < 0 || book >= self->n_books) return 0;
+  return get32 (self->books + (size_t)book * self->book_size + field);
+  }
+
+
+/*============================================================================
+book_string
+============================================================================*/
+static const char *book_string (const EBookCatalog *self, int book,
+       int field)
+  {
+  uint32_t offset = book_field (self, book, field);
+  if (offset == 0 || offset >= self->strings_size) return NULL;
+  return (const char *)self->strings + offset;
+  }
+
+
+/*============================================================================
+ebookcatalog_get_filename
+============================================================================*/
+const char *ebookcatalog_get_filename (const EBookCatalog *self, int book)
+  {
+  return book_string (self, book, B_FILENAME);
+  }
+
+
+/*============================================================================
+ebookcatalog_get_type
+============================================================================*/
+int ebookcatalog_get_type (const EBookCatalog *self, int book)
+  {
+  return book_field (self, book, B_TYPE);
+  }
+
+
+/*============================================================================
+ebookcatalog_get_title
+============================================================================*/
+const char *ebookcatalog_get_title (const EBookCatalog *self, int book)
+  {
+  return book_string (self, book, B_TITLE);
+  }
+
+
+/*============================================================================
+ebookcatalog_get_author
+============================================================================*/
+const char *ebookcatalog_get_author (const EBookCatalog *self, int book)
+  {
+  return book_string (self, book, B_AUTHOR);
+  }
+
+
+/*============================================================================
+ebookcatalog_get_year
+============================================================================*/
+int ebookcatalog_get_year (const EBookCatalog *self, int book)
+  {
+  return book_field (self, book, B_YEAR);
+  }
+
+
+/*============================================================================
+ebookcatalog_get_record
+============================================================================*/
+BOOL ebookcatalog_get_record (const EBookCatalog *self, int book,
+       EBookRecord *record, char **error)
+  {
+  if (book < 0 || book >= self->n_books)
+    {
+    asprintf (error, "No book %d in the catalog", book);
+    return FALSE;
+    }
+  const unsigned char *b = self->books + (size_t)book * self->book_size;
+  uint64_t offset = get64 (b + B_RECORD), size = get32 (b + B_RECORD_SIZE);
+  if (offset > self->records_size || size > self->records_size - offset)
+    {
+    asprintf (error, "Catalog entry %d is damaged", book);
+    return FALSE;
+    }
+  return ebookrecord_open (record, self->records + offset, size, error);
+  }
+
+
+/*============================================================================
+ebookcatalog_index_count
+============================================================================*/
+int ebookcatalog_index_count (const EBookCatalog *self, int index)
+  {
+  if (index < 0 || index >= EBOOK_CATALOG_N_INDEXES) return 0;
+  return self->index_count[index];
+  }
+
+
+/*============================================================================
+ebookcatalog_index_book
+============================================================================*/
+int ebookcatalog_index_book (const EBookCatalog *self, int index,
+      int position)
+  {
+  if (position < 0 || position >= ebookcatalog_index_count (self, index))
+    return -1;
+  return get32 (self->index[index] + (size_t)position * sizeof (uint32_t));
+  }
+
+
+/*============================================================================
+compare_at
+Compare the field of the book at a position in an index with a value:
+a year, or a string, which is a prefix if n is not -1
+============================================================================*/
+static int compare_at (const EBookCatalog *self, int index, int position,
+       const char *s, int n, int year)
+  {
+  int book = ebookcatalog_index_book (self, index, position);
+  if (index == EBOOK_CATALOG_BY_YEAR)
+    {
+    int v = ebookcatalog_get_year (self, book);
+    return (v > year) - (v < year);
+    }
+  const char *v = index == EBOOK_CATALOG_BY_AUTHOR
+    ? ebookcatalog_get_author (self, book)
+    : ebookcatalog_get_title (self, book);
+  if (!v) v = "";
+  return n >= 0 ? strncasecmp (v, s, n) : strcasecmp (v, s);
+  }
+
+
+/*============================================================================
+search
+The first position in an index whose field is greater than the value,
+or, if or_equal, not less than it
+============================================================================*/
+static int search (const EBookCatalog *self, int index, const char *s,
+       int n, int year, BOOL or_equal)
+  {
+  int lo = 0, hi = ebookcatalog_index_count (self, index);
+  while (lo < hi)
+    {
+    int mid = lo + (hi - lo) / 2;
+    int c = compare_at (self, index, mid, s, n, year);
+    if (c < 0 || (c == 0 && !or_equal))
+      lo = mid + 1;
+    else
+      hi = mid;
+    }
+  return lo;
+  }
+
+
+/*============================================================================
+ebookcatalog_matches
+============================================================================*/
+BOOL ebookcatalog_matches (const EBookCatalog *self, int index, int book,
+       const char *from, const char *to)
+  {
+  if (index < 0 || index >= EBOOK_CATALOG_N_INDEXES || !from) return FALSE;
+  if (index == EBOOK_CATALOG_BY_YEAR)
+    {
+    int year = ebookcatalog_get_year (self, book);
+    return year && year >= atoi (from) && year <= atoi (to ? to : from);
+    }
+  const char *v = index == EBOOK_CATALOG_BY_AUTHOR
+    ? ebookcatalog_get_author (self, book)
+    : ebookcatalog_get_title (self, book);
+  if (!v) return FALSE;
+  size_t n = strlen (from);
+  if (!to && n > 0 && from[n - 1] == '*')
+    return strncasecmp (v, from, n - 1) == 0;
+  return strcasecmp (v, from) >= 0 && strcasecmp (v, to ? to : from) <= 0;
+  }
+
+
+/*============================================================================
+ebookcatalog_find
+============================================================================*/
+int ebookcatalog_find (const EBookCatalog *self, int index,
+      const char *from, const char *to, int *first)
+  {
+  *first = 0;
+  if (index < 0 || index >= EBOOK_CATALOG_N_INDEXES || !from) return 0;
+  int start, end;
+  if (index == EBOOK_CATALOG_BY_YEAR)
+    {
+    start = search (self, index, NULL, -1, atoi (from), TRUE);
+    end = search (self, index, NULL, -1, atoi (to ? to : from), FALSE);
+    }
+  else
+    {
+    int n = strlen (from);
+    if (!to && n > 0 && from[n - 1] == '*')
+      {
+      start = search (self, index, from, n - 1, 0, TRUE);
+      end = search (self, index, from, n - 1, 0, FALSE);
+      }
+    else
+      {
+      start = search (self, index, from, -1, 0, TRUE);
+      end = search (self, index, to ? to : from, -1, 0, FALSE);
+      }
+    }
+  *first = start;
+  return end > start ? end - start : 0;
+  }
+
@@ -11,22 +11,335 @@
 #include <malloc.h>
 #include <ebookinfo/ebook.h>
 #include <ebookinfo/ebookmetadata.h>
-#include "mobi.h" 
-#include "epub.h" 
-#include "rtf.h" 
+#include <ebookinfo/stringpool.h>
+#include "metadata.h"
+#include "sortkey.h"
+#include "alloc.h"
+
+typedef struct _MDValue
+  {
+  char *value;
+  char *qualifier;
+  } MDValue;
 
 /*============================================================================
 private struct ebookmetadata
+The structure, its values and their strings are one allocation: the 
+values follow the header, grouped by key, and the packed, 
+NUL-terminated strings follow the values. The classic fields point 
+at the same strings where they can. So a clone is one allocation and
+a memcpy(), with the pointers moved along -- except for metadata
+interned in a string pool, whose commonly repeated strings are in the
+pool, and not in the block at all. The sort keys are made along with
+the classic fields, and are in the block too. A classic field changed 
+with one of the setters gets a string of its own, marked in owned, 
+and freed on destroy, and so does its sort key, if it has one; edited
+marks every classic field that has been set, even to NULL. refs is 
+only ever changed atomically; everything else is fixed once the 
+object has been shared, and the public setters refuse to change it
 ============================================================================*/
 struct _EBookMetadata
   {
-  char *title;
-  char *author;
-  char *year;
-  char *genre;
-  char *comment;
+  int refs;
+  size_t size;
+  unsigned int owned;
+  unsigned int edited;
+  char *fields[N_ALL_FIELDS];
+  int date[3];
+  int first[EBOOK_N_KEYS];
+  int count[EBOOK_N_KEYS];
+  int n_values;
+  MDValue values[];
   };
 
+// The pool that builders started on this thread pack into, if any
+static __thread EBookStringPool *current_pool;
+
+static const char *key_names[EBOOK_N_KEYS] =
+  {
+  "title", "creator", "subject", "description", "date", "language",
+  "publisher", "identifier", "series", "series-index"
+  };
+
+
+/*============================================================================
+parse_digits
+============================================================================*/
+static int parse_digits (const char *s, size_t length, int n)
+  {
+  if ((size_t)n > length) return -1;
+  int i, v = 0;
+  for (i = 0; i < n; i++)
+    {
+    if (s[i] < '0' || s[i] > '9') return -1;
+    v = v * 10 + s[i] - '0';
+    }
+  return v;
+  }
+
+
+/*============================================================================
+parse_date
+Read YYYY, YYYY-MM or YYYY-MM-DD from the start of a date, ignoring
+anything after it, such as a time. Returns FALSE, with date all 0, if
+there is not even a year
+============================================================================*/
+static BOOL parse_date (const char *s, size_t length, int *date)
+  {
+  memset (date, 0, 3 * sizeof (int));
+  while (length && (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r'))
+    {
+    s++;
+    length--;
+    }
+  int year = parse_digits (s, length, 4);
+  if (year < 0) return FALSE;
+  date[0] = year;
+  if (length < 7 || s[4] != '-') return TRUE;
+  int month = parse_digits (s + 5, length - 5, 2);
+  if (month < 1 || month > 12) return TRUE;
+  date[1] = month;
+  if (length < 10 || s[7] != '-') return TRUE;
+  int day = parse_digits (s + 8, length - 8, 2);
+  if (day >= 1 && day <= 31) date[2] = day;
+  return TRUE;
+  }
+
+
+/*============================================================================
+put
+Copy a string into the packed area, returning where it went
+============================================================================*/
+static char *put (char **p, const char *s, size_t n)
+  {
+  char *ret = *p;
+  memcpy (ret, s, n);
+  ret[n] = 0;
+  *p += n + 1;
+  return ret;
+  }
+
+
+/*============================================================================
+first_value
+============================================================================*/
+static char *first_value (const EBookMetadata *self, int key)
+  {
+  if (self->count[key] == 0) return NULL;
+  return self->values[self->first[key]].value;
+  }
+
+
+/*============================================================================
+is_author
+Whether a creator's role makes it the author: no role, or "aut"
+============================================================================*/
+static BOOL is_author (const char *role, size_t length)
+  {
+  if (!role) return TRUE;
+  return strnlen (role, length) == 3 && strncasecmp (role, "aut", 3) == 0;
+  }
+
+
+/*============================================================================
+pooled
+Whether a key's values go in the pool, if there is one. These are
+the keys whose values repeat from book to book
+============================================================================*/
+static BOOL pooled (const EBookStringPool *pool, int key)
+  {
+  if (!pool) return FALSE;
+  return key == EBOOK_KEY_CREATOR || key == EBOOK_KEY_SUBJECT
+    || key == EBOOK_KEY_LANGUAGE || key == EBOOK_KEY_PUBLISHER
+    || key == EBOOK_KEY_SERIES;
+  }
+
+
+/*============================================================================
+pack
+One allocation holding the given values. Values whose key is out of
+range, including replaced values, are skipped. With a pool, the 
+values of the pooled keys, the qualifiers, the year and the genre are
+interned in it, rather than copied into the block
+============================================================================*/
+static EBookMetadata *pack (const EBIMDValue *in, int n_in,
+       EBookStringPool *pool)
+  {
+  int count[EBOOK_N_KEYS];
+  memset (count, 0, sizeof (count));
+  int date[3] = { 0, 0, 0 };
+  BOOL have_date = FALSE;
+  char iso[16];
+  size_t strings = 0, subjects = 0;
+  // The values the author and title will be, and the language, for
+  //  the sort keys
+  const EBIMDValue *title = NULL, *author = NULL, *creator = NULL;
+  char language[8] = "";
+  int i, n = 0;
+  for (i = 0; i < n_in; i++)
+    {
+    const EBIMDValue *v = &in[i];
+    if (v->key < 0 || v->key >= EBOOK_N_KEYS) continue;
+    size_t length = strnlen (v->value, v->length);
+    if (v->key == EBOOK_KEY_TITLE && !title) title = v;
+    if (v->key == EBOOK_KEY_CREATOR && !creator) creator = v;
+    if (v->key == EBOOK_KEY_CREATOR && !author 
+        && is_author (v->qualifier, v->qualifier_length))
+      author = v;
+    if (v->key == EBOOK_KEY_LANGUAGE && count[v->key] == 0)
+      {
+      size_t l = length < sizeof (language) ? length : sizeof (language) - 1;
+      memcpy (language, v->value, l);
+      language[l] = 0;
+      }
+    if (v->key == EBOOK_KEY_DATE && count[v->key] == 0
+        && parse_date (v->value, length, date))
+      {
+      have_date = TRUE;
+      if (date[2])
+        snprintf (iso, sizeof (iso), "%04d-%02d-%02d", date[0], date[1],
+          date[2]);
+      else if (date[1])
+        snprintf (iso, sizeof (iso), "%04d-%02d", date[0], date[1]);
+      else
+        snprintf (iso, sizeof (iso), "%04d", date[0]);
+      length = strlen (iso);
+      }
+    if (!pooled (pool, v->key)) strings += length + 1;
+    if (v->qualifier && !pool) 
+      strings += strnlen (v->qualifier, v->qualifier_length) + 1;
+    if (v->key == EBOOK_KEY_SUBJECT) subjects += length + 1;
+    count[v->key]++;
+    n++;
+    }
+  // The year, and the subjects joined into a genre, if there is more
+  //  than one of them
+  if (!pool)
+    {
+    if (have_date) strings += 5;
+    if (count[EBOOK_KEY_SUBJECT] > 1) strings += subjects;
+    }
+  if (!author) author = creator;
+  char *author_sort = author 
+    ? ebi_sortkey_author (author->value, author->length) : NULL;
+  char *title_sort = title 
+    ? ebi_sortkey_title (title->value, title->length, 
+        language[0] ? language : NULL) 
+    : NULL;
+  if (author_sort && !pool) strings += strlen (author_sort) + 1;
+  if (title_sort) strings += strlen (title_sort) + 1;
+
+  size_t size = sizeof (EBookMetadata) + n * sizeof (MDValue) + strings;
+  EBookMetadata *self = ebi_malloc (size);
+  memset (self, 0, sizeof (EBookMetadata));
+  self->refs = 1;
+  self->size = size;
+  self->n_values = n;
+  memcpy (self->date, date, sizeof (date));
+  int k, next = 0;
+  for (k = 0; k < EBOOK_N_KEYS; k++)
+    {
+    self->first[k] = next;
+    next += count[k];
+    }
+
+  char *p = (char *)(self->values + n);
+  int filled[EBOOK_N_KEYS];
+  memset (filled, 0, sizeof (filled));
+  for (i = 0; i < n_in; i++)
+    {
+    const EBIMDValue *v = &in[i];
+    if (v->key < 0 || v->key >= EBOOK_N_KEYS) continue;
+    MDValue *out = &self->values[self->first[v->key] + filled[v->key]];
+    if (v->key == EBOOK_KEY_DATE && filled[v->key] == 0 && have_date)
+      out->value = put (&p, iso, strlen (iso));
+    else if (pooled (pool, v->key))
+      out->value = (char *)ebookstringpool_intern (pool, v->value, v->length);
+    else
+      out->value = put (&p, v->value, strnlen (v->value, v->length));
+    if (!v->qualifier)
+      out->qualifier = NULL;
+    else if (pool)
+      out->qualifier = (char *)ebookstringpool_intern (pool, v->qualifier,
+        v->qualifier_length);
+    else
+      out->qualifier = put (&p, v->qualifier, 
+        strnlen (v->qualifier, v->qualifier_length));
+    filled[v->key]++;
+    }
+  memcpy (self->count, filled, sizeof (self->count));
+
+  // The classic fields
+  self->fields[FIELD_TITLE] = first_value (self, EBOOK_KEY_TITLE);
+  self->fields[FIELD_COMMENT] = first_value (self, EBOOK_KEY_DESCRIPTION);
+  for (i = 0; i < count[EBOOK_KEY_CREATOR]; i++)
+    {
+    const MDValue *v = &self->values[self->first[EBOOK_KEY_CREATOR] + i];
+    if (is_author (v->qualifier, -1))
+      {
+      self->fields[FIELD_AUTHOR] = v->value;
+      break;
+      }
+    }
+  if (!self->fields[FIELD_AUTHOR])
+    self->fields[FIELD_AUTHOR] = first_value (self, EBOOK_KEY_CREATOR);
+  if (have_date && pool)
+    {
+    char year[5];
+    snprintf (year, sizeof (year), "%04d", date[0]);
+    self->fields[FIELD_YEAR] = (char *)ebookstringpool_intern (pool, year, 4);
+    }
+  else if (have_date)
+    {
+    snprintf (p, 5, "%04d", date[0]);
+    self->fields[FIELD_YEAR] = p;
+    p += 5;
+    }
+  if (count[EBOOK_KEY_SUBJECT] == 1)
+    self->fields[FIELD_GENRE] = first_value (self, EBOOK_KEY_SUBJECT);
+  else if (count[EBOOK_KEY_SUBJECT] > 1)
+    {
+    // Joined in place, or in a scratch copy to be interned
+    char *genre = pool ? ebi_malloc (subjects) : p;
+    char *g = genre;
+    for (i = 0; i < count[EBOOK_KEY_SUBJECT]; i++)
+      {
+      const char *s = self->values[self->first[EBOOK_KEY_SUBJECT] + i].value;
+      size_t length = strlen (s);
+      memcpy (g, s, length);
+      g += length;
+      *g++ = ',';
+      }
+    g[-1] = 0;
+    if (pool)
+      {
+      self->fields[FIELD_GENRE] = 
+        (char *)ebookstringpool_intern (pool, genre, -1);
+      ebi_free (genre);
+      }
+    else
+      {
+      self->fields[FIELD_GENRE] = genre;
+      p = g;
+      }
+    }
+
+  // The sort keys
+  if (author_sort && pool)
+    self->fields[FIELD_AUTHOR_SORT] = 
+      (char *)ebookstringpool_intern (pool, author_sort, -1);
+  else if (author_sort)
+    self->fields[FIELD_AUTHOR_SORT] = 
+      put (&p, author_sort, strlen (author_sort));
+  if (title_sort)
+    self->fields[FIELD_TITLE_SORT] = 
+      put (&p, title_sort, strlen (title_sort));
+  if (author_sort) ebi_free (author_sort);
+  if (title_sort) ebi_free (title_sort);
+
+  return self;
+  }
+
 
 /*============================================================================
 create
@@ -34,50 +347,215 @@ create
 EBookMetadata *ebookmetadata_create (const char *title, const char *author,
                  const char *year, const char *genre, const char *comment)
   {
-  EBookMetadata *self = malloc (sizeof (EBookMetadata));
-  memset (self, 0, sizeof (EBookMetadata));
-  if (title) ebookmetadata_set_title (self, title);
-  if (author) ebookmetadata_set_author (self, author);
-  if (year) ebookmetadata_set_year (self, year);
-  if (genre) ebookmetadata_set_genre (self, genre);
-  if (comment) ebookmetadata_set_comment (self, comment);
+  EBIMDBuilder builder;
+  ebi_mdbuilder_init (&builder, EBOOK_FIELDS_ALL);
+  if (title) ebi_mdbuilder_set (&builder, EBOOK_KEY_TITLE, title, -1);
+  if (author) ebi_mdbuilder_set (&builder, EBOOK_KEY_CREATOR, author, -1);
+  if (year) ebi_mdbuilder_set (&builder, EBOOK_KEY_DATE, year, -1);
+  if (genre) ebi_mdbuilder_set (&builder, EBOOK_KEY_SUBJECT, genre, -1);
+  if (comment) ebi_mdbuilder_set (&builder, EBOOK_KEY_DESCRIPTION, comment, -1);
+  EBookMetadata *self = ebi_mdbuilder_build (&builder);
+  ebi_mdbuilder_clear (&builder);
   return self;
   }
 
 
+/*============================================================================
+create_values
+============================================================================*/
+EBookMetadata *ebookmetadata_create_values (int n, const int *keys, 
+                 const char *const *values, const char *const *qualifiers)
+  {
+  EBIMDBuilder builder;
+  ebi_mdbuilder_init (&builder, EBOOK_FIELDS_ALL);
+  int i;
+  for (i = 0; i < n; i++)
+    {
+    const char *qualifier = qualifiers ? qualifiers[i] : NULL;
+    if (keys[i] < 0 || keys[i] >= EBOOK_N_KEYS) continue;
+    ebi_mdbuilder_add (&builder, keys[i], values[i], -1, qualifier, -1);
+    }
+  EBookMetadata *self = ebi_mdbuilder_build (&builder);
+  ebi_mdbuilder_clear (&builder);
+  return self;
+  }
+
+
+/*============================================================================
+rebase
+Move a pointer into one copy of the block to the same place in another.
+A pointer outside the block, into a string pool, stays as it is
+============================================================================*/
+static char *rebase (const EBookMetadata *from, EBookMetadata *to, char *p)
+  {
+  if (!p) return NULL;
+  const char *start = (const char *)from;
+  if (p < start || p >= start + from->size) return p;
+  return (char *)to + (p - start);
+  }
+
+
 /*============================================================================
 clone
 ============================================================================*/
 EBookMetadata *ebookmetadata_clone (const EBookMetadata *self)
   {
-  return ebookmetadata_create (
-    ebookmetadata_get_title (self),
-    ebookmetadata_get_author (self),
-    ebookmetadata_get_year (self),
-    ebookmetadata_get_genre (self),
-    ebookmetadata_get_comment (self));
+  EBookMetadata *clone = ebi_malloc (self->size);
+  memcpy (clone, self, self->size);
+  clone->refs = 1;
+  int i;
+  for (i = 0; i < N_ALL_FIELDS; i++)
+    {
+    if (self->owned & (1 << i))
+      clone->fields[i] = ebi_strdup (self->fields[i]);
+    else
+      clone->fields[i] = rebase (self, clone, self->fields[i]);
+    }
+  for (i = 0; i < self->n_values; i++)
+    {
+    clone->values[i].value = rebase (self, clone, self->values[i].value);
+    clone->values[i].qualifier = 
+      rebase (self, clone, self->values[i].qualifier);
+    }
+  return clone;
   }
 
 
 /*============================================================================
-get_author
+retain
 ============================================================================*/
-const char *ebookmetadata_get_author (const EBookMetadata *self)
+EBookMetadata *ebookmetadata_retain (EBookMetadata *self)
+  {
+  if (self) __atomic_fetch_add (&self->refs, 1, __ATOMIC_RELAXED);
+  return self;
+  }
+
+
+/*============================================================================
+get_field
+============================================================================*/
+static const char *get_field (const EBookMetadata *self, int field)
   {
   if (self)
-    return self->author;
+    return self->fields[field];
   else 
     return NULL;
   }
 
 
+/*============================================================================
+set_owned
+Give a field a string of its own, which may be NULL
+============================================================================*/
+static void set_owned (EBookMetadata *self, int field, char *value)
+  {
+  if (self->owned & (1 << field)) ebi_free (self->fields[field]);
+  self->fields[field] = value;
+  if (value)
+    self->owned |= (1 << field);
+  else
+    self->owned &= ~(1 << field);
+  }
+
+
+/*============================================================================
+set_field
+Set a classic field, and its sort key along with it
+============================================================================*/
+static void set_field (EBookMetadata *self, int field, const char *value)
+  {
+  set_owned (self, field, value ? ebi_strdup (value) : NULL);
+  self->edited |= (1 << field);
+  if (field == FIELD_AUTHOR)
+    set_owned (self, FIELD_AUTHOR_SORT, ebi_sortkey_author (value, -1));
+  else if (field == FIELD_TITLE)
+    set_owned (self, FIELD_TITLE_SORT, ebi_sortkey_title (value, -1, 
+      first_value (self, EBOOK_KEY_LANGUAGE)));
+  }
+
+
+/*============================================================================
+set_public
+The public setters may change only an object that nobody else holds.
+A shared object -- such as the one a book caches and hands out from
+ebook_get_metadata() -- may be being read by other threads, and will
+be handed to later callers, so it is left alone
+============================================================================*/
+static BOOL set_public (EBookMetadata *self, int field, const char *value)
+  {
+  if (!self) return FALSE;
+  if (__atomic_load_n (&self->refs, __ATOMIC_ACQUIRE) > 1)
+    {
+    fprintf (stderr, "libebookinfo: metadata is shared, and can't be "
+      "changed; use ebookmetadata_clone() for a copy that can\n");
+    return FALSE;
+    }
+  set_field (self, field, value);
+  return TRUE;
+  }
+
+
+/*============================================================================
+ebi_metadata_edited
+============================================================================*/
+unsigned int ebi_metadata_edited (const EBookMetadata *self)
+  {
+  return self->edited;
+  }
+
+
+/*============================================================================
+ebi_metadata_get_field
+============================================================================*/
+const char *ebi_metadata_get_field (const EBookMetadata *self, int field)
+  {
+  return get_field (self, field);
+  }
+
+
+/*============================================================================
+ebi_metadata_set_field
+============================================================================*/
+void ebi_metadata_set_field (EBookMetadata *self, int field, 
+       const char *value)
+  {
+  set_field (self, field, value);
+  }
+
+
+/*============================================================================
+get_author
+============================================================================*/
+const char *ebookmetadata_get_author (const EBookMetadata *self)
+  {
+  return get_field (self, FIELD_AUTHOR);
+  }
+
+
 /*============================================================================
 set_author
 ============================================================================*/
-void ebookmetadata_set_author (EBookMetadata *self, const char *author)
+BOOL ebookmetadata_set_author (EBookMetadata *self, const char *author)
+  {
+  return set_public (self, FIELD_AUTHOR, author);
+  }
+
+
+/*============================================================================
+get_author_sort
+============================================================================*/
+const char *ebookmetadata_get_author_sort (const EBookMetadata *self)
   {
-  if (self->author) free (self->author);
-  self->author = strdup (author);
+  return get_field (self, FIELD_AUTHOR_SORT);
+  }
+
+
+/*============================================================================
+get_title_sort
+============================================================================*/
+const char *ebookmetadata_get_title_sort (const EBookMetadata *self)
+  {
+  return get_field (self, FIELD_TITLE_SORT);
   }
 
 
@@ -86,20 +564,16 @@ get_title
 ============================================================================*/
 const char *ebookmetadata_get_title (const EBookMetadata *self)
   {
-  if (self)
-    return self->title;
-  else 
-    return NULL;
+  return get_field (self, FIELD_TITLE);
   }
 
 
 /*============================================================================
 set_title
 ============================================================================*/
-void ebookmetadata_set_title (EBookMetadata *self, const char *title)
+BOOL ebookmetadata_set_title (EBookMetadata *self, const char *title)
   {
-  if (self->title) free (self->title);
-  self->title = strdup (title);
+  return set_public (self, FIELD_TITLE, title);
   }
 
 
@@ -108,20 +582,16 @@ get_year
 ============================================================================*/
 const char *ebookmetadata_get_year (const EBookMetadata *self)
   {
-  if (self)
-    return self->year;
-  else 
-    return NULL;
+  return get_field (self, FIELD_YEAR);
   }
 
 
 /*============================================================================
 set_year
 ============================================================================*/
-void ebookmetadata_set_year (EBookMetadata *self, const char *year)
+BOOL ebookmetadata_set_year (EBookMetadata *self, const char *year)
   {
-  if (self->year) free (self->year);
-  self->year = strdup (year);
+  return set_public (self, FIELD_YEAR, year);
   }
 
 
@@ -130,20 +600,16 @@ get_genre
 ============================================================================*/
 const char *ebookmetadata_get_genre (const EBookMetadata *self)
   {
-  if (self)
-    return self->genre;
-  else 
-    return NULL;
+  return get_field (self, FIELD_GENRE);
   }
 
 
 /*============================================================================
 set_genre
 ============================================================================*/
-void ebookmetadata_set_genre (EBookMetadata *self, const char *genre)
+BOOL ebookmetadata_set_genre (EBookMetadata *self, const char *genre)
   {
-  if (self->genre) free (self->genre);
-  self->genre = strdup (genre);
+  return set_public (self, FIELD_GENRE, genre);
   }
 
 
@@ -152,20 +618,82 @@ get_comment
 ============================================================================*/
 const char *ebookmetadata_get_comment (const EBookMetadata *self)
   {
-  if (self)
-    return self->comment;
-  else 
-    return NULL;
+  return get_field (self, FIELD_COMMENT);
   }
 
 
 /*============================================================================
 set_comment
 ============================================================================*/
-void ebookmetadata_set_comment (EBookMetadata *self, const char *comment)
+BOOL ebookmetadata_set_comment (EBookMetadata *self, const char *comment)
+  {
+  return set_public (self, FIELD_COMMENT, comment);
+  }
+
+
+/*============================================================================
+ebookmetadata_count
+============================================================================*/
+int ebookmetadata_count (const EBookMetadata *self, int key)
+  {
+  if (!self || key < 0 || key >= EBOOK_N_KEYS) return 0;
+  return self->count[key];
+  }
+
+
+/*============================================================================
+ebookmetadata_get
+============================================================================*/
+const char *ebookmetadata_get (const EBookMetadata *self, int key, int i)
+  {
+  if (i < 0 || i >= ebookmetadata_count (self, key)) return NULL;
+  return self->values[self->first[key] + i].value;
+  }
+
+
+/*============================================================================
+ebookmetadata_get_qualifier
+============================================================================*/
+const char *ebookmetadata_get_qualifier (const EBookMetadata *self, 
+              int key, int i)
   {
-  if (self->comment) free (self->comment);
-  self->comment = strdup (comment);
+  if (i < 0 || i >= ebookmetadata_count (self, key)) return NULL;
+  return self->values[self->first[key] + i].qualifier;
+  }
+
+
+/*============================================================================
+ebookmetadata_get_date
+============================================================================*/
+BOOL ebookmetadata_get_date (const EBookMetadata *self, 
+       int *year, int *month, int *day)
+  {
+  if (year) *year = self ? self->date[0] : 0;
+  if (month) *month = self ? self->date[1] : 0;
+  if (day) *day = self ? self->date[2] : 0;
+  return self && self->date[0] != 0;
+  }
+
+
+/*============================================================================
+ebookmetadata_key
+============================================================================*/
+int ebookmetadata_key (const char *name)
+  {
+  int i;
+  for (i = 0; i < EBOOK_N_KEYS; i++)
+    if (strcmp (key_names[i], name) == 0) return i;
+  return -1;
+  }
+
+
+/*============================================================================
+ebookmetadata_key_name
+============================================================================*/
+const char *ebookmetadata_key_name (int key)
+  {
+  if (key < 0 || key >= EBOOK_N_KEYS) return NULL;
+  return key_names[key];
   }
 
 
@@ -174,18 +702,183 @@ destroy
 ============================================================================*/
 void ebookmetadata_destroy (EBookMetadata *self)
   {
-  if (self)
+  // The release ordering makes this thread's reads of the object
+  //  happen before whichever thread frees it
+  if (self && __atomic_sub_fetch (&self->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+    int i;
+    for (i = 0; i < N_ALL_FIELDS; i++)
+      if (self->owned & (1 << i)) ebi_free (self->fields[i]);
+    ebi_free (self);
+    }
+  }
+
+
+/*============================================================================
+ebi_metadata_set_pool
+============================================================================*/
+EBookStringPool *ebi_metadata_set_pool (EBookStringPool *pool)
+  {
+  EBookStringPool *old = current_pool;
+  current_pool = pool;
+  return old;
+  }
+
+
+/*============================================================================
+ebi_mdbuilder_init
+============================================================================*/
+void ebi_mdbuilder_init (EBIMDBuilder *self, unsigned int fields)
+  {
+  self->pool = current_pool;
+  self->fields = fields;
+  self->found = 0;
+  self->values = self->inline_values;
+  self->n_values = 0;
+  self->size = EBI_MDBUILDER_INLINE;
+  self->kept = NULL;
+  self->n_kept = 0;
+  }
+
+
+/*============================================================================
+ebi_mdbuilder_add
+Add a value to a key. qualifier may be NULL
+============================================================================*/
+void ebi_mdbuilder_add (EBIMDBuilder *self, int key, const char *value, 
+       size_t length, const char *qualifier, size_t qualifier_length)
+  {
+  if (!value || !ebi_mdbuilder_wants (self, key)) return;
+  if (self->n_values == self->size)
     {
-    if (self->title) free (self->title);
-    if (self->author) free (self->author);
-    if (self->year) free (self->year);
-    if (self->genre) free (self->genre);
-    if (self->comment) free (self->comment);
-    free (self);
+    self->size *= 2;
+    if (self->values == self->inline_values)
+      {
+      self->values = ebi_malloc (self->size * sizeof (EBIMDValue));
+      memcpy (self->values, self->inline_values, 
+        sizeof (self->inline_values));
+      }
+    else
+      self->values = ebi_realloc (self->values, 
+        self->size * sizeof (EBIMDValue));
     }
+  EBIMDValue *v = &self->values[self->n_values++];
+  v->key = key;
+  v->value = value;
+  v->length = length;
+  v->qualifier = qualifier;
+  v->qualifier_length = qualifier_length;
+  self->found |= EBOOK_FIELD (key);
+  }
+
+
+/*============================================================================
+ebi_mdbuilder_set
+Replace any values a key has with this one
+============================================================================*/
+void ebi_mdbuilder_set (EBIMDBuilder *self, int key, const char *value,
+       size_t length)
+  {
+  int i;
+  for (i = 0; i < self->n_values; i++)
+    if (self->values[i].key == key) self->values[i].key = -1;
+  ebi_mdbuilder_add (self, key, value, length, NULL, 0);
+  }
+
+
+/*============================================================================
+ebi_mdbuilder_has
+============================================================================*/
+BOOL ebi_mdbuilder_has (const EBIMDBuilder *self, int key)
+  {
+  return (self->found & EBOOK_FIELD (key)) != 0;
+  }
+
+
+/*============================================================================
+ebi_mdbuilder_wants
+============================================================================*/
+BOOL ebi_mdbuilder_wants (const EBIMDBuilder *self, int key)
+  {
+  return (self->fields & EBOOK_FIELD (key)) != 0;
+  }
+
+
+/*============================================================================
+ebi_mdbuilder_complete
+TRUE once every wanted key has a value, so that a handler can stop 
+reading. Keys that collect several values are never complete, since
+there may always be another
+============================================================================*/
+BOOL ebi_mdbuilder_complete (const EBIMDBuilder *self)
+  {
+  const unsigned int lists = EBOOK_FIELD (EBOOK_KEY_CREATOR) 
+    | EBOOK_FIELD (EBOOK_KEY_SUBJECT) | EBOOK_FIELD (EBOOK_KEY_IDENTIFIER);
+  if (self->fields & lists) return FALSE;
+  return (self->fields & ~self->found) == 0;
+  }
+
+
+/*============================================================================
+ebi_mdbuilder_keep
+Take charge of an ebi_malloc()'d string, to free it on clear
+============================================================================*/
+const char *ebi_mdbuilder_keep (EBIMDBuilder *self, char *s)
+  {
+  self->kept = ebi_realloc (self->kept, (self->n_kept + 1) * sizeof (char *));
+  self->kept[self->n_kept++] = s;
+  return s;
   }
 
 
+/*============================================================================
+ebi_mdbuilder_build
+============================================================================*/
+EBookMetadata *ebi_mdbuilder_build (const EBIMDBuilder *self)
+  {
+  return pack (self->values, self->n_values, self->pool);
+  }
 
 
+/*============================================================================
+ebi_mdbuilder_clear
+Free what the builder allocated. It may be used again after this
+============================================================================*/
+void ebi_mdbuilder_clear (EBIMDBuilder *self)
+  {
+  int i;
+  for (i = 0; i < self->n_kept; i++)
+    ebi_free (self->kept[i]);
+  if (self->kept) ebi_free (self->kept);
+  if (self->values != self->inline_values) ebi_free (self->values);
+  ebi_mdbuilder_init (self, self->fields);
+  }
+
+
+/*============================================================================
+ebookmetadata_intern
+============================================================================*/
+EBookMetadata *ebookmetadata_intern (const EBookMetadata *self, 
+                 EBookStringPool *pool)
+  {
+  EBIMDValue *in = ebi_malloc ((self->n_values + 1) * sizeof (EBIMDValue));
+  int k, i, n = 0;
+  for (k = 0; k < EBOOK_N_KEYS; k++)
+    for (i = 0; i < self->count[k]; i++)
+      {
+      const MDValue *v = &self->values[self->first[k] + i];
+      in[n].key = k;
+      in[n].value = v->value;
+      in[n].length = strlen (v->value);
+      in[n].qualifier = v->qualifier;
+      in[n].qualifier_length = v->qualifier ? strlen (v->qualifier) : 0;
+      n++;
+      }
+  EBookMetadata *ret = pack (in, n, pool);
+  ebi_free (in);
+  for (i = 0; i < N_FIELDS; i++)
+    if (self->edited & (1 << i))
+      set_field (ret, i, self->fields[i]);
+  return ret;
+  }
 
@@ -0,0 +1,368 @@
+/*============================================================================
+ * libebookinfo
+ * ebookrecord.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebookmetadata.h>
+#include <ebookinfo/ebookrecord.h>
+#include "metadata.h"
+
+#define MAGIC "EBR"
+#define HEADER_SIZE 4
+
+// A varint of more than this many bytes would not fit in a size_t
+#define MAX_VARINT 10
+
+
+/*============================================================================
+put_byte
+============================================================================*/
+static void put_byte (unsigned char **p, unsigned char c)
+  {
+  *(*p)++ = c;
+  }
+
+
+/*============================================================================
+put_varint
+============================================================================*/
+static void put_varint (unsigned char **p, size_t v)
+  {
+  while (v >= 0x80)
+    {
+    put_byte (p, (v & 0x7f) | 0x80);
+    v >>= 7;
+    }
+  put_byte (p, v);
+  }
+
+
+/*============================================================================
+varint_size
+============================================================================*/
+static size_t varint_size (size_t v)
+  {
+  size_t n = 1;
+  while (v >= 0x80)
+    {
+    v >>= 7;
+    n++;
+    }
+  return n;
+  }
+
+
+/*============================================================================
+put_string
+============================================================================*/
+static void put_string (unsigned char **p, const char *s)
+  {
+  if (!s)
+    {
+    put_varint (p, 0);
+    return;
+    }
+  size_t length = strlen (s);
+  put_varint (p, length + 1);
+  memcpy (*p, s, length + 1);
+  *p += length + 1;
+  }
+
+
+/*============================================================================
+string_size
+============================================================================*/
+static size_t string_size (const char *s)
+  {
+  if (!s) return 1;
+  size_t length = strlen (s);
+  return varint_size (length + 1) + length + 1;
+  }
+
+
+/*============================================================================
+ebookmetadata_encode
+The body length comes before the body, so the values are sized first;
+that pass also gives each key's offset for the directory
+============================================================================*/
+size_t ebookmetadata_encode (const EBookMetadata *self, void *buffer,
+         size_t size)
+  {
+  size_t offset[EBOOK_N_KEYS];
+  size_t values = 0;
+  int k, i;
+  for (k = 0; k < EBOOK_N_KEYS; k++)
+    {
+    offset[k] = values;
+    for (i = 0; i < ebookmetadata_count (self, k); i++)
+      values += string_size (ebookmetadata_get (self, k, i))
+        + string_size (ebookmetadata_get_qualifier (self, k, i));
+    }
+
+  unsigned int edited = ebi_metadata_edited (self);
+  size_t body = varint_size (EBOOK_N_KEYS) + varint_size (edited) + values;
+  for (k = 0; k < EBOOK_N_KEYS; k++)
+    body += varint_size (ebookmetadata_count (self, k))
+      + varint_size (offset[k]);
+  for (i = 0; i < N_FIELDS; i++)
+    if (edited & (1 << i))
+      body += string_size (ebi_metadata_get_field (self, i));
+
+  size_t total = HEADER_SIZE + varint_size (body) + body;
+  if (total > size) return total;
+
+  unsigned char *w = buffer;
+  put_byte (&w, MAGIC[0]);
+  put_byte (&w, MAGIC[1]);
+  put_byte (&w, MAGIC[2]);
+  put_byte (&w, EBOOK_RECORD_VERSION);
+  put_varint (&w, body);
+  put_varint (&w, EBOOK_N_KEYS);
+  for (k = 0; k < EBOOK_N_KEYS; k++)
+    {
+    put_varint (&w, ebookmetadata_count (self, k));
+    put_varint (&w, offset[k]);
+    }
+  put_varint (&w, edited);
+  for (i = 0; i < N_FIELDS; i++)
+    if (edited & (1 << i))
+      put_string (&w, ebi_metadata_get_field (self, i));
+  for (k = 0; k < EBOOK_N_KEYS; k++)
+    for (i = 0; i < ebookmetadata_count (self, k); i++)
+      {
+      put_string (&w, ebookmetadata_get (self, k, i));
+      put_string (&w, ebookmetadata_get_qualifier (self, k, i));
+      }
+
+  return total;
+  }
+
+
+/*============================================================================
+get_varint
+Read a varint at *p, not going past end. Returns FALSE if it is cut
+short, or too long
+============================================================================*/
+static BOOL get_varint (const unsigned char **p, const unsigned char *end,
+       size_t *v)
+  {
+  size_t result = 0;
+  int i;
+  for (i = 0; i < MAX_VARINT && *p < end; i++)
+    {
+    unsigned char c = *(*p)++;
+    result |= (size_t)(c & 0x7f) << (7 * i);
+    if (!(c & 0x80))
+      {
+      *v = result;
+      return TRUE;
+      }
+    }
+  return FALSE;
+  }
+
+
+/*============================================================================
+get_string
+Read a string at *p, checking that it lies within end and is
+NUL-terminated. *s is NULL for a missing string
+============================================================================*/
+static BOOL get_string (const unsigned char **p, const unsigned char *end,
+       const char **s)
+  {
+  size_t length;
+  if (!get_varint (p, end, &length)) return FALSE;
+  if (length == 0)
+    {
+    *s = NULL;
+    return TRUE;
+    }
+  if (length > (size_t)(end - *p) || (*p)[length - 1] != 0) return FALSE;
+  *s = (const char *)*p;
+  *p += length;
+  return TRUE;
+  }
+
+
+/*============================================================================
+skip_string
+As get_string(), for a record that has already been checked
+============================================================================*/
+static const char *skip_string (const unsigned char **p)
+  {
+  size_t length = 0;
+  int shift = 0;
+  unsigned char c;
+  do
+    {
+    c = *(*p)++;
+    length |= (size_t)(c & 0x7f) << shift;
+    shift += 7;
+    } while (c & 0x80);
+  if (length == 0) return NULL;
+  const char *s = (const char *)*p;
+  *p += length;
+  return s;
+  }
+
+
+/*============================================================================
+ebookrecord_open
+============================================================================*/
+BOOL ebookrecord_open (EBookRecord *self, const void *data, size_t length,
+       char **error)
+  {
+  const unsigned char *start = data, *p = start + HEADER_SIZE, *end;
+  size_t body, n_keys, edited;
+  memset (self, 0, sizeof (EBookRecord));
+
+  if (length < HEADER_SIZE || memcmp (start, MAGIC, 3) != 0)
+    {
+    asprintf (error, "Not a metadata record");
+    return FALSE;
+    }
+  if (start[3] != EBOOK_RECORD_VERSION)
+    {
+    asprintf (error, "Unsupported metadata record version %d", start[3]);
+    return FALSE;
+    }
+  if (!get_varint (&p, start + length, &body)
+      || body > (size_t)(start + length - p))
+    {
+    asprintf (error, "Metadata record is truncated");
+    return FALSE;
+    }
+  end = p + body;
+  self->size = end - start;
+
+  BOOL ok = get_varint (&p, end, &n_keys);
+  size_t k, count, offset;
+  for (k = 0; ok && k < n_keys; k++)
+    {
+    ok = get_varint (&p, end, &count) && get_varint (&p, end, &offset);
+    if (ok && k < EBOOK_N_KEYS)
+      {
+      ok = count <= body && offset <= body;
+      self->count[k] = count;
+      self->offset[k] = offset;
+      }
+    }
+  ok = ok && get_varint (&p, end, &edited);
+  int i;
+  for (i = 0; ok && i < N_FIELDS; i++)
+    if (edited & (1 << i))
+      ok = get_string (&p, end, &self->fields[i]);
+  self->edited = edited & ((1 << N_FIELDS) - 1);
+  self->values = p;
+
+  // Every value of a known key must lie within the body, so that the
+  //  getters can walk them blind
+  for (k = 0; ok && k < EBOOK_N_KEYS; k++)
+    {
+    const unsigned char *v = self->values + self->offset[k];
+    const char *s;
+    ok = v <= end;
+    for (i = 0; ok && i < self->count[k]; i++)
+      ok = get_string (&v, end, &s) && s && get_string (&v, end, &s);
+    }
+
+  if (!ok)
+    {
+    asprintf (error, "Metadata record is corrupt");
+    memset (self, 0, sizeof (EBookRecord));
+    }
+  return ok;
+  }
+
+
+/*============================================================================
+ebookrecord_size
+============================================================================*/
+size_t ebookrecord_size (const EBookRecord *self)
+  {
+  return self->size;
+  }
+
+
+/*============================================================================
+ebookrecord_count
+============================================================================*/
+int ebookrecord_count (const EBookRecord *self, int key)
+  {
+  if (key < 0 || key >= EBOOK_N_KEYS) return 0;
+  return self->count[key];
+  }
+
+
+/*============================================================================
+find_value
+Where the i'th value of a key starts, or NULL
+============================================================================*/
+static const unsigned char *find_value (const EBookRecord *self, int key,
+       int i)
+  {
+  if (i < 0 || i >= ebookrecord_count (self, key)) return NULL;
+  const unsigned char *p = self->values + self->offset[key];
+  while (i--)
+    {
+    skip_string (&p);
+    skip_string (&p);
+    }
+  return p;
+  }
+
+
+/*============================================================================
+ebookrecord_get
+============================================================================*/
+const char *ebookrecord_get (const EBookRecord *self, int key, int i)
+  {
+  const unsigned char *p = find_value (self, key, i);
+  return p ? skip_string (&p) : NULL;
+  }
+
+
+/*============================================================================
+ebookrecord_get_qualifier
+============================================================================*/
+const char *ebookrecord_get_qualifier (const EBookRecord *self, int key,
+         int i)
+  {
+  const unsigned char *p = find_value (self, key, i);
+  if (!p) return NULL;
+  skip_string (&p);
+  return skip_string (&p);
+  }
+
+
+/*============================================================================
+ebookrecord_to_metadata
+============================================================================*/
+EBookMetadata *ebookrecord_to_metadata (const EBookRecord *self)
+  {
+  EBIMDBuilder builder;
+  ebi_mdbuilder_init (&builder, EBOOK_FIELDS_ALL);
+  int k, i;
+  for (k = 0; k < EBOOK_N_KEYS; k++)
+    {
+    const unsigned char *p = self->values + self->offset[k];
+    for (i = 0; i < self->count[k]; i++)
+      {
+      const char *value = skip_string (&p);
+      const char *qualifier = skip_string (&p);
+      ebi_mdbuilder_add (&builder, k, value, strlen (value), qualifier,
+        qualifier ? strlen (qualifier) : 0);
+      }
+    }
+  EBookMetadata *ret = ebi_mdbuilder_build (&builder);
+  ebi_mdbuilder_clear (&builder);
+  for (i = 0; i < N_FIELDS; i++)
+    if (self->edited & (1 << i))
+      ebi_metadata_set_field (ret, i, self->fields[i]);
+  return ret;
+  }
+
@@ -11,61 +11,47 @@
 #include <malloc.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
 #include <pcre.h>
 #include <ebookinfo/ebook.h>
 #include <ebookinfo/constants.h>
 #include "sxmlc.h" 
 #include "epub.h" 
+#include "ebizip.h" 
 #include "ebistring.h" 
+#include "alloc.h"
+#include "metadata.h"
+#include "stats.h"
+#include "trace.h"
+#include "probes.h"
 
 typedef struct _EPUB
   {
-  char *tempdir;
-
+  EBIZip *zip;
+  const char *name;
+  EBookMetadata *cached_metadata;
+  unsigned int cached_fields;
   } EPUB;
 
+// Compiled once, when first needed, and kept for the life of the
+//  process; pcre_exec() can share it between threads
 static pcre *re_entity;
-
-/*============================================================================
-epub_recognize
-============================================================================*/
-BOOL epub_recognize (const char *filename)
-  {
-  BOOL ret = FALSE;
-  int f = open (filename, O_RDONLY);
-  if (f >= 0)
-    {
-    char buff[2];
-    if (read (f, buff, 2) == 2)
-      {
-      if (buff[0] == 'P' && buff[1] == 'K')
-        ret = TRUE;
-      }
-    close (f);
-    }
-
-  return ret;
-  }
+static pthread_once_t re_once = PTHREAD_ONCE_INIT;
 
 /*============================================================================
 epub_close
 ============================================================================*/
-void epub_close (EBook *self)
+static void epub_close (EBook *self)
   {
   if (self)
     {
     EPUB *epub = (EPUB *) ebook_get_data (self);
     if (epub)
       {
-      if (epub->tempdir)
-        {
-        char *cmd;
-        asprintf (&cmd, "rm -rf \"%s\"", epub->tempdir);
-        system (cmd);
-        free (cmd);
-        }
-      free (epub->tempdir);
-      free (epub);
+      ebookmetadata_destroy (epub->cached_metadata);
+      ebizip_close (epub->zip);
+      ebi_free (epub);
       }
     }
   }
@@ -73,37 +59,70 @@ void epub_close (EBook *self)
 
 /*============================================================================
 epub_open
+The book is read in place from the source; nothing is extracted until
+metadata is asked for, and then only the container and OPF entries
 ============================================================================*/
-BOOL epub_open (EBook *self, const char *filename, char **error)
+static BOOL epub_open (EBook *self, const EBookSource *source, char **error)
   {
   BOOL ret = FALSE;
 
-  EPUB *epub = malloc (sizeof (EPUB));
+  EPUB *epub = ebi_malloc (sizeof (EPUB));
   memset (epub, 0, sizeof (EPUB));
+  epub->name = source->name ? source->name : "EPUB";
+  ebook_set_data (self, epub);
 
-  const char *tempbase = getenv("TMP");
-  if (!tempbase) tempbase = "/tmp";
-  char *tempdir;
-  asprintf (&tempdir, "%s/ebookinfo%d", tempbase, getpid());
+  epub->zip = ebizip_open (source->data, source->length, error);
+  if (epub->zip)
+    ret = TRUE;
+  
+  return ret;
+  }
 
-  char *cmd;
-  asprintf (&cmd, "mkdir -p \"%s\"", tempdir);
-  system (cmd);
-  free (cmd);
 
-  epub->tempdir = tempdir;
- 
-  asprintf (&cmd, "unzip -o -qq \"%s\" -d \"%s\"", filename, tempdir);
-  system (cmd);
-  free (cmd);
+/*============================================================================
+read_entry
+Get the contents of a named entry in the EPUB. *buffer is set as for
+ebizip_read(), and must be freed by the caller. Every entry read is
+XML, and the XML parser counts in ints, so larger entries are refused
+============================================================================*/
+static BOOL read_entry (const EPUB *epub, const char *name,
+    const unsigned char **data, size_t *length, unsigned char **buffer,
+    char **error)
+  {
+  EBIZipEntry entry;
+  EBI_TRACE_BEGIN ("container read", name);
+  BOOL ret = ebizip_find (epub->zip, name, &entry);
+  if (ret && (entry.size > INT_MAX || entry.compressed_size > INT_MAX))
+    {
+    asprintf (error, "parsing EPUB: %s: entry %s is too large\n", 
+      epub->name, name);
+    ret = FALSE;
+    }
+  else if (ret)
+    ret = ebizip_read (epub->zip, &entry, data, length, buffer, error);
+  else
+    asprintf (error, "parsing EPUB: %s has no entry %s\n", epub->name, name);
+  EBI_TRACE_END ();
+  EBI_PROBE3 (entry__read, name, ret ? *length : 0, ret);
+  return ret;
+  }
 
-  asprintf (&cmd, "chmod -R 744 \"%s\"", tempdir);
-  system (cmd);
-  free (cmd);
 
-  ebook_set_data (self, epub);
-  ret = TRUE;
-  
+/*============================================================================
+parse_xml
+============================================================================*/
+static BOOL parse_xml (const unsigned char *data, size_t length,
+    const char *name, XMLDoc *xmldoc)
+  {
+  EBI_TRACE_BEGIN ("xml parse", name);
+  EBI_PROBE2 (xml__parse__start, name, length);
+  BOOL ret = XMLDoc_parse_buffer_DOM_len ((const char *)data, length, 
+    name, xmldoc);
+  // sxmlc reports success with an empty document when the parse is
+  //  abandoned, or the data holds no element at all
+  if (ret && xmldoc->i_root < 0) ret = FALSE;
+  EBI_PROBE2 (xml__parse__done, name, ret);
+  EBI_TRACE_END ();
   return ret;
   }
 
@@ -126,7 +145,7 @@ unescape
 ===========================================================================*/
 char *unescape (const char *_input)
   {
-  char *input = strdup (_input);
+  char *input = ebi_strdup (_input);
   BOOL done = FALSE;
   EBIString *s = ebistring_create_empty ();
 
@@ -139,139 +158,348 @@ char *unescape (const char *_input)
     if (count != 1) done = TRUE;
     if (!done)
       {
-      char *temp = strdup (input);
+      char *temp = ebi_strdup (input);
       temp[vec[0]] = 0;
       ebistring_append (s, temp);
-      free (temp);
-      char *subs = strdup (input+ vec[0]+1);
+      ebi_free (temp);
+      char *subs = ebi_strdup (input+ vec[0]+1);
       subs [vec[1] - vec[0] - 2] = 0;
       ebistring_append (s, decode_entity (subs));
-      free (subs);
-      temp = strdup (input + vec[1]);
-      free (temp);
+      ebi_free (subs);
+      temp = ebi_strdup (input + vec[1]);
+      ebi_free (temp);
       memmove (input, input + vec[1], strlen (input) - vec[1] + 1);
       }
     }
 
   ebistring_append (s, input);
 
-  char *t = strdup (ebistring_cstr(s));
-  free (input);
+  char *t = ebi_strdup (ebistring_cstr(s));
+  ebi_free (input);
   ebistring_destroy (s);
   return t;
   }
 
 
+/*===========================================================================
+get_attribute
+The value of the attribute called name, with or without a namespace
+prefix, as "opf:role" for "role"; or NULL
+===========================================================================*/
+static const char *get_attribute (const XMLNode *node, const char *name)
+  {
+  int k;
+  for (k = 0; k < node->n_attributes; k++)
+    {
+    const char *a = node->attributes[k].name;
+    const char *colon = strchr (a, ':');
+    if (strcasecmp (colon ? colon + 1 : a, name) == 0)
+      return node->attributes[k].value;
+    }
+  return NULL;
+  }
+
+
+/*===========================================================================
+add_identifier
+The scheme is taken from the opf:scheme attribute if there is one, or
+else from a URN prefix, which is removed, as "urn:isbn:..." or 
+"urn:uuid:..."
+===========================================================================*/
+static void add_identifier (EBIMDBuilder *builder, const XMLNode *m)
+  {
+  static const char *prefixes[] = { "isbn", "uuid", "asin", "issn", "doi" };
+  const char *value = m->text;
+  const char *scheme = get_attribute (m, "scheme");
+  size_t scheme_length = scheme ? strlen (scheme) : 0;
+  if (!scheme)
+    {
+    const char *v = value;
+    if (strncasecmp (v, "urn:", 4) == 0) v += 4;
+    int i;
+    for (i = 0; i < sizeof (prefixes) / sizeof (prefixes[0]); i++)
+      {
+      size_t n = strlen (prefixes[i]);
+      if (strncasecmp (v, prefixes[i], n) == 0 && v[n] == ':')
+        {
+        scheme = v;
+        scheme_length = n;
+        value = v + n + 1;
+        break;
+        }
+      }
+    }
+  ebi_mdbuilder_add (builder, EBOOK_KEY_IDENTIFIER, value, strlen (value),
+    scheme, scheme_length);
+  }
+
+
+/*===========================================================================
+add_meta
+<meta> elements: calibre's series, and EPUB 3 collections
+===========================================================================*/
+static void add_meta (EBIMDBuilder *builder, const XMLNode *m)
+  {
+  const char *name = get_attribute (m, "name");
+  const char *content = get_attribute (m, "content");
+  const char *property = get_attribute (m, "property");
+  if (name && content)
+    {
+    if (strcmp (name, "calibre:series") == 0)
+      ebi_mdbuilder_add (builder, EBOOK_KEY_SERIES, content, 
+        strlen (content), NULL, 0);
+    else if (strcmp (name, "calibre:series_index") == 0)
+      ebi_mdbuilder_add (builder, EBOOK_KEY_SERIES_INDEX, content, 
+        strlen (content), NULL, 0);
+    }
+  else if (property && m->text 
+      && strcmp (property, "belongs-to-collection") == 0)
+    {
+    ebi_mdbuilder_add (builder, EBOOK_KEY_SERIES, m->text, 
+      strlen (m->text), NULL, 0);
+    }
+  }
+
+
+/*===========================================================================
+element_key
+The key that a child of <metadata> holds, or -1. Any namespace prefix
+is ignored, and OPF 2 books in the wild use "dc:Title" as well as
+"dc:title". <meta> may hold a series or a series index
+===========================================================================*/
+static int element_key (const char *tag)
+  {
+  if (strcasecmp (tag, "meta") == 0) return EBOOK_KEY_SERIES;
+  if (strcasestr (tag, "creator")) return EBOOK_KEY_CREATOR;
+  if (strcasestr (tag, "description")) return EBOOK_KEY_DESCRIPTION;
+  if (strcasestr (tag, "title")) return EBOOK_KEY_TITLE;
+  if (strcasestr (tag, "date")) return EBOOK_KEY_DATE;
+  if (strcasestr (tag, "subject")) return EBOOK_KEY_SUBJECT;
+  if (strcasestr (tag, "language")) return EBOOK_KEY_LANGUAGE;
+  if (strcasestr (tag, "publisher")) return EBOOK_KEY_PUBLISHER;
+  if (strcasestr (tag, "identifier")) return EBOOK_KEY_IDENTIFIER;
+  return -1;
+  }
+
+
+/*===========================================================================
+element_wanted
+===========================================================================*/
+static BOOL element_wanted (const EBIMDBuilder *builder, const char *tag)
+  {
+  int key = element_key (tag);
+  if (key == EBOOK_KEY_SERIES)
+    return ebi_mdbuilder_wants (builder, EBOOK_KEY_SERIES)
+      || ebi_mdbuilder_wants (builder, EBOOK_KEY_SERIES_INDEX);
+  return key >= 0 && ebi_mdbuilder_wants (builder, key);
+  }
+
+
+/*===========================================================================
+add_element
+One child of <metadata>. Values are referenced in the node, so the 
+builder must be used before it is freed
+===========================================================================*/
+static void add_element (EBIMDBuilder *builder, const XMLNode *m)
+  {
+  const char *text = m->text;
+  int key = element_key (m->tag);
+  if (key == EBOOK_KEY_SERIES)
+    add_meta (builder, m);
+  else if (!text)
+    return;
+  else if (key == EBOOK_KEY_CREATOR)
+    {
+    const char *role = get_attribute (m, "role");
+    ebi_mdbuilder_add (builder, EBOOK_KEY_CREATOR, text, strlen (text), 
+      role, role ? strlen (role) : 0);
+    }
+  else if (key == EBOOK_KEY_DESCRIPTION)
+    {
+    const char *d = ebi_mdbuilder_keep (builder, unescape (text));
+    ebi_mdbuilder_add (builder, EBOOK_KEY_DESCRIPTION, d, strlen (d), 
+      NULL, 0);
+    }
+  else if (key == EBOOK_KEY_IDENTIFIER)
+    add_identifier (builder, m);
+  else if (key >= 0)
+    ebi_mdbuilder_add (builder, key, text, strlen (text), NULL, 0);
+  }
+
+
+/*===========================================================================
+OPF parsing
+The content file is read with sxmlc's SAX parser rather than into a
+DOM, because only <metadata> is needed, and in a large book the 
+manifest and spine that follow it can be most of the file. Wanted 
+children of <metadata> are copied, with their text, into the 
+children of a node of our own, which the builder refers to. Parsing
+stops at </metadata>, or as soon as the builder has all it wants
+===========================================================================*/
+typedef struct _OPFParse
+  {
+  EBIMDBuilder *builder;
+  XMLNode metadata;
+  XMLNode *element;      // the child of <metadata> being read, or NULL
+  int depth;             // of the innermost open element; the root is 1
+  int metadata_depth;    // of <metadata>, or 0 until it is found
+  BOOL seen_root;
+  } OPFParse;
+
+
+/*===========================================================================
+opf_start_node
+===========================================================================*/
+static int opf_start_node (const XMLNode *node, SAX_Data *sd)
+  {
+  OPFParse *p = sd->user;
+  EBI_STATS_COUNT (xml_nodes, 1);
+  p->depth++;
+  if (node->tag_type != TAG_FATHER && node->tag_type != TAG_SELF) 
+    return TRUE;
+  if (p->depth == 1)
+    {
+    if (node->tag_type == TAG_FATHER) p->seen_root = TRUE;
+    }
+  else if (p->metadata_depth == 0)
+    {
+    if (p->depth == 2 && p->seen_root && node->tag_type == TAG_FATHER
+        && strcasecmp (node->tag, "metadata") == 0)
+      p->metadata_depth = 2;
+    }
+  else if (p->depth == p->metadata_depth + 1
+      && element_wanted (p->builder, node->tag))
+    {
+    p->element = XMLNode_dup (node, FALSE);
+    if (!p->element) return FALSE;
+    XMLNode_add_child (&p->metadata, p->element);
+    }
+  return TRUE;
+  }
+
+
+/*===========================================================================
+opf_new_text
+Text belongs to the innermost open element, and is kept only for a 
+wanted child of <metadata>, as the DOM would keep it
+===========================================================================*/
+static int opf_new_text (SXML_CHAR *text, SAX_Data *sd)
+  {
+  OPFParse *p = sd->user;
+  XMLNode *e = p->element;
+  if (e && p->depth == p->metadata_depth + 1)
+    {
+    size_t l = e->text ? strlen (e->text) : 0;
+    e->text = ebi_realloc (e->text, l + strlen (text) + 1);
+    strcpy (e->text + l, text);
+    }
+  return TRUE;
+  }
+
+
+/*===========================================================================
+opf_end_node
+Returns FALSE, to stop the parse, when nothing more is needed
+===========================================================================*/
+static int opf_end_node (const XMLNode *node, SAX_Data *sd)
+  {
+  OPFParse *p = sd->user;
+  int depth = p->depth--;
+  if (p->metadata_depth == 0) return TRUE;
+  if (depth == p->metadata_depth) return FALSE;
+  if (p->element && depth == p->metadata_depth + 1)
+    {
+    add_element (p->builder, p->element);
+    p->element = NULL;
+    if (ebi_mdbuilder_complete (p->builder)) return FALSE;
+    }
+  return TRUE;
+  }
+
+
+/*===========================================================================
+opf_error
+===========================================================================*/
+static int opf_error (ParseError error_num, int line_number, SAX_Data *sd)
+  {
+  return FALSE;
+  }
+
+
 /*===========================================================================
 parse_content
+Fills in *metadata, if the content file can be parsed
 ===========================================================================*/
-static BOOL parse_content (const char *filename, 
-    char **title, char **creator, char **year, 
-    char **genre, char **comment, char **error)
+static BOOL parse_content (const EPUB *epub, const char *filename, 
+    unsigned int fields, EBookMetadata **metadata, char **error)
   {
   BOOL ok = TRUE;
 
   // Note that all hrefs in this file are relative to this file's
   // location, not to the location of the manifest.
-  char *filename2 = strdup (filename);
-  
-  FILE *f = fopen (filename, "r");
-  if (f)
+  const unsigned char *data;
+  size_t length;
+  unsigned char *buffer;
+  if (read_entry (epub, filename, &data, &length, &buffer, error))
     {
-    XMLDoc *xmldoc = malloc (sizeof (XMLDoc));
-    XMLDoc_init (xmldoc);
-    if (XMLDoc_parse_file_DOM (filename, xmldoc))
+    EBIMDBuilder builder;
+    ebi_mdbuilder_init (&builder, fields);
+    OPFParse p;
+    memset (&p, 0, sizeof (p));
+    p.builder = &builder;
+    XMLNode_init (&p.metadata);
+    SAX_Callbacks sax;
+    SAX_Callbacks_init (&sax);
+    sax.start_node = opf_start_node;
+    sax.end_node = opf_end_node;
+    sax.new_text = opf_new_text;
+    sax.on_error = opf_error;
+
+    EBI_TRACE_BEGIN ("xml parse", filename);
+    EBI_PROBE2 (xml__parse__start, filename, length);
+    BOOL parsed = XMLDoc_parse_buffer_SAX_len ((const char *)data, length,
+      filename, &sax, &p) && p.seen_root;
+    EBI_PROBE2 (xml__parse__done, filename, parsed);
+    EBI_TRACE_END ();
+
+    if (parsed)
       {
-      XMLNode *root = XMLDoc_root (xmldoc);
-      int i, l = root->n_children;
-      for (i = 0; i < l; i++)
-        {
-        XMLNode *r1 = root->children[i];
-        if (strcasecmp (r1->tag, "metadata") == 0)
-          {
-          int i, l = r1->n_children;
-          for (i = 0; i < l; i++)
-            {
-            XMLNode *m = r1->children[i];
-            if (strcasestr (m->tag, "creator"))
-              {
-              if (m->text && creator) *creator = strdup (m->text);
-              }
-            else if (strcasestr (m->tag, "description"))
-              {
-              if (m->text && comment) *comment = unescape (m->text);
-              }
-            else if (strcasestr (m->tag, "title"))
-              {
-              if (m->text && title) *title = strdup (m->text);
-              }
-            else if (m->text && strcasestr (m->tag, "date"))
-              {
-              char *y = strdup (m->text);
-              char *p = strchr (y, '-');
-              if (p)
-                {
-                *p = 0; 
-                if (year) *year = strdup (y);
-                }
-              free (y);
-              }
-            else if (strcasestr (m->tag, "subject"))
-              {
-              if (m->text && genre) 
-               {
-               if (*genre)
-                 {
-                 *genre = realloc (*genre, strlen (*genre) + strlen (m->text) + 5);
-                 strcat (*genre, ",");
-                 strcat (*genre, m->text);
-                 }
-               else
-                 *genre = strdup (m->text);
-               }
-              }
-            }
-          }
-        else if (strcasecmp (r1->tag, "manifest") == 0)
-          {
-          }
-        }
+      if (*metadata) ebookmetadata_destroy (*metadata);
+      *metadata = ebi_mdbuilder_build (&builder);
       }
     else
       {
       asprintf (error, "parsing EPUB: Can't parse content file %s\n", filename);
       }
-    fclose (f);
-    XMLDoc_free (xmldoc);
-    free (xmldoc);
+    ebi_mdbuilder_clear (&builder);
+    XMLNode_free (&p.metadata);
+    ebi_free (buffer);
     }
   else
     {
-    asprintf (error, "parseing EPUB: Can't open content file %s\n", filename);
+    ok = FALSE;
     }
-  free (filename2);
   return ok;
   }
 
- 
 
 /*===========================================================================
 _get_epub_metadata
 ===========================================================================*/
-static BOOL _epub_get_metadata (const char *tempdir, 
-     char **title, char **creator, char **year, char **genre, char **comment,
-     char **error) 
+static BOOL _epub_get_metadata (const EPUB *epub, unsigned int fields,
+     EBookMetadata **metadata, char **error) 
   {
   BOOL ok = TRUE;
 
-  char *opf;
-  asprintf (&opf, "%s/META-INF/container.xml", tempdir);
-  FILE *f = fopen (opf, "r");
-  if (f)
+  const char *opf = "META-INF/container.xml";
+  const unsigned char *data;
+  size_t length;
+  unsigned char *buffer;
+  if (read_entry (epub, opf, &data, &length, &buffer, error))
     {
-    XMLDoc *xmldoc = malloc (sizeof (XMLDoc));
+    XMLDoc *xmldoc = ebi_malloc (sizeof (XMLDoc));
     XMLDoc_init (xmldoc);
-    if (XMLDoc_parse_file_DOM (opf, xmldoc))
+    if (parse_xml (data, length, opf, xmldoc))
       {
       XMLNode *root = XMLDoc_root (xmldoc);
       int i, l = root->n_children;
@@ -294,11 +522,8 @@ static BOOL _epub_get_metadata (const char *tempdir,
                 char *value = r1->attributes[k].value;
                 if (strcmp (name, "full-path") == 0)
                   {
-                  char *c;
-                  asprintf (&c, "%s/%s", tempdir, value);
-                  ok = parse_content (c, 
-                    title, creator, year, genre, comment, error);
-                  free (c);
+                  ok = parse_content (epub, value, fields, metadata, 
+                         error);
                   }
                 }
               }
@@ -313,17 +538,14 @@ static BOOL _epub_get_metadata (const char *tempdir,
       }
 
     XMLDoc_free (xmldoc);
-    free (xmldoc);
-    fclose (f);
+    ebi_free (xmldoc);
+    ebi_free (buffer);
     }
   else
     {
-    asprintf (error, "parsing EPUB: can't open file %s\n", opf);
     ok = FALSE;
     }
 
-  free (opf);
-
   return ok;
   }
 
@@ -340,50 +562,68 @@ static void init_re (void)
     &pcreErrorStr, &pcreErrorOffset, NULL);
   }
 
-/*============================================================================
-init_re
-============================================================================*/
-static void cleanup_re (void)
-  {
-  if (re_entity)
-    pcre_free (re_entity);
-  }
 
 /*============================================================================
 epub_get_metadata
 ============================================================================*/
-EBookMetadata *epub_get_metadata (const EBook *ebook, char **error)
+static EBookMetadata *epub_get_metadata (const EBook *ebook, 
+    unsigned int fields, char **error)
   {
   EBookMetadata *ret = NULL;
 
-  init_re();
-
   EPUB *epub = (EPUB *) ebook_get_data (ebook);
-  const char *tempdir = epub->tempdir;
 
-  char *title = NULL, *author=NULL, *year=NULL, *genre=NULL, *comment=NULL;
+  if (epub->cached_metadata && (fields & ~epub->cached_fields) == 0) 
+    return ebookmetadata_retain (epub->cached_metadata);
+
+  // Read again for the fields already cached as well, so that the
+  //  cache only grows, and calls that alternate between sets of 
+  //  fields don't each read the book afresh
+  if (epub->cached_metadata) fields |= epub->cached_fields;
 
-  BOOL ok = _epub_get_metadata (tempdir, 
-     &title, &author, &year, &genre, &comment,
-     error);
+  if (fields & EBOOK_FIELD (EBOOK_KEY_DESCRIPTION)) 
+    pthread_once (&re_once, init_re);
+
+  BOOL ok = _epub_get_metadata (epub, fields, &ret, error);
 
   if (ok)
     {
-    ret  = ebookmetadata_create (title, 
-      author, year, genre, comment); 
-  
-    if (title) free (title);
-    if (author) free (author);
-    if (year) free (year);
-    if (genre) free (genre);
-    if (comment) free (comment);
+    // A book whose content file couldn't be found has no meta-data,
+    //  but that is not an error
+    if (!ret) ret = ebookmetadata_create (NULL, NULL, NULL, NULL, NULL);
+    ebookmetadata_destroy (epub->cached_metadata);
+    epub->cached_metadata = ebookmetadata_retain (ret);
+    epub->cached_fields = fields;
+    }
+  else if (ret)
+    {
+    ebookmetadata_destroy (ret);
+    ret = NULL;
     }
 
-  cleanup_re();
-  
   return ret;
   }
 
 
+/*============================================================================
+epub_format
+============================================================================*/
+static const EBookMagic epub_magics[] =
+  {
+  { 30, "mimetypeapplication/epub+zip", 28, EBOOK_CONFIDENCE_HIGH },
+  { 0, "PK\003\004", 4, EBOOK_CONFIDENCE_LOW },
+  { 0, NULL, 0, 0 }
+  };
+
+const EBookFormat epub_format =
+  {
+  EBOOK_TYPE_EPUB,
+  "EPUB",
+  epub_magics,
+  NULL,
+  epub_open,
+  epub_get_metadata,
+  epub_close
+  };
 
 
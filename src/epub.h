@@ -6,17 +6,13 @@
 
 #pragma once
 
-#include <ebookinfo/constants.h> 
-#include <ebookinfo/ebookmetadata.h> 
+#include "format.h" 
 
 #ifdef __CPLUSPLUS
 extern "C" {
 #endif
 
-BOOL           epub_recognize (const char *filename);
-void           epub_close (EBook *self);
-BOOL           epub_open (EBook *self, const char *filename, char **error);
-EBookMetadata *epub_get_metadata (const EBook *ebook, char **error);
+extern const EBookFormat epub_format;
 
 #ifdef __CPLUSPLUS
 }
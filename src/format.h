@@ -0,0 +1,67 @@
+/*============================================================================
+ * libebookinfo
+ * format.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebook.h>
+#include <ebookinfo/ebookmetadata.h>
+#include "source.h"
+
+// Number of bytes read from the start of a file to identify its format.
+//  Every magic in the registry must lie entirely within this window
+#define EBOOK_SNIFF_SIZE 128
+
+/*============================================================================
+A magic is a run of bytes at a fixed offset that identifies a format.
+A format may have several, each with the confidence (one of the
+EBOOK_CONFIDENCE_ constants) that a match carries; the most specific
+magic that matches wins. Lists of magics are terminated by an entry 
+with NULL bytes
+============================================================================*/
+typedef struct _EBookMagic
+  {
+  int offset;
+  const char *bytes;
+  int length;
+  int confidence;
+  } EBookMagic;
+
+/*============================================================================
+A format descriptor. Each format module exports one of these, and
+formats.c lists them. recognize() is optional: if set, it is called
+only when one of the magics has matched, and returns the confidence
+to use in place of the magic's, or EBOOK_CONFIDENCE_NONE to reject
+the buffer. Neither it nor the sniff may open files or allocate 
+handler state; that is open()'s job. get_metadata() is given a mask
+of the keys wanted, and need not read the others.
+============================================================================*/
+typedef struct _EBookFormat
+  {
+  int type;
+  const char *name;
+  const EBookMagic *magics;
+  int (*recognize) (const unsigned char *sniff, int length, 
+        int confidence);
+  BOOL (*open) (EBook *self, const EBookSource *source, char **error);
+  EBookMetadata *(*get_metadata) (const EBook *self, unsigned int fields,
+        char **error);
+  void (*close) (EBook *self);
+  } EBookFormat;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+const EBookFormat *ebookformat_sniff (const unsigned char *sniff,
+                     int length, int *confidence);
+const EBookFormat *ebookformat_for_type (int type);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
+
@@ -0,0 +1,160 @@
+/*============================================================================
+ * libebookinfo
+ * formats.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <ebookinfo/constants.h>
+#include "format.h"
+#include "mobi.h"
+#include "epub.h"
+#include "rtf.h"
+
+/*============================================================================
+The registry. To add a format, write a module that exports an
+EBookFormat, and list it here. Where two formats match the same file
+with equal confidence, the one listed first wins
+============================================================================*/
+static const EBookFormat *formats[] =
+  {
+  &mobi_format,
+  &epub_format,
+  &rtf_format,
+  NULL
+  };
+
+/*============================================================================
+The magic index. All magics are grouped by offset and then bucketed by
+their first byte, so sniffing a buffer costs one table lookup per
+distinct offset, however many formats are registered.
+============================================================================*/
+#define MAX_MAGIC_OFFSETS 16
+
+typedef struct _MagicEntry
+  {
+  const EBookFormat *format;
+  const EBookMagic *magic;
+  int priority;
+  struct _MagicEntry *next;
+  } MagicEntry;
+
+typedef struct _MagicOffset
+  {
+  int offset;
+  MagicEntry *buckets[256];
+  } MagicOffset;
+
+static MagicOffset offsets[MAX_MAGIC_OFFSETS];
+static int n_offsets;
+static MagicEntry *entries;
+static pthread_once_t index_once = PTHREAD_ONCE_INIT;
+
+
+/*============================================================================
+build_index
+============================================================================*/
+static void build_index (void)
+  {
+  int i, n_magics = 0;
+  for (i = 0; formats[i]; i++)
+    {
+    const EBookMagic *m;
+    for (m = formats[i]->magics; m && m->bytes; m++) n_magics++;
+    }
+
+  // The index lives as long as the process, so it is not allocated
+  //  with the library's allocator, which might be replaced later
+  entries = malloc (n_magics * sizeof (MagicEntry));
+  memset (entries, 0, n_magics * sizeof (MagicEntry));
+
+  // Insert in reverse registry order, so each bucket ends up
+  //  listed in priority order
+  int e = 0;
+  for (i--; i >= 0; i--)
+    {
+    const EBookMagic *m;
+    for (m = formats[i]->magics; m && m->bytes; m++)
+      {
+      if (m->length <= 0 || m->offset + m->length > EBOOK_SNIFF_SIZE)
+        continue;
+      int o;
+      for (o = 0; o < n_offsets; o++)
+        if (offsets[o].offset == m->offset) break;
+      if (o == n_offsets)
+        {
+        if (n_offsets == MAX_MAGIC_OFFSETS) continue;
+        offsets[n_offsets++].offset = m->offset;
+        }
+      MagicEntry *entry = &entries[e++];
+      unsigned char first = (unsigned char)m->bytes[0];
+      entry->format = formats[i];
+      entry->magic = m;
+      entry->priority = i;
+      entry->next = offsets[o].buckets[first];
+      offsets[o].buckets[first] = entry;
+      }
+    }
+  }
+
+
+/*============================================================================
+ebookformat_sniff
+Match every registered magic against the sniff buffer, and return
+the format that matched with the highest confidence (and, if it has a 
+recognizer, accepted the buffer), or NULL. If confidence is not NULL,
+it receives the confidence of the match, or EBOOK_CONFIDENCE_NONE
+============================================================================*/
+const EBookFormat *ebookformat_sniff (const unsigned char *sniff, int length,
+     int *confidence)
+  {
+  pthread_once (&index_once, build_index);
+
+  const EBookFormat *ret = NULL;
+  int best = -1, best_confidence = EBOOK_CONFIDENCE_NONE;
+  int o;
+  for (o = 0; o < n_offsets; o++)
+    {
+    int offset = offsets[o].offset;
+    if (offset >= length) continue;
+    MagicEntry *entry;
+    for (entry = offsets[o].buckets[sniff[offset]]; entry;
+         entry = entry->next)
+      {
+      const EBookMagic *m = entry->magic;
+      if (offset + m->length > length) continue;
+      if (memcmp (sniff + offset, m->bytes, m->length) != 0) continue;
+      const EBookFormat *format = entry->format;
+      int c = m->confidence;
+      if (format->recognize) c = format->recognize (sniff, length, c);
+      if (c > best_confidence 
+          || (c == best_confidence && c > EBOOK_CONFIDENCE_NONE 
+              && entry->priority < best))
+        {
+        ret = format;
+        best = entry->priority;
+        best_confidence = c;
+        }
+      }
+    }
+
+  if (confidence) *confidence = best_confidence;
+  return ret;
+  }
+
+
+/*============================================================================
+ebookformat_for_type
+============================================================================*/
+const EBookFormat *ebookformat_for_type (int type)
+  {
+  int i;
+  for (i = 0; formats[i]; i++)
+    if (formats[i]->type == type) return formats[i];
+  return NULL;
+  }
+
+
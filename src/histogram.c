@@ -0,0 +1,71 @@
+/*============================================================================
+ * ebookinfo
+ * histogram.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#include "histogram.h"
+
+
+/*============================================================================
+bucket_of
+============================================================================*/
+static int bucket_of (unsigned long long v)
+  {
+  if (v < HISTOGRAM_SUB) return v;
+  int msb = 63 - __builtin_clzll (v);
+  int shift = msb - HISTOGRAM_SUB_BITS;
+  return HISTOGRAM_SUB * (shift + 1) + (int)((v >> shift) - HISTOGRAM_SUB);
+  }
+
+
+/*============================================================================
+bucket_value
+The highest value that falls into a bucket, so that percentiles are
+never understated
+============================================================================*/
+static unsigned long long bucket_value (int bucket)
+  {
+  if (bucket < HISTOGRAM_SUB) return bucket;
+  int shift = bucket / HISTOGRAM_SUB - 1;
+  unsigned long long base = HISTOGRAM_SUB + bucket % HISTOGRAM_SUB;
+  return ((base + 1) << shift) - 1;
+  }
+
+
+/*============================================================================
+histogram_record
+============================================================================*/
+void histogram_record (Histogram *self, unsigned long long v)
+  {
+  self->counts[bucket_of (v)]++;
+  self->total++;
+  if (v > self->max) self->max = v;
+  }
+
+
+/*============================================================================
+histogram_percentile
+p is from 0 to 100. Returns 0 for an empty histogram
+============================================================================*/
+unsigned long long histogram_percentile (const Histogram *self, double p)
+  {
+  if (self->total == 0) return 0;
+  // Nearest rank
+  double r = p / 100.0 * self->total;
+  unsigned long long rank = (unsigned long long)r;
+  if (rank < r || rank < 1) rank++;
+  if (rank > self->total) rank = self->total;
+  unsigned long long seen = 0;
+  int i;
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+    seen += self->counts[i];
+    if (seen >= rank)
+      {
+      unsigned long long v = bucket_value (i);
+      return v < self->max ? v : self->max;
+      }
+    }
+  return self->max;
+  }
+
@@ -0,0 +1,38 @@
+/*============================================================================
+ * ebookinfo
+ * histogram.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+/*============================================================================
+A latency histogram in the style of HdrHistogram: buckets are linear
+up to 16ns, and above that there are 16 for each power of two, so any
+value is recorded to within about 6%, from nanoseconds to hours, in a
+fixed 8kB. Recording is a few shifts and an increment; callers that 
+share a histogram between threads must lock it themselves
+============================================================================*/
+
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB      (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS  ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB)
+
+typedef struct _Histogram
+  {
+  unsigned long long counts[HISTOGRAM_BUCKETS];
+  unsigned long long total;
+  unsigned long long max;
+  } Histogram;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+void               histogram_record (Histogram *self, unsigned long long v);
+unsigned long long histogram_percentile (const Histogram *self, double p);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
@@ -0,0 +1,446 @@
+/*============================================================================
+ * libebookinfo
+ * htmltext.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/htmltext.h>
+#include "alloc.h"
+
+#define STATE_TEXT    0
+#define STATE_TAG     1
+#define STATE_ENTITY  2
+#define STATE_COMMENT 3
+#define STATE_LT      4 // Just seen '<', which may not start a tag
+
+// Pending whitespace, in increasing order of strength. When several
+//  breaks meet, the strongest one wins
+#define BREAK_NONE      0
+#define BREAK_SPACE     1
+#define BREAK_LINE      2
+#define BREAK_PARAGRAPH 3
+
+#define MAX_NAME 32
+#define OUT_SIZE 4096
+
+struct _EBookHTMLText
+  {
+  EBookTextSink sink;
+  void *user;
+  int state;
+  char name[MAX_NAME + 1];   // Tag or entity name being collected
+  int name_length;
+  BOOL name_done;            // The tag name has ended; now in attributes
+  char quote;                // Quote character, if inside an attribute
+  int dashes;                // Consecutive '-' seen, in a comment
+  BOOL skipping;             // Inside <script> or <style>
+  int pending;               // Whitespace waiting for the next text
+  BOOL started;              // Some text has been written
+  char out[OUT_SIZE];
+  int out_length;
+  };
+
+typedef struct _Entity
+  {
+  const char *name;
+  unsigned int code;
+  } Entity;
+
+static const Entity entities[] =
+  {
+  { "amp", '&' }, { "lt", '<' }, { "gt", '>' }, { "quot", '"' },
+  { "apos", '\'' }, { "nbsp", 0xA0 }, { "shy", 0xAD },
+  { "copy", 0xA9 }, { "reg", 0xAE }, { "trade", 0x2122 },
+  { "mdash", 0x2014 }, { "ndash", 0x2013 }, { "hellip", 0x2026 },
+  { "lsquo", 0x2018 }, { "rsquo", 0x2019 }, { "ldquo", 0x201C },
+  { "rdquo", 0x201D }, { "laquo", 0xAB }, { "raquo", 0xBB },
+  { "bull", 0x2022 }, { "middot", 0xB7 }, { "deg", 0xB0 },
+  { "pound", 0xA3 }, { "euro", 0x20AC }, { "sect", 0xA7 },
+  { "aacute", 0xE1 }, { "eacute", 0xE9 }, { "iacute", 0xED },
+  { "oacute", 0xF3 }, { "uacute", 0xFA }, { "agrave", 0xE0 },
+  { "egrave", 0xE8 }, { "auml", 0xE4 }, { "ouml", 0xF6 },
+  { "uuml", 0xFC }, { "szlig", 0xDF }, { "ccedil", 0xE7 },
+  { "ntilde", 0xF1 }, { "Eacute", 0xC9 }, { "Auml", 0xC4 },
+  { "Ouml", 0xD6 }, { "Uuml", 0xDC },
+  { NULL, 0 }
+  };
+
+// Elements that start a new line, and those that start a new paragraph
+static const char *line_tags[] =
+  { "br", "li", "tr", "dt", "dd", NULL };
+static const char *paragraph_tags[] =
+  { "p", "div", "h1", "h2", "h3", "h4", "h5", "h6", "blockquote", "pre",
+    "ul", "ol", "dl", "table", "hr", "section", "article", NULL };
+
+
+/*============================================================================
+flush_out
+============================================================================*/
+static void flush_out (EBookHTMLText *self)
+  {
+  if (self->out_length > 0)
+    self->sink (self->out, self->out_length, self->user);
+  self->out_length = 0;
+  }
+
+
+/*============================================================================
+put_raw
+A run too long for the buffer goes straight to the sink
+============================================================================*/
+static void put_raw (EBookHTMLText *self, const char *s, int length)
+  {
+  if (self->out_length + length > OUT_SIZE) flush_out (self);
+  if (length >= OUT_SIZE)
+    {
+    self->sink (s, length, self->user);
+    return;
+    }
+  memcpy (self->out + self->out_length, s, length);
+  self->out_length += length;
+  }
+
+
+/*============================================================================
+put_text
+Write visible text, preceded by whatever whitespace is pending.
+Whitespace at the very start is dropped, as is whitespace at the end,
+since nothing follows it
+============================================================================*/
+static void put_text (EBookHTMLText *self, const char *s, int length)
+  {
+  if (self->skipping) return;
+  if (self->started)
+    {
+    switch (self->pending)
+      {
+      case BREAK_SPACE: put_raw (self, " ", 1); break;
+      case BREAK_LINE: put_raw (self, "\n", 1); break;
+      case BREAK_PARAGRAPH: put_raw (self, "\n\n", 2); break;
+      }
+    }
+  self->pending = BREAK_NONE;
+  self->started = TRUE;
+  put_raw (self, s, length);
+  }
+
+
+/*============================================================================
+put_break
+============================================================================*/
+static void put_break (EBookHTMLText *self, int level)
+  {
+  if (level > self->pending) self->pending = level;
+  }
+
+
+/*============================================================================
+put_code
+Write a Unicode code point as UTF-8
+============================================================================*/
+static void put_code (EBookHTMLText *self, unsigned int c)
+  {
+  char b[4];
+  if (c == 0xA0)
+    {
+    put_break (self, BREAK_SPACE);
+    return;
+    }
+  if (c == 0xAD) return; // Soft hyphen
+  if (c < 0x80)
+    {
+    b[0] = c;
+    put_text (self, b, 1);
+    }
+  else if (c < 0x800)
+    {
+    b[0] = 0xC0 | (c >> 6);
+    b[1] = 0x80 | (c & 0x3F);
+    put_text (self, b, 2);
+    }
+  else if (c < 0x10000)
+    {
+    b[0] = 0xE0 | (c >> 12);
+    b[1] = 0x80 | ((c >> 6) & 0x3F);
+    b[2] = 0x80 | (c & 0x3F);
+    put_text (self, b, 3);
+    }
+  else if (c < 0x110000)
+    {
+    b[0] = 0xF0 | (c >> 18);
+    b[1] = 0x80 | ((c >> 12) & 0x3F);
+    b[2] = 0x80 | ((c >> 6) & 0x3F);
+    b[3] = 0x80 | (c & 0x3F);
+    put_text (self, b, 4);
+    }
+  }
+
+
+/*============================================================================
+end_entity
+The collected name is everything between '&' and ';'. Anything not
+recognized is written out as it was
+============================================================================*/
+static void end_entity (EBookHTMLText *self, BOOL terminated)
+  {
+  const char *name = self->name;
+  self->name[self->name_length] = 0;
+  self->state = STATE_TEXT;
+
+  unsigned int code = 0;
+  if (terminated && name[0] == '#')
+    {
+    char *end;
+    if (name[1] == 'x' || name[1] == 'X')
+      code = strtoul (name + 2, &end, 16);
+    else
+      code = strtoul (name + 1, &end, 10);
+    if (*end) code = 0;
+    }
+  else if (terminated)
+    {
+    const Entity *e;
+    for (e = entities; e->name; e++)
+      if (strcmp (e->name, name) == 0)
+        {
+        code = e->code;
+        break;
+        }
+    }
+
+  if (code)
+    put_code (self, code);
+  else
+    {
+    put_text (self, "&", 1);
+    if (self->name_length) put_text (self, name, self->name_length);
+    if (terminated) put_text (self, ";", 1);
+    }
+  }
+
+
+/*============================================================================
+in_list
+============================================================================*/
+static BOOL in_list (const char *name, const char **list)
+  {
+  for (; *list; list++)
+    if (strcasecmp (name, *list) == 0) return TRUE;
+  return FALSE;
+  }
+
+
+/*============================================================================
+end_tag
+The collected name is the tag name, with a leading '/' for an end tag
+============================================================================*/
+static void end_tag (EBookHTMLText *self)
+  {
+  self->name[self->name_length] = 0;
+  self->state = STATE_TEXT;
+
+  BOOL closing = (self->name[0] == '/');
+  const char *name = closing ? self->name + 1 : self->name;
+
+  if (strcasecmp (name, "script") == 0 || strcasecmp (name, "style") == 0)
+    {
+    self->skipping = !closing;
+    return;
+    }
+  if (self->skipping) return;
+
+  if (in_list (name, paragraph_tags))
+    put_break (self, BREAK_PARAGRAPH);
+  else if (in_list (name, line_tags))
+    {
+    put_break (self, BREAK_LINE);
+    if (!closing && strcasecmp (name, "li") == 0)
+      put_text (self, "* ", 2);
+    }
+  }
+
+
+/*============================================================================
+ebookhtmltext_create
+============================================================================*/
+EBookHTMLText *ebookhtmltext_create (EBookTextSink sink, void *user)
+  {
+  EBookHTMLText *self = ebi_malloc (sizeof (EBookHTMLText));
+  memset (self, 0, sizeof (EBookHTMLText));
+  self->sink = sink;
+  self->user = user;
+  self->state = STATE_TEXT;
+  return self;
+  }
+
+
+/*============================================================================
+ebookhtmltext_feed
+============================================================================*/
+void ebookhtmltext_feed (EBookHTMLText *self, const char *html,
+       size_t length)
+  {
+  const char *p = html, *end = html + length;
+  const char *run = NULL; // Start of a run of plain text
+
+  while (p < end)
+    {
+    char c = *p;
+    switch (self->state)
+      {
+      case STATE_TEXT:
+        if (c == '<' || c == '&' || isspace ((unsigned char)c))
+          {
+          if (run) put_text (self, run, p - run);
+          run = NULL;
+          if (c == '<')
+            self->state = STATE_LT;
+          else if (c == '&')
+            {
+            self->state = STATE_ENTITY;
+            self->name_length = 0;
+            }
+          else if (!self->skipping)
+            put_break (self, BREAK_SPACE);
+          }
+        else if (!run)
+          run = p;
+        break;
+
+      case STATE_LT:
+        // Only '<' followed by what can start a tag name, an end tag,
+        //  a comment or a processing instruction is markup. Anything
+        //  else, as in "3 < 7", is text
+        if (isalpha ((unsigned char)c) || c == '/' || c == '!' || c == '?')
+          {
+          self->state = STATE_TAG;
+          self->name_length = 0;
+          self->name_done = FALSE;
+          self->quote = 0;
+          }
+        else
+          {
+          self->state = STATE_TEXT;
+          put_text (self, "<", 1);
+          }
+        continue; // Look at this character again, in the new state
+
+      case STATE_ENTITY:
+        if (c == ';')
+          end_entity (self, TRUE);
+        else if ((isalnum ((unsigned char)c) || c == '#')
+                 && self->name_length < MAX_NAME)
+          self->name[self->name_length++] = c;
+        else
+          {
+          end_entity (self, FALSE);
+          continue; // Look at this character again, as text
+          }
+        break;
+
+      case STATE_TAG:
+        if (self->quote)
+          {
+          if (c == self->quote) self->quote = 0;
+          }
+        else if (c == '>')
+          end_tag (self);
+        else if (c == '"' || c == '\'')
+          {
+          if (self->name_done) self->quote = c;
+          }
+        else if (!self->name_done)
+          {
+          if (isspace ((unsigned char)c) || (c == '/' && self->name_length))
+            self->name_done = TRUE;
+          else if (self->name_length < MAX_NAME)
+            {
+            self->name[self->name_length++] = c;
+            if (self->name_length == 3 && memcmp (self->name, "!--", 3) == 0)
+              {
+              self->state = STATE_COMMENT;
+              self->dashes = 0;
+              }
+            }
+          }
+        break;
+
+      case STATE_COMMENT:
+        if (c == '>' && self->dashes >= 2)
+          self->state = STATE_TEXT;
+        else if (c == '-')
+          self->dashes++;
+        else
+          self->dashes = 0;
+        break;
+      }
+    p++;
+    }
+
+  if (run) put_text (self, run, p - run);
+  }
+
+
+/*============================================================================
+ebookhtmltext_finish
+Flush everything out to the sink. The converter can then be used
+for another document
+============================================================================*/
+void ebookhtmltext_finish (EBookHTMLText *self)
+  {
+  if (self->state == STATE_ENTITY) end_entity (self, FALSE);
+  if (self->state == STATE_LT) put_text (self, "<", 1);
+  flush_out (self);
+  self->state = STATE_TEXT;
+  self->pending = BREAK_NONE;
+  self->started = FALSE;
+  self->skipping = FALSE;
+  }
+
+
+/*============================================================================
+ebookhtmltext_destroy
+============================================================================*/
+void ebookhtmltext_destroy (EBookHTMLText *self)
+  {
+  if (self) ebi_free (self);
+  }
+
+
+/*============================================================================
+ebookhtmltext_convert
+The result belongs to the caller, so it comes from malloc(), not the
+library's allocator
+============================================================================*/
+typedef struct _StringSink
+  {
+  char *s;
+  size_t length;
+  } StringSink;
+
+static void string_sink (const char *text, size_t length, void *user)
+  {
+  StringSink *ss = user;
+  ss->s = realloc (ss->s, ss->length + length + 1);
+  memcpy (ss->s + ss->length, text, length);
+  ss->length += length;
+  ss->s[ss->length] = 0;
+  }
+
+char *ebookhtmltext_convert (const char *html)
+  {
+  StringSink ss = { strdup (""), 0 };
+  EBookHTMLText *self = ebookhtmltext_create (string_sink, &ss);
+  ebookhtmltext_feed (self, html, strlen (html));
+  ebookhtmltext_finish (self);
+  ebookhtmltext_destroy (self);
+  return ss.s;
+  }
+
+
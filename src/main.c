@@ -11,21 +11,946 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <getopt.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <ebookinfo/ebookinfo.h>
+#include "outbuf.h"
+#include "perfcount.h"
+#include "histogram.h"
+#include "sorter.h"
+#include "mergeinput.h"
+#include "pathqueue.h"
 
+#define FORMAT_TEXT   0
+#define FORMAT_JSON   1
+#define FORMAT_NDJSON 2
+
+// Phases of handling one file, timed for the slow-file log
+#define TIME_OPEN     0
+#define TIME_METADATA 1
+#define TIME_OUTPUT   2
+#define TIME_CLOSE    3
+#define TIME_N        4
+
+// What --sort sorts by
+#define SORT_NONE     0
+#define SORT_AUTHOR   1
+#define SORT_TITLE    2
+#define SORT_DATE     3
+#define SORT_FILE     4
+
+// The most threads --jobs will start
+#define MAX_JOBS      256
+
+typedef struct _Options
+  {
+  BOOL show_comment;
+  BOOL html2text;
+  BOOL type_only;
+  BOOL show_filename;
+  BOOL perf_counters;
+  BOOL timing;
+  unsigned int timeout;
+  unsigned int fields;
+  int format;
+  EBookCatalogWriter *catalog;   // For --build-catalog, instead of output
+  int sort;
+  Sorter *sorter;                // For --sort, records go here first
+  int shard;                     // For --shard, counting from 1
+  int shards;
+  } Options;
+
+// A reading thread's share of the work
+typedef struct _Worker
+  {
+  const Options *options;
+  PathQueue *queue;
+  } Worker;
+
+// Per-file latency, per format, for --stats; and the slow-file log.
+//  Both are shared by all threads, under latency_mutex
+static pthread_mutex_t latency_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Histogram latencies[EBOOK_STATS_FORMATS];
+static FILE *slow_log;
+static unsigned long long slow_threshold = 100000000ULL;
+
+// The sorter and the catalog writer are shared by all threads, under
+//  sink_mutex
+static pthread_mutex_t sink_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*============================================================================
+json_field
+Write ,"name":"value" -- or nothing, if value is NULL
+============================================================================*/
+static void json_field (OutBuf *out, const char *name, const char *value)
+  {
+  if (!value) return;
+  outbuf_printf (out, ",\"%s\":", name);
+  outbuf_json_string (out, value);
+  }
+
+
+/*============================================================================
+json_begin_record
+============================================================================*/
+static void json_begin_record (OutBuf *out, const Options *options,
+     const char *filename)
+  {
+  if (options->format == FORMAT_JSON) outbuf_array_item (out);
+  outbuf_puts (out, "{\"file\":");
+  outbuf_json_string (out, filename);
+  }
+
+
+/*============================================================================
+json_end_record
+============================================================================*/
+static void json_end_record (OutBuf *out, const Options *options)
+  {
+  outbuf_puts (out, options->format == FORMAT_NDJSON ? "}\n" : "}");
+  }
+
+
+/*============================================================================
+report_error
+In the JSON formats an error is a record of its own, so that the
+output still accounts for every input file
+============================================================================*/
+static void report_error (OutBuf *out, const Options *options,
+     const char *filename, const char *what, const char *error)
+  {
+  if (options->format == FORMAT_TEXT)
+    {
+    fprintf (stderr, "%s %s: %s\n", what, filename, error);
+    }
+  else
+    {
+    char *msg;
+    asprintf (&msg, "%s: %s", what, error);
+    json_begin_record (out, options, filename);
+    json_field (out, "error", msg);
+    json_end_record (out, options);
+    free (msg);
+    }
+  }
+
+
+/*============================================================================
+text_sink
+Pass converted HTML straight into the output buffer
+============================================================================*/
+static void text_sink (const char *text, size_t length, void *user)
+  {
+  outbuf_append ((OutBuf *)user, text, length);
+  }
+
+
+/*============================================================================
+write_comment
+============================================================================*/
+static void write_comment (OutBuf *out, const Options *options,
+     const char *comment)
+  {
+  if (options->html2text)
+    {
+    EBookHTMLText *h = ebookhtmltext_create (text_sink, out);
+    ebookhtmltext_feed (h, comment, strlen (comment));
+    ebookhtmltext_finish (h);
+    ebookhtmltext_destroy (h);
+    }
+  else
+    {
+    outbuf_puts (out, comment);
+    }
+  outbuf_puts (out, "\n");
+  }
+
+
+/*============================================================================
+json_list
+Write ,"name":[...] for all the values of a key -- or nothing, if it
+has none. Values with qualifiers are written as objects
+============================================================================*/
+static void json_list (OutBuf *out, const EBookMetadata *metadata, int key,
+     const char *name, const char *qualifier_name)
+  {
+  int i, n = ebookmetadata_count (metadata, key);
+  if (n == 0) return;
+  outbuf_printf (out, ",\"%s\":[", name);
+  for (i = 0; i < n; i++)
+    {
+    const char *value = ebookmetadata_get (metadata, key, i);
+    const char *qualifier = ebookmetadata_get_qualifier (metadata, key, i);
+    if (i) outbuf_puts (out, ",");
+    if (qualifier)
+      {
+      outbuf_puts (out, "{\"value\":");
+      outbuf_json_string (out, value);
+      outbuf_printf (out, ",\"%s\":", qualifier_name);
+      outbuf_json_string (out, qualifier);
+      outbuf_puts (out, "}");
+      }
+    else
+      outbuf_json_string (out, value);
+    }
+  outbuf_puts (out, "]");
+  }
+
+
+/*============================================================================
+write_metadata
+============================================================================*/
+static void write_metadata (OutBuf *out, const Options *options,
+     const char *filename, int type, const EBookMetadata *metadata)
+  {
+  const char *title = ebookmetadata_get_title (metadata);
+  const char *author = ebookmetadata_get_author (metadata);
+  const char *genre = ebookmetadata_get_genre (metadata);
+  const char *comment = ebookmetadata_get_comment (metadata);
+  const char *year = ebookmetadata_get_year (metadata);
+  if (!options->show_comment) comment = NULL;
+
+  if (options->format == FORMAT_TEXT)
+    {
+    outbuf_printf (out, "type: %s\n", ebook_type_name (type));
+    if (title)
+      outbuf_printf (out, "title: %s\n", title);
+    if (author)
+      outbuf_printf (out, "author: %s\n", author);
+    if (genre)
+      outbuf_printf (out, "genre: %s\n", genre);
+    if (year)
+      outbuf_printf (out, "year: %s\n", year);
+    static const int keys[] = { EBOOK_KEY_DATE, EBOOK_KEY_LANGUAGE, 
+      EBOOK_KEY_PUBLISHER, EBOOK_KEY_SERIES, EBOOK_KEY_SERIES_INDEX };
+    int k;
+    for (k = 0; k < sizeof (keys) / sizeof (keys[0]); k++)
+      {
+      const char *value = ebookmetadata_get (metadata, keys[k], 0);
+      if (value) 
+        outbuf_printf (out, "%s: %s\n", ebookmetadata_key_name (keys[k]),
+          value);
+      }
+    for (k = 0; k < ebookmetadata_count (metadata, EBOOK_KEY_IDENTIFIER); k++)
+      {
+      const char *scheme = 
+        ebookmetadata_get_qualifier (metadata, EBOOK_KEY_IDENTIFIER, k);
+      outbuf_printf (out, "identifier: %s%s%s\n", scheme ? scheme : "",
+        scheme ? ":" : "", 
+        ebookmetadata_get (metadata, EBOOK_KEY_IDENTIFIER, k));
+      }
+    if (comment)
+      write_comment (out, options, comment);
+    }
+  else
+    {
+    json_begin_record (out, options, filename);
+    json_field (out, "type", ebook_type_name (type));
+    json_field (out, "title", title);
+    json_field (out, "author", author);
+    json_field (out, "title_sort", ebookmetadata_get_title_sort (metadata));
+    json_field (out, "author_sort", 
+      ebookmetadata_get_author_sort (metadata));
+    json_field (out, "genre", genre);
+    json_field (out, "year", year);
+    json_field (out, "date", ebookmetadata_get (metadata, EBOOK_KEY_DATE, 0));
+    json_field (out, "language", 
+      ebookmetadata_get (metadata, EBOOK_KEY_LANGUAGE, 0));
+    json_field (out, "publisher", 
+      ebookmetadata_get (metadata, EBOOK_KEY_PUBLISHER, 0));
+    json_field (out, "series", 
+      ebookmetadata_get (metadata, EBOOK_KEY_SERIES, 0));
+    json_field (out, "series_index", 
+      ebookmetadata_get (metadata, EBOOK_KEY_SERIES_INDEX, 0));
+    json_list (out, metadata, EBOOK_KEY_CREATOR, "creators", "role");
+    json_list (out, metadata, EBOOK_KEY_SUBJECT, "subjects", NULL);
+    json_list (out, metadata, EBOOK_KEY_IDENTIFIER, "identifiers", "scheme");
+    if (comment && options->html2text)
+      {
+      char *text = ebookhtmltext_convert (comment);
+      json_field (out, "comment", text);
+      free (text);
+      }
+    else
+      json_field (out, "comment", comment);
+    json_end_record (out, options);
+    }
+  }
+
+
+/*============================================================================
+sort_key
+The key to sort a book's record by, which the caller frees. Ties are
+broken by filename, which follows the key after a \x01, so that the 
+order does not depend on the order of the input, and merged shards 
+come out as one run would. Books without the key have one that starts 
+with \xff, which no UTF-8 does, so they come last
+============================================================================*/
+static char *sort_key (const Options *options, const char *filename,
+     const EBookMetadata *metadata)
+  {
+  const char *key = NULL;
+  char *ret = NULL;
+  switch (options->sort)
+    {
+    case SORT_AUTHOR: key = ebookmetadata_get_author_sort (metadata); break;
+    case SORT_TITLE: key = ebookmetadata_get_title_sort (metadata); break;
+    case SORT_DATE: key = ebookmetadata_get (metadata, EBOOK_KEY_DATE, 0); 
+      break;
+    case SORT_FILE: return strdup (filename);
+    default: return NULL;
+    }
+  asprintf (&ret, "%s\x01%s", key ? key : "\xff", filename);
+  return ret;
+  }
+
+
+/*============================================================================
+sort_record
+Take the record written since mark back out of the output, and give
+it to the sorter instead
+============================================================================*/
+static void sort_record (const Options *options, OutBuf *out, size_t mark,
+     const char *key)
+  {
+  size_t length;
+  const char *data = outbuf_since (out, mark, &length);
+  char *error = NULL;
+  pthread_mutex_lock (&sink_mutex);
+  BOOL ok = sorter_add (options->sorter, key, data, length, &error);
+  pthread_mutex_unlock (&sink_mutex);
+  if (!ok)
+    {
+    fprintf (stderr, "Can't sort: %s\n", error);
+    exit (-1);
+    }
+  outbuf_rewind (out, mark);
+  }
+
+
+/*============================================================================
+write_sorted
+============================================================================*/
+static void write_sorted (const char *data, size_t length, void *user)
+  {
+  OutBuf *out = user;
+  outbuf_append (out, data, length);
+  outbuf_end_record (out);
+  }
+
+
+/*============================================================================
+now_ns
+============================================================================*/
+static unsigned long long now_ns (void)
+  {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+
+/*============================================================================
+lap
+Time since *last, which is moved on to now; or 0 if not timing
+============================================================================*/
+static unsigned long long lap (const Options *options, 
+     unsigned long long *last)
+  {
+  if (!options->timing) return 0;
+  unsigned long long now = now_ns ();
+  unsigned long long d = now - *last;
+  *last = now;
+  return d;
+  }
+
+
+/*============================================================================
+record_latency
+Add a file's time to its format's histogram and, if it was slow, log
+it. The size is only looked up for the (few) files that get logged
+============================================================================*/
+static void record_latency (const Options *options, const char *filename,
+     int type, unsigned long long total, const unsigned long long *times)
+  {
+  if (!options->timing) return;
+  if (type < 0 || type >= EBOOK_STATS_UNKNOWN) type = EBOOK_STATS_UNKNOWN;
+
+  pthread_mutex_lock (&latency_mutex);
+  histogram_record (&latencies[type], total);
+  if (slow_log && total >= slow_threshold)
+    {
+    struct stat sb;
+    long long size = stat (filename, &sb) == 0 ? (long long)sb.st_size : -1;
+    fprintf (slow_log, "%.3f\t%s\t%lld", total / 1e6, 
+      type == EBOOK_STATS_UNKNOWN ? "unknown" : ebook_type_name (type), size);
+    int i;
+    for (i = 0; i < TIME_N; i++)
+      fprintf (slow_log, "\t%.3f", times[i] / 1e6);
+    fprintf (slow_log, "\t%s\n", filename);
+    }
+  pthread_mutex_unlock (&latency_mutex);
+  }
+
+
+/*============================================================================
+process_file
+============================================================================*/
+static void process_file (const Options *options, const char *filename)
+  {
+  OutBuf *out = outbuf_get ();
+  char *error = NULL;
+  unsigned long long times[TIME_N] = {0, 0, 0, 0};
+  unsigned long long start = options->timing ? now_ns () : 0;
+  unsigned long long last = start;
+  int type = EBOOK_TYPE_UNKNOWN;
+  size_t mark = outbuf_mark (out);
+  char *key = NULL;
+
+  if (options->format == FORMAT_TEXT && options->show_filename
+      && !options->catalog)
+    outbuf_printf (out, "file: %s\n", filename);
+
+  if (options->type_only)
+    {
+    type = ebook_probe (filename, NULL, &error);
+    times[TIME_OPEN] = lap (options, &last);
+    if (error)
+      {
+      report_error (out, options, filename, "Can't read e-book file", error);
+      free (error);
+      }
+    else if (options->format == FORMAT_TEXT)
+      {
+      outbuf_printf (out, "type: %s\n", ebook_type_name (type));
+      }
+    else
+      {
+      json_begin_record (out, options, filename);
+      json_field (out, "type", ebook_type_name (type));
+      json_end_record (out, options);
+      }
+    if (options->sorter)
+      {
+      key = sort_key (options, filename, NULL);
+      sort_record (options, out, mark, key);
+      free (key);
+      }
+    outbuf_end_record (out);
+    times[TIME_OUTPUT] = lap (options, &last);
+    record_latency (options, filename, type, last - start, times);
+    return;
+    }
+
+  // One deadline covers both opening and reading the book
+  EBookLimits limits;
+  memset (&limits, 0, sizeof (limits));
+  if (options->timeout) limits.deadline = ebook_deadline (options->timeout);
+
+  EBook *ebook = ebook_open_ex (filename, &limits, &error);
+  times[TIME_OPEN] = lap (options, &last);
+  if (ebook)
+    {
+    type = ebook_get_type (ebook);
+    PerfSample sample;
+    if (options->perf_counters) perfcount_start (&sample);
+    EBookMetadata *metadata = ebook_get_metadata_ex (ebook, 
+      options->fields, &limits, &error);
+    if (options->perf_counters) perfcount_stop (&sample, type);
+    times[TIME_METADATA] = lap (options, &last);
+    if (metadata && options->catalog)
+      {
+      pthread_mutex_lock (&sink_mutex);
+      ebookcatalog_writer_add (options->catalog, filename, type, metadata);
+      pthread_mutex_unlock (&sink_mutex);
+      ebookmetadata_destroy (metadata);
+      }
+    else if (metadata)
+      {
+      ebook_trace_begin ("output", NULL);
+      write_metadata (out, options, filename, type, metadata);
+      ebook_trace_end ();
+      if (options->sorter) key = sort_key (options, filename, metadata);
+      ebookmetadata_destroy (metadata);
+      }
+    else
+      {
+      report_error (out, options, filename, "Can't read metadata", error);
+      free (error);
+      }
+    times[TIME_OUTPUT] = lap (options, &last);
+
+    ebook_close (ebook);
+    times[TIME_CLOSE] = lap (options, &last);
+    }
+  else
+    {
+    report_error (out, options, filename, "Can't open e-book file", error);
+    free (error);
+    }
+
+  if (options->sorter)
+    {
+    if (!key) key = sort_key (options, filename, NULL);
+    sort_record (options, out, mark, key);
+    free (key);
+    }
+  outbuf_end_record (out);
+  times[TIME_OUTPUT] += lap (options, &last);
+  record_latency (options, filename, type, last - start, times);
+  }
+
+
+/*============================================================================
+run_query
+Each query is field=value, field=from..to, or field=prefix*, where the
+field is author, title or year. The first query is looked up in its
+index, and the others filter what it finds; with no queries, every 
+book is listed
+============================================================================*/
+static BOOL run_query (const Options *options, const char *catalog_file,
+     char **queries, int n_queries)
+  {
+  static const char *names[EBOOK_CATALOG_N_INDEXES] = 
+    { "author", "title", "year" };
+  int index[n_queries + 1];
+  const char *from[n_queries + 1], *to[n_queries + 1];
+  int q, i;
+  for (q = 0; q < n_queries; q++)
+    {
+    char *eq = strchr (queries[q], '=');
+    index[q] = -1;
+    if (eq)
+      {
+      *eq = 0;
+      for (i = 0; i < EBOOK_CATALOG_N_INDEXES; i++)
+        if (strcmp (queries[q], names[i]) == 0) index[q] = i;
+      from[q] = eq + 1;
+      char *dots = strstr (eq + 1, "..");
+      to[q] = NULL;
+      if (dots)
+        {
+        *dots = 0;
+        to[q] = dots + 2;
+        }
+      }
+    if (index[q] < 0)
+      {
+      fprintf (stderr, "Bad query: %s; expected author=, title= or year=\n",
+        queries[q]);
+      return FALSE;
+      }
+    }
+
+  char *error = NULL;
+  EBookCatalog *catalog = ebookcatalog_open (catalog_file, &error);
+  if (!catalog)
+    {
+    fprintf (stderr, "Can't open catalog: %s\n", error);
+    free (error);
+    return FALSE;
+    }
+
+  int first = 0, n = ebookcatalog_count (catalog);
+  if (n_queries)
+    n = ebookcatalog_find (catalog, index[0], from[0], to[0], &first);
+  OutBuf *out = outbuf_get ();
+  for (i = first; i < first + n; i++)
+    {
+    int book = n_queries ? ebookcatalog_index_book (catalog, index[0], i) : i;
+    for (q = 1; q < n_queries; q++)
+      if (!ebookcatalog_matches (catalog, index[q], book, from[q], to[q])) 
+        break;
+    if (q < n_queries) continue;
+
+    const char *filename = ebookcatalog_get_filename (catalog, book);
+    if (!filename) filename = "";
+    size_t mark = outbuf_mark (out);
+    char *key = NULL;
+    EBookRecord record;
+    if (options->format == FORMAT_TEXT)
+      outbuf_printf (out, "file: %s\n", filename);
+    if (ebookcatalog_get_record (catalog, book, &record, &error))
+      {
+      EBookMetadata *metadata = ebookrecord_to_metadata (&record);
+      write_metadata (out, options, filename, 
+        ebookcatalog_get_type (catalog, book), metadata);
+      if (options->sorter) key = sort_key (options, filename, metadata);
+      ebookmetadata_destroy (metadata);
+      }
+    else
+      {
+      report_error (out, options, filename, "Can't read catalog entry", 
+        error);
+      free (error);
+      error = NULL;
+      }
+    if (options->sorter)
+      {
+      if (!key) key = sort_key (options, filename, NULL);
+      sort_record (options, out, mark, key);
+      free (key);
+      }
+    outbuf_end_record (out);
+    }
+
+  ebookcatalog_close (catalog);
+  return TRUE;
+  }
+
+
+/*============================================================================
+merge_before
+Whether one book comes before another in a merge: by the sort key, 
+or, without one, not at all, so that the inputs follow one another
+============================================================================*/
+static BOOL merge_before (const Options *options, const char *a,
+     const char *b)
+  {
+  if (options->sort == SORT_NONE || !a) return FALSE;
+  return !b || strcmp (a, b) < 0;
+  }
+
+
+/*============================================================================
+run_merge
+Merge the output of earlier runs -- catalogs, or NDJSON or JSON -- 
+into one, as a catalog if --build-catalog is given. With --sort, the
+inputs should each be sorted on the same key, as --sort leaves them,
+and the merge keeps that order; the next book is whichever of the 
+inputs' next books comes first. There are seldom more inputs than 
+hosts, so finding it is a plain scan
+============================================================================*/
+static BOOL run_merge (const Options *options, char **inputs, int n_inputs)
+  {
+  MergeInput *in[n_inputs];
+  MergeRecord current[n_inputs];
+  char *keys[n_inputs];
+  BOOL have[n_inputs], ret = TRUE;
+  char *error = NULL;
+  int i;
+  for (i = 0; i < n_inputs; i++)
+    {
+    have[i] = FALSE;
+    keys[i] = NULL;
+    in[i] = mergeinput_open (inputs[i], &error);
+    if (!in[i])
+      {
+      fprintf (stderr, "%s\n", error);
+      free (error);
+      while (i--) mergeinput_close (in[i]);
+      return FALSE;
+      }
+    }
+
+  OutBuf *out = outbuf_get ();
+  int next = 0;
+  while (next >= 0)
+    {
+    // Take the next book of any input that has used its last
+    for (i = 0; i < n_inputs; i++)
+      {
+      if (have[i] || !in[i]) continue;
+      have[i] = mergeinput_next (in[i], &current[i], &error);
+      if (have[i])
+        keys[i] = sort_key (options, current[i].filename, 
+          current[i].metadata);
+      else
+        {
+        if (error)
+          {
+          fprintf (stderr, "%s\n", error);
+          free (error);
+          error = NULL;
+          ret = FALSE;
+          }
+        mergeinput_close (in[i]);
+        in[i] = NULL;
+        }
+      }
+
+    next = -1;
+    for (i = 0; i < n_inputs; i++)
+      if (have[i] && (next < 0 || merge_before (options, keys[i], keys[next])))
+        next = i;
+    if (next < 0) break;
+
+    MergeRecord *record = &current[next];
+    if (options->catalog)
+      {
+      if (record->metadata)
+        ebookcatalog_writer_add (options->catalog, record->filename, 
+          record->type, record->metadata);
+      }
+    else
+      {
+      if (options->format == FORMAT_TEXT)
+        outbuf_printf (out, "file: %s\n", record->filename);
+      if (record->metadata)
+        write_metadata (out, options, record->filename, record->type, 
+          record->metadata);
+      else if (options->format == FORMAT_TEXT)
+        fprintf (stderr, "%s: %s\n", record->filename, record->error);
+      else
+        {
+        json_begin_record (out, options, record->filename);
+        json_field (out, "error", record->error);
+        json_end_record (out, options);
+        }
+      outbuf_end_record (out);
+      }
+    mergerecord_clear (record);
+    free (keys[next]);
+    keys[next] = NULL;
+    have[next] = FALSE;
+    }
+
+  return ret;
+  }
+
+
+/*============================================================================
+shard_of
+Which of n shards a file is in, from a hash (64-bit FNV-1a) of its
+path, as given. The hash is fixed, so every host that sees the same
+paths divides them the same way
+============================================================================*/
+static int shard_of (const char *path, int n)
+  {
+  unsigned long long h = 14695981039346656037ULL;
+  const unsigned char *p;
+  for (p = (const unsigned char *)path; *p; p++)
+    {
+    h ^= *p;
+    h *= 1099511628211ULL;
+    }
+  return h % n;
+  }
+
+
+/*============================================================================
+dispatch
+Read a book, if it is in this shard -- at once, or, with workers, by
+passing it to them
+============================================================================*/
+static void dispatch (const Options *options, PathQueue *queue,
+     const char *filename)
+  {
+  if (options->shards 
+      && shard_of (filename, options->shards) != options->shard - 1) 
+    return;
+  if (queue)
+    pathqueue_push (queue, strdup (filename));
+  else
+    {
+    ebook_trace_begin ("file", filename);
+    process_file (options, filename);
+    ebook_trace_end ();
+    }
+  }
+
+
+/*============================================================================
+worker
+Read books until there are no more, and then write out what is left
+of the thread's own output
+============================================================================*/
+static void *worker (void *arg)
+  {
+  const Worker *w = arg;
+  char *filename;
+  while ((filename = pathqueue_pop (w->queue)))
+    {
+    ebook_trace_begin ("file", filename);
+    process_file (w->options, filename);
+    ebook_trace_end ();
+    free (filename);
+    }
+  outbuf_release ();
+  return NULL;
+  }
+
+
+/*============================================================================
+read_file_list
+Read filenames from a file, or "-" for stdin, separated by delim, and
+dispatch each one as soon as it has been read
+============================================================================*/
+static BOOL read_file_list (const Options *options, PathQueue *queue,
+     const char *list, int delim)
+  {
+  FILE *f = strcmp (list, "-") == 0 ? stdin : fopen (list, "r");
+  if (!f)
+    {
+    fprintf (stderr, "Can't read file list %s: %s\n", list, 
+      strerror (errno));
+    return FALSE;
+    }
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t n;
+  while ((n = getdelim (&line, &size, delim, f)) >= 0)
+    {
+    if (n && line[n - 1] == delim) line[--n] = 0;
+    if (n) dispatch (options, queue, line);
+    }
+  BOOL ret = !ferror (f);
+  if (!ret)
+    fprintf (stderr, "Can't read file list %s: %s\n", list, 
+      strerror (errno));
+  free (line);
+  if (f != stdin) fclose (f);
+  return ret;
+  }
+
+
+/*============================================================================
+print_stats
+A summary of where the time went, on stderr so as not to mix with
+the output proper
+============================================================================*/
+static void print_stats (void)
+  {
+  EBookStats stats;
+  ebook_stats_get (&stats);
+
+  int i, p;
+  fprintf (stderr, "%-8s %7s %9s %9s %9s %9s", "format", "files", "MB",
+    "syscalls", "xml nodes", "inflated");
+  for (p = 0; p < EBOOK_N_PHASES; p++)
+    fprintf (stderr, " %9s", ebook_phase_name (p));
+  fprintf (stderr, "\n");
+
+  for (i = 0; i < EBOOK_STATS_FORMATS; i++)
+    {
+    const EBookFormatStats *s = &stats.formats[i];
+    if (s->files_opened == 0 && s->phase_calls[EBOOK_PHASE_SNIFF] == 0) 
+      continue;
+    fprintf (stderr, "%-8s %7llu %9.2f %9llu %9llu %9llu",
+      i == EBOOK_STATS_UNKNOWN ? "unknown" : ebook_type_name (i),
+      s->files_opened, s->bytes_read / 1048576.0, s->syscalls,
+      s->xml_nodes, s->entries_inflated);
+    for (p = 0; p < EBOOK_N_PHASES; p++)
+      fprintf (stderr, " %7.1fms", s->phase_ns[p] / 1e6);
+    fprintf (stderr, "\n");
+    }
+
+  // Time per file, from start to finish, including output
+  static const double percentiles[] = { 50, 90, 99, 99.9 };
+  int n_percentiles = sizeof (percentiles) / sizeof (percentiles[0]);
+  fprintf (stderr, "\n%-8s %7s", "format", "files");
+  for (p = 0; p < n_percentiles; p++)
+    {
+    char label[16];
+    snprintf (label, sizeof (label), "p%g", percentiles[p]);
+    fprintf (stderr, " %9s", label);
+    }
+  fprintf (stderr, " %9s\n", "max");
+
+  for (i = 0; i < EBOOK_STATS_FORMATS; i++)
+    {
+    const Histogram *h = &latencies[i];
+    if (h->total == 0) continue;
+    fprintf (stderr, "%-8s %7llu",
+      i == EBOOK_STATS_UNKNOWN ? "unknown" : ebook_type_name (i), h->total);
+    for (p = 0; p < n_percentiles; p++)
+      fprintf (stderr, " %7.2fms", 
+        histogram_percentile (h, percentiles[p]) / 1e6);
+    fprintf (stderr, " %7.2fms\n", h->max / 1e6);
+    }
+  }
+
+
+/*============================================================================
+parse_fields
+A comma-separated list of keys, as "title,creator,date", or of the 
+classic field names, as "title,author,year"
+============================================================================*/
+static BOOL parse_fields (const char *list, unsigned int *fields)
+  {
+  static const char *aliases[][2] = 
+    {
+    { "author", "creator" }, { "genre", "subject" }, { "year", "date" },
+    { "comment", "description" }
+    };
+  BOOL ret = TRUE;
+  char *s = strdup (list);
+  char *name, *save = NULL;
+  *fields = 0;
+  for (name = strtok_r (s, ",", &save); name && ret; 
+      name = strtok_r (NULL, ",", &save))
+    {
+    int i;
+    for (i = 0; i < sizeof (aliases) / sizeof (aliases[0]); i++)
+      if (strcmp (name, aliases[i][0]) == 0) name = (char *)aliases[i][1];
+    int key = ebookmetadata_key (name);
+    if (key >= 0)
+      *fields |= EBOOK_FIELD (key);
+    else
+      {
+      fprintf (stderr, "Unknown field: %s\n", name);
+      ret = FALSE;
+      }
+    }
+  free (s);
+  return ret;
+  }
+
+
+/*============================================================================
+main
+============================================================================*/
 int main (int argc, char **argv)
   {
   static BOOL show_version = FALSE;
   static BOOL show_usage = FALSE;
   static BOOL show_comment = FALSE;
   static BOOL html2text = FALSE;
+  static BOOL type_only = FALSE;
+  static BOOL json = FALSE;
+  static BOOL ndjson = FALSE;
+  static BOOL stats = FALSE;
+  static BOOL perf_counters = FALSE;
+  const char *trace_file = NULL;
+  const char *slow_log_file = NULL;
+  const char *field_list = NULL;
+  const char *catalog_file = NULL;
+  const char *query_file = NULL;
+  const char *sort = NULL;
+  size_t sort_memory = 64;
+  static BOOL merge = FALSE;
+  static BOOL null = FALSE;
+  int shard = 0, shards = 0, jobs = 1;
+  const char *files_from = NULL;
+  unsigned int timeout = 0;
 
-  static struct option long_options[] = 
+  static struct option long_options[] =
    {
      {"version", no_argument, &show_version, 'v'},
      {"comment", no_argument, &show_comment, 'c'},
      {"html2text", no_argument, &html2text, 'h'},
+     {"type", no_argument, &type_only, 't'},
+     {"json", no_argument, &json, TRUE},
+     {"ndjson", no_argument, &ndjson, TRUE},
+     {"stats", no_argument, &stats, TRUE},
+     {"perf-counters", no_argument, &perf_counters, TRUE},
+     {"trace", required_argument, NULL, 'T'},
+     {"slow-log", required_argument, NULL, 'L'},
+     {"slow-threshold", required_argument, NULL, 'M'},
+     {"timeout", required_argument, NULL, 'O'},
+     {"fields", required_argument, NULL, 'F'},
+     {"build-catalog", required_argument, NULL, 'B'},
+     {"query", required_argument, NULL, 'Q'},
+     {"sort", required_argument, NULL, 'S'},
+     {"sort-memory", required_argument, NULL, 'Y'},
+     {"shard", required_argument, NULL, 'H'},
+     {"merge", no_argument, &merge, TRUE},
+     {"files-from", required_argument, NULL, 'I'},
+     {"null", no_argument, NULL, '0'},
+     {"jobs", required_argument, NULL, 'j'},
      {"help", no_argument, &show_usage, '?'},
      {0, 0, 0, 0}
    };
@@ -34,7 +959,7 @@ int main (int argc, char **argv)
   while (1)
    {
    int option_index = 0;
-   opt = getopt_long (argc, argv, "?vch",
+   opt = getopt_long (argc, argv, "?vcht0j:",
      long_options, &option_index);
 
    if (opt == -1) break;
@@ -51,6 +976,35 @@ int main (int argc, char **argv)
      case 'c': show_comment = TRUE; break;
      case 'v': show_version = TRUE; break;
      case 'h': html2text = TRUE; break;
+     case 't': type_only = TRUE; break;
+     case 'T': trace_file = optarg; break;
+     case 'L': slow_log_file = optarg; break;
+     case 'M': slow_threshold = strtod (optarg, NULL) * 1e6; break;
+     case 'O': timeout = atoi (optarg); break;
+     case 'F': field_list = optarg; break;
+     case 'B': catalog_file = optarg; break;
+     case 'Q': query_file = optarg; break;
+     case 'S': sort = optarg; break;
+     case 'Y': sort_memory = strtoul (optarg, NULL, 10); break;
+     case 'I': files_from = optarg; break;
+     case '0': null = TRUE; break;
+     case 'j': 
+       jobs = atoi (optarg); 
+       if (jobs < 1 || jobs > MAX_JOBS)
+         {
+         fprintf (stderr, "Bad number of jobs: %s (1 to %d)\n", optarg,
+           MAX_JOBS);
+         exit (-1);
+         }
+       break;
+     case 'H': 
+       if (sscanf (optarg, "%d/%d", &shard, &shards) != 2 || shards < 1
+           || shard < 1 || shard > shards)
+         {
+         fprintf (stderr, "Bad shard: %s; expected K/N, as 1/4\n", optarg);
+         exit (-1);
+         }
+       break;
      case '?': show_usage = TRUE; break;
      default:  exit(-1);
      }
@@ -60,12 +1014,33 @@ int main (int argc, char **argv)
     {
     printf ("Usage %s [options] {files}\n", argv[0]);
     printf ("  -c, --show            show comment/description\n");
-    printf ("  -h, --html2text       format with html2text\n");
+    printf ("  -h, --html2text       convert HTML in the comment to plain text\n");
+    printf ("  -t, --type            show only the format, without reading the book\n");
+    printf ("      --json            write a JSON array of records\n");
+    printf ("      --ndjson          write one JSON record per line\n");
+    printf ("      --stats           show where the time went, on stderr\n");
+    printf ("      --perf-counters   show CPU counters for each format, on stderr\n");
+    printf ("      --trace FILE      write a Chrome trace of each file's phases\n");
+    printf ("      --slow-log FILE   log files slower than the threshold\n");
+    printf ("      --slow-threshold MS  threshold for --slow-log (default 100)\n");
+    printf ("      --timeout MS      give up on any book that takes longer\n");
+    printf ("      --fields LIST     read only these fields, as title,author\n");
+    printf ("      --build-catalog FILE  write the books' metadata to a catalog\n");
+    printf ("      --query FILE      look up books in a catalog; the arguments\n");
+    printf ("                        are queries, as author=Dickens, year=1830..1840\n");
+    printf ("      --sort KEY        sort by author, title, date or file\n");
+    printf ("      --sort-memory MB  memory to sort in, before using temporary\n");
+    printf ("                        files (default 64)\n");
+    printf ("      --shard K/N       read only the K'th of N shares of the files\n");
+    printf ("      --merge           merge catalogs or JSON output of other runs\n");
+    printf ("      --files-from FILE read filenames from FILE, or - for stdin\n");
+    printf ("  -0, --null            filenames in the list end with NUL, not newline\n");
+    printf ("  -j, --jobs N          read N books at once\n");
     printf ("  -v, --version         show version information\n");
     printf ("  -?                    show this message\n");
     exit (0);
     }
- 
+
   if (show_version)
     {
     printf ("ebookinfo " VERSION "\n");
@@ -73,82 +1048,186 @@ int main (int argc, char **argv)
     printf ("Distributed according to the terms of the GPL, v3.0\n");
     exit (0);
     }
- 
-  int i;
-  for (i = optind; i < argc; i++)
-    {
-    const char *filename = argv[i];
 
-    if (argc - optind > 1)
-      printf ("file: %s\n", filename);
+  int i, ret;
+  Options options;
+  memset (&options, 0, sizeof (Options));
+  options.show_comment = show_comment;
+  options.html2text = html2text;
+  options.type_only = type_only;
+  options.show_filename = (argc - optind > 1) || shards || files_from;
+  options.shard = shard;
+  options.shards = shards;
+  options.timeout = timeout;
+  // Without -c the description is never shown, so need not be read;
+  //  asking for it with --fields is as good as -c
+  options.fields = EBOOK_FIELDS_ALL & ~EBOOK_FIELD (EBOOK_KEY_DESCRIPTION);
+  if (field_list && !parse_fields (field_list, &options.fields)) exit (-1);
+  if (show_comment) options.fields |= EBOOK_FIELD (EBOOK_KEY_DESCRIPTION);
+  options.show_comment = 
+    (options.fields & EBOOK_FIELD (EBOOK_KEY_DESCRIPTION)) != 0;
+  // A catalog holds everything, unless told otherwise
+  if (catalog_file && !field_list) options.fields = EBOOK_FIELDS_ALL;
+  if (catalog_file) options.catalog = ebookcatalog_writer_create ();
+  if (sort)
+    {
+    static const char *names[] = { "author", "title", "date", "file" };
+    for (i = 0; i < sizeof (names) / sizeof (names[0]); i++)
+      if (strcmp (sort, names[i]) == 0) options.sort = SORT_AUTHOR + i;
+    if (options.sort == SORT_NONE)
+      {
+      fprintf (stderr, "Unknown sort key: %s\n", sort);
+      exit (-1);
+      }
+    // The key has to be read to sort on it; and a title's key depends
+    //  on its language
+    if (options.sort == SORT_AUTHOR)
+      options.fields |= EBOOK_FIELD (EBOOK_KEY_CREATOR);
+    else if (options.sort == SORT_TITLE)
+      options.fields |= EBOOK_FIELD (EBOOK_KEY_TITLE) 
+        | EBOOK_FIELD (EBOOK_KEY_LANGUAGE);
+    else if (options.sort == SORT_DATE)
+      options.fields |= EBOOK_FIELD (EBOOK_KEY_DATE);
+    if (!catalog_file && !merge) 
+      options.sorter = sorter_create (sort_memory * 1024 * 1024);
+    }
+  if (merge && query_file)
+    {
+    fprintf (stderr, "--merge and --query can't be used together\n");
+    exit (-1);
+    }
+  if (ndjson)
+    options.format = FORMAT_NDJSON;
+  else if (json)
+    options.format = FORMAT_JSON;
+  else
+    options.format = FORMAT_TEXT;
 
+  if (stats) ebook_stats_enable (TRUE);
+  if (trace_file) ebook_trace_enable (TRUE);
+  if (slow_log_file)
+    {
+    slow_log = fopen (slow_log_file, "w");
+    if (!slow_log)
+      {
+      fprintf (stderr, "Can't write slow log %s: %s\n", slow_log_file,
+        strerror (errno));
+      exit (-1);
+      }
+    fprintf (slow_log, "# ms\tformat\tbytes\topen\tmetadata\toutput"
+      "\tclose\tfile\n");
+    }
+  options.timing = stats || slow_log;
+  if (perf_counters)
+    {
+    // Without counters, say so and carry on with the real work
     char *error = NULL;
-    EBook *ebook = ebook_open (filename, &error);
-    if (ebook)
+    if (perfcount_init (&error))
+      options.perf_counters = TRUE;
+    else
+      {
+      fprintf (stderr, "%s\n", error);
+      free (error);
+      }
+    }
+
+  OutBuf *out = outbuf_get ();
+  if (options.format == FORMAT_JSON) outbuf_array_begin (out);
+
+  ret = 0;
+  if (query_file)
+    {
+    if (!run_query (&options, query_file, argv + optind, argc - optind))
+      ret = -1;
+    }
+  else if (merge)
+    {
+    if (!run_merge (&options, argv + optind, argc - optind)) ret = -1;
+    }
+  else
+    {
+    // With more than one job, this thread only finds the files, and
+    //  the workers read them. The queue holds a few for each worker,
+    //  so that none waits while there are files to read
+    PathQueue *queue = jobs > 1 ? pathqueue_create (4 * jobs) : NULL;
+    pthread_t *threads = queue ? malloc (jobs * sizeof (pthread_t)) : NULL;
+    int started = 0;
+    Worker w = { &options, queue };
+    for (i = 0; queue && i < jobs; i++)
       {
-      int type = ebook_get_type (ebook);
-      switch (type)
+      int e = pthread_create (&threads[started], NULL, worker, &w);
+      if (e)
         {
-        case EBOOK_TYPE_EPUB: 
-          printf ("type: EPUB\n");
-          break;
-        case EBOOK_TYPE_MOBI: 
-          printf ("type: MOBI\n");
-          break;
-        case EBOOK_TYPE_RTF: 
-          printf ("type: RTF\n");
-          break;
-        default: 
-          printf ("type: unknown\n");
-        } 
-      EBookMetadata *metadata = ebook_get_metadata (ebook, &error); 
-      if (metadata)
-	{
-        const char *title = ebookmetadata_get_title (metadata);
-        const char *author = ebookmetadata_get_author (metadata);
-        const char *genre = ebookmetadata_get_genre (metadata);
-        const char *comment = ebookmetadata_get_comment (metadata);
-        const char *year = ebookmetadata_get_year (metadata);
-        if (title)
-	  printf ("title: %s\n", title); 
-        if (author)
-	  printf ("author: %s\n", author); 
-        if (genre)
-	  printf ("genre: %s\n", genre); 
-        if (year)
-	  printf ("year: %s\n", year); 
-        if (comment && show_comment)
-          {
-          if (html2text)
-            {
-            FILE *f = popen ("html2text", "w");
-	    fprintf (f, comment); 
-            fclose (f);
-            }
-          else
-            {
-            printf (comment);
-            printf ("\n");
-            }
-          }
+        fprintf (stderr, "Can't start thread %d of %d: %s\n", i + 1, jobs, 
+          strerror (e));
+        break;
+        }
+      started++;
+      }
+    // With no threads at all, read the books in this one
+    if (queue && started == 0)
+      {
+      pathqueue_destroy (queue);
+      queue = NULL;
+      }
 
-	ebookmetadata_destroy (metadata);
-	}
-      else
-	{
-	fprintf (stderr, "Can't read metadata: %s\n", error);
-	free (error);
-	}
+    for (i = optind; i < argc; i++)
+      dispatch (&options, queue, argv[i]);
+    if (files_from 
+        && !read_file_list (&options, queue, files_from, null ? 0 : '\n'))
+      ret = -1;
+
+    if (queue)
+      {
+      pathqueue_close (queue);
+      for (i = 0; i < started; i++)
+        pthread_join (threads[i], NULL);
+      pathqueue_destroy (queue);
+      }
+    free (threads);
+    }
 
-      ebook_close (ebook);
+  if (options.sorter)
+    {
+    char *error = NULL;
+    if (!sorter_finish (options.sorter, write_sorted, out, &error))
+      {
+      fprintf (stderr, "Can't sort: %s\n", error);
+      free (error);
+      ret = -1;
       }
-    else
+    sorter_destroy (options.sorter);
+    }
+
+  if (options.format == FORMAT_JSON) outbuf_array_end (out);
+  outbuf_flush (out);
+
+  if (options.catalog)
+    {
+    char *error = NULL;
+    if (!ebookcatalog_writer_write (options.catalog, catalog_file, &error))
       {
-      fprintf (stderr, "Can't open e-book file %s: %s\n", filename, error);
+      fprintf (stderr, "%s\n", error);
       free (error);
+      ret = -1;
       }
+    ebookcatalog_writer_destroy (options.catalog);
     }
-  
-  return 0;
+
+  if (stats) print_stats ();
+  if (slow_log) fclose (slow_log);
+  if (options.perf_counters) perfcount_report (stderr);
+
+  if (trace_file)
+    {
+    char *error = NULL;
+    if (!ebook_trace_write (trace_file, &error))
+      {
+      fprintf (stderr, "%s\n", error);
+      free (error);
+      }
+    }
+
+  return ret;
   }
 
@@ -0,0 +1,511 @@
+/*============================================================================
+ * ebookinfo
+ * mergeinput.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ebookinfo/ebookinfo.h>
+#include "mergeinput.h"
+
+#define CATALOG_MAGIC "EBOOKCAT"
+
+// Deeper than anything ebookinfo writes
+#define MAX_DEPTH 8
+
+#define J_OTHER  0
+#define J_STRING 1
+#define J_ARRAY  2
+#define J_OBJECT 3
+
+/*============================================================================
+A parsed JSON value. Numbers, true, false and null are all J_OTHER,
+since ebookinfo writes none of them; the members of an object are
+its items, with their names in names
+============================================================================*/
+typedef struct _JValue
+  {
+  int type;
+  char *string;
+  int n;
+  char **names;
+  struct _JValue *items;
+  } JValue;
+
+struct _MergeInput
+  {
+  char *filename;
+  EBookCatalog *catalog;
+  int book;
+  FILE *f;
+  char *line;
+  size_t line_size;
+  int line_number;
+  };
+
+// Where each key's values are in a JSON record, and the name of their
+//  qualifiers, for values written as objects. The classic field is
+//  read only if the record does not have the full list
+static const struct
+  {
+  const char *name;
+  int key;
+  const char *qualifier;
+  const char *classic;
+  } json_keys[] =
+  {
+  { "title", EBOOK_KEY_TITLE, NULL, NULL },
+  { "creators", EBOOK_KEY_CREATOR, "role", "author" },
+  { "subjects", EBOOK_KEY_SUBJECT, NULL, "genre" },
+  { "comment", EBOOK_KEY_DESCRIPTION, NULL, NULL },
+  { "date", EBOOK_KEY_DATE, NULL, "year" },
+  { "language", EBOOK_KEY_LANGUAGE, NULL, NULL },
+  { "publisher", EBOOK_KEY_PUBLISHER, NULL, NULL },
+  { "identifiers", EBOOK_KEY_IDENTIFIER, "scheme", NULL },
+  { "series", EBOOK_KEY_SERIES, NULL, NULL },
+  { "series_index", EBOOK_KEY_SERIES_INDEX, NULL, NULL },
+  };
+#define N_JSON_KEYS (sizeof (json_keys) / sizeof (json_keys[0]))
+
+
+/*============================================================================
+free_value
+============================================================================*/
+static void free_value (JValue *v)
+  {
+  int i;
+  for (i = 0; i < v->n; i++)
+    {
+    free_value (&v->items[i]);
+    if (v->names) free (v->names[i]);
+    }
+  free (v->items);
+  free (v->names);
+  free (v->string);
+  memset (v, 0, sizeof (JValue));
+  }
+
+
+/*============================================================================
+skip_space
+============================================================================*/
+static void skip_space (const char **p)
+  {
+  while (**p == ' ' || **p == '\t' || **p == '\n' || **p == '\r') (*p)++;
+  }
+
+
+/*============================================================================
+hex4
+============================================================================*/
+static BOOL hex4 (const char *s, unsigned int *v)
+  {
+  int i;
+  *v = 0;
+  for (i = 0; i < 4; i++)
+    {
+    char c = s[i];
+    int d;
+    if (c >= '0' && c <= '9') d = c - '0';
+    else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+    else return FALSE;
+    *v = (*v << 4) | d;
+    }
+  return TRUE;
+  }
+
+
+/*============================================================================
+put_utf8
+============================================================================*/
+static char *put_utf8 (char *w, unsigned int cp)
+  {
+  if (cp < 0x80)
+    *w++ = cp;
+  else if (cp < 0x800)
+    {
+    *w++ = 0xc0 | (cp >> 6);
+    *w++ = 0x80 | (cp & 0x3f);
+    }
+  else if (cp < 0x10000)
+    {
+    *w++ = 0xe0 | (cp >> 12);
+    *w++ = 0x80 | ((cp >> 6) & 0x3f);
+    *w++ = 0x80 | (cp & 0x3f);
+    }
+  else
+    {
+    *w++ = 0xf0 | (cp >> 18);
+    *w++ = 0x80 | ((cp >> 12) & 0x3f);
+    *w++ = 0x80 | ((cp >> 6) & 0x3f);
+    *w++ = 0x80 | (cp & 0x3f);
+    }
+  return w;
+  }
+
+
+/*============================================================================
+parse_string
+A string at *p, which is at its opening quote. The decoded string is
+never longer than the escaped one
+============================================================================*/
+static BOOL parse_string (const char **p, char **out)
+  {
+  const char *s = *p + 1, *end = s;
+  while (*end && *end != '"')
+    {
+    if (*end == '\\' && end[1]) end++;
+    end++;
+    }
+  if (*end != '"') return FALSE;
+
+  char *ret = malloc (end - s + 1), *w = ret;
+  while (s < end)
+    {
+    if (*s != '\\')
+      {
+      *w++ = *s++;
+      continue;
+      }
+    s++;
+    unsigned int cp, low;
+    switch (*s++)
+      {
+      case '"': *w++ = '"'; break;
+      case '\\': *w++ = '\\'; break;
+      case '/': *w++ = '/'; break;
+      case 'b': *w++ = '\b'; break;
+      case 'f': *w++ = '\f'; break;
+      case 'n': *w++ = '\n'; break;
+      case 'r': *w++ = '\r'; break;
+      case 't': *w++ = '\t'; break;
+      case 'u':
+        if (!hex4 (s, &cp))
+          {
+          free (ret);
+          return FALSE;
+          }
+        s += 4;
+        if (cp >= 0xd800 && cp < 0xdc00 && s[0] == '\\' && s[1] == 'u'
+            && hex4 (s + 2, &low) && low >= 0xdc00 && low < 0xe000)
+          {
+          cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+          s += 6;
+          }
+        w = put_utf8 (w, cp);
+        break;
+      default:
+        free (ret);
+        return FALSE;
+      }
+    }
+  *w = 0;
+  *out = ret;
+  *p = end + 1;
+  return TRUE;
+  }
+
+
+/*============================================================================
+parse_value
+============================================================================*/
+static BOOL parse_value (const char **p, JValue *v, int depth)
+  {
+  memset (v, 0, sizeof (JValue));
+  skip_space (p);
+  char c = **p;
+  if (c == '"')
+    {
+    v->type = J_STRING;
+    return parse_string (p, &v->string);
+    }
+  if (c != '{' && c != '[')
+    {
+    const char *start = *p;
+    while ((**p >= '0' && **p <= '9') || (**p >= 'a' && **p <= 'z')
+        || **p == '-' || **p == '+' || **p == '.' || **p == 'E')
+      (*p)++;
+    v->type = J_OTHER;
+    return *p > start;
+    }
+  if (depth >= MAX_DEPTH) return FALSE;
+
+  char close = c == '{' ? '}' : ']';
+  v->type = c == '{' ? J_OBJECT : J_ARRAY;
+  (*p)++;
+  skip_space (p);
+  if (**p == close)
+    {
+    (*p)++;
+    return TRUE;
+    }
+  while (TRUE)
+    {
+    char *name = NULL;
+    if (v->type == J_OBJECT)
+      {
+      skip_space (p);
+      if (**p != '"' || !parse_string (p, &name)) return FALSE;
+      skip_space (p);
+      if (**p != ':')
+        {
+        free (name);
+        return FALSE;
+        }
+      (*p)++;
+      }
+    v->items = realloc (v->items, (v->n + 1) * sizeof (JValue));
+    if (v->type == J_OBJECT)
+      {
+      v->names = realloc (v->names, (v->n + 1) * sizeof (char *));
+      v->names[v->n] = name;
+      }
+    // Counted before it is parsed, so that a failure frees it
+    BOOL ok = parse_value (p, &v->items[v->n++], depth + 1);
+    if (!ok) return FALSE;
+    skip_space (p);
+    if (**p == close)
+      {
+      (*p)++;
+      return TRUE;
+      }
+    if (**p != ',') return FALSE;
+    (*p)++;
+    }
+  }
+
+
+/*============================================================================
+member
+============================================================================*/
+static const JValue *member (const JValue *object, const char *name)
+  {
+  int i;
+  if (object->type != J_OBJECT) return NULL;
+  for (i = 0; i < object->n; i++)
+    if (strcmp (object->names[i], name) == 0) return &object->items[i];
+  return NULL;
+  }
+
+
+/*============================================================================
+string_of
+The string of a value, or NULL if it is not a string
+============================================================================*/
+static const char *string_of (const JValue *v)
+  {
+  return v && v->type == J_STRING ? v->string : NULL;
+  }
+
+
+/*============================================================================
+type_from_name
+============================================================================*/
+static int type_from_name (const char *name)
+  {
+  int t;
+  if (name)
+    for (t = 0; strcmp (ebook_type_name (t), "unknown") != 0; t++)
+      if (strcmp (ebook_type_name (t), name) == 0) return t;
+  return EBOOK_TYPE_UNKNOWN;
+  }
+
+
+/*============================================================================
+record_from_json
+============================================================================*/
+static BOOL record_from_json (const JValue *object, MergeRecord *record)
+  {
+  const char *filename = string_of (member (object, "file"));
+  if (!filename) return FALSE;
+  record->filename = strdup (filename);
+  record->type = type_from_name (string_of (member (object, "type")));
+  const char *error = string_of (member (object, "error"));
+  if (error)
+    {
+    record->error = strdup (error);
+    return TRUE;
+    }
+
+  int n = 0, size = 16;
+  int *keys = malloc (size * sizeof (int));
+  const char **values = malloc (size * sizeof (char *));
+  const char **qualifiers = malloc (size * sizeof (char *));
+  size_t k;
+  for (k = 0; k < N_JSON_KEYS; k++)
+    {
+    const JValue *v = member (object, json_keys[k].name);
+    if (!v && json_keys[k].classic) v = member (object, json_keys[k].classic);
+    if (!v) continue;
+    int i, count = v->type == J_ARRAY ? v->n : 1;
+    for (i = 0; i < count; i++)
+      {
+      const JValue *item = v->type == J_ARRAY ? &v->items[i] : v;
+      const char *value = string_of (item), *qualifier = NULL;
+      if (item->type == J_OBJECT)
+        {
+        value = string_of (member (item, "value"));
+        if (json_keys[k].qualifier)
+          qualifier = string_of (member (item, json_keys[k].qualifier));
+        }
+      if (!value) continue;
+      if (n == size)
+        {
+        size *= 2;
+        keys = realloc (keys, size * sizeof (int));
+        values = realloc (values, size * sizeof (char *));
+        qualifiers = realloc (qualifiers, size * sizeof (char *));
+        }
+      keys[n] = json_keys[k].key;
+      values[n] = value;
+      qualifiers[n] = qualifier;
+      n++;
+      }
+    }
+  record->metadata = ebookmetadata_create_values (n, keys, values,
+    qualifiers);
+  free (keys);
+  free (values);
+  free (qualifiers);
+  return TRUE;
+  }
+
+
+/*============================================================================
+mergeinput_open
+============================================================================*/
+MergeInput *mergeinput_open (const char *filename, char **error)
+  {
+  FILE *f = fopen (filename, "r");
+  if (!f)
+    {
+    asprintf (error, "Can't open %s: %s", filename, strerror (errno));
+    return NULL;
+    }
+  MergeInput *self = calloc (1, sizeof (MergeInput));
+  self->filename = strdup (filename);
+  char magic[sizeof (CATALOG_MAGIC) - 1];
+  if (fread (magic, 1, sizeof (magic), f) == sizeof (magic)
+      && memcmp (magic, CATALOG_MAGIC, sizeof (magic)) == 0)
+    {
+    fclose (f);
+    self->catalog = ebookcatalog_open (filename, error);
+    if (!self->catalog)
+      {
+      mergeinput_close (self);
+      return NULL;
+      }
+    }
+  else
+    {
+    rewind (f);
+    self->f = f;
+    }
+  return self;
+  }
+
+
+/*============================================================================
+mergeinput_close
+============================================================================*/
+void mergeinput_close (MergeInput *self)
+  {
+  if (self->catalog) ebookcatalog_close (self->catalog);
+  if (self->f) fclose (self->f);
+  free (self->line);
+  free (self->filename);
+  free (self);
+  }
+
+
+/*============================================================================
+next_from_catalog
+A book whose record is damaged is given as one that could not be read
+============================================================================*/
+static BOOL next_from_catalog (MergeInput *self, MergeRecord *record)
+  {
+  if (self->book >= ebookcatalog_count (self->catalog)) return FALSE;
+  int book = self->book++;
+  const char *filename = ebookcatalog_get_filename (self->catalog, book);
+  record->filename = strdup (filename ? filename : "");
+  record->type = ebookcatalog_get_type (self->catalog, book);
+  EBookRecord r;
+  char *error = NULL;
+  if (ebookcatalog_get_record (self->catalog, book, &r, &error))
+    record->metadata = ebookrecord_to_metadata (&r);
+  else
+    {
+    record->error = strdup (error);
+    free (error);
+    }
+  return TRUE;
+  }
+
+
+/*============================================================================
+next_from_json
+Lines other than records -- blank lines, and the brackets around a
+--json array -- are skipped, as are the commas after records
+============================================================================*/
+static BOOL next_from_json (MergeInput *self, MergeRecord *record,
+       char **error)
+  {
+  while (getline (&self->line, &self->line_size, self->f) >= 0)
+    {
+    self->line_number++;
+    char *line = self->line;
+    size_t length = strlen (line);
+    while (length && strchr (" \t\r\n,", line[length - 1])) length--;
+    line[length] = 0;
+    while (*line == ' ' || *line == '\t') line++;
+    if (!*line || strcmp (line, "[") == 0 || strcmp (line, "]") == 0)
+      continue;
+
+    const char *p = line;
+    JValue object;
+    BOOL ok = parse_value (&p, &object, 0) && object.type == J_OBJECT;
+    skip_space (&p);
+    ok = ok && *p == 0 && record_from_json (&object, record);
+    free_value (&object);
+    if (!ok)
+      {
+      mergerecord_clear (record);
+      asprintf (error, "%s, line %d: not a record written by ebookinfo",
+        self->filename, self->line_number);
+      }
+    return ok;
+    }
+  if (ferror (self->f))
+    asprintf (error, "Can't read %s: %s", self->filename, strerror (errno));
+  return FALSE;
+  }
+
+
+/*============================================================================
+mergeinput_next
+============================================================================*/
+BOOL mergeinput_next (MergeInput *self, MergeRecord *record, char **error)
+  {
+  memset (record, 0, sizeof (MergeRecord));
+  record->type = EBOOK_TYPE_UNKNOWN;
+  if (self->catalog) return next_from_catalog (self, record);
+  return next_from_json (self, record, error);
+  }
+
+
+/*============================================================================
+mergerecord_clear
+============================================================================*/
+void mergerecord_clear (MergeRecord *record)
+  {
+  free (record->filename);
+  free (record->error);
+  if (record->metadata) ebookmetadata_destroy (record->metadata);
+  memset (record, 0, sizeof (MergeRecord));
+  record->type = EBOOK_TYPE_UNKNOWN;
+  }
+
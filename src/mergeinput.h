@@ -0,0 +1,48 @@
+/*============================================================================
+ * ebookinfo
+ * mergeinput.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebookmetadata.h>
+
+/*============================================================================
+A MergeInput reads back, one book at a time and in order, what an
+earlier run wrote: a catalog from --build-catalog, or the output of
+--ndjson or --json. Catalogs are told from JSON by their first bytes.
+JSON is read a line at a time, so it must be as ebookinfo writes it,
+one record to a line; the metadata is rebuilt from the values it
+shows, and the classic fields derived from them afresh
+============================================================================*/
+
+struct _MergeInput;
+typedef struct _MergeInput MergeInput;
+
+typedef struct _MergeRecord
+  {
+  char *filename;
+  int type;
+  EBookMetadata *metadata;   // NULL for a book that could not be read
+  char *error;               // Why not, if metadata is NULL
+  } MergeRecord;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+MergeInput *mergeinput_open (const char *filename, char **error);
+void        mergeinput_close (MergeInput *self);
+// Read the next book into record, to be freed by mergerecord_clear().
+//  Returns FALSE at the end of the input, and also if it cannot be
+//  read, with *error set
+BOOL        mergeinput_next (MergeInput *self, MergeRecord *record,
+              char **error);
+void        mergerecord_clear (MergeRecord *record);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
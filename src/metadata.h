@@ -0,0 +1,101 @@
+/*============================================================================
+ * libebookinfo
+ * metadata.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebookmetadata.h>
+#include <ebookinfo/stringpool.h>
+
+// The classic fields
+#define FIELD_TITLE   0
+#define FIELD_AUTHOR  1
+#define FIELD_YEAR    2
+#define FIELD_GENRE   3
+#define FIELD_COMMENT 4
+#define N_FIELDS      5
+
+// The sort keys, which follow the author and title, and are not 
+//  classic fields
+#define FIELD_AUTHOR_SORT 5
+#define FIELD_TITLE_SORT  6
+#define N_ALL_FIELDS      7
+
+/*============================================================================
+A builder collects the values of an EBookMetadata and then packs them
+into one allocation. Values are held as pointers and lengths, not
+copies, so whatever they point at -- usually the book's source data,
+or a parsed document -- must stay valid until ebi_mdbuilder_build().
+A string made just for the metadata can be handed to the builder with
+ebi_mdbuilder_keep(), and is freed by ebi_mdbuilder_clear(). A value
+is cut short at its first NUL, as strndup() would. Up to
+EBI_MDBUILDER_INLINE values are held without allocating. Values for
+keys outside the builder's fields are dropped; handlers can ask
+ebi_mdbuilder_wants() to avoid the work of finding them at all, and
+ebi_mdbuilder_complete() to stop reading early. A builder started
+while the thread has a current string pool, as set by
+ebi_metadata_set_pool(), builds metadata whose repeating strings are 
+in that pool
+============================================================================*/
+
+#define EBI_MDBUILDER_INLINE 32
+
+typedef struct _EBIMDValue
+  {
+  int key;                // -1 once replaced
+  const char *value;
+  size_t length;
+  const char *qualifier;  // May be NULL
+  size_t qualifier_length;
+  } EBIMDValue;
+
+typedef struct _EBIMDBuilder
+  {
+  EBIMDValue inline_values[EBI_MDBUILDER_INLINE];
+  EBIMDValue *values;
+  unsigned int fields;
+  unsigned int found;
+  int n_values;
+  int size;
+  char **kept;
+  int n_kept;
+  EBookStringPool *pool;
+  } EBIMDBuilder;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+void           ebi_mdbuilder_init (EBIMDBuilder *self, unsigned int fields);
+void           ebi_mdbuilder_add (EBIMDBuilder *self, int key, 
+                 const char *value, size_t length, 
+                 const char *qualifier, size_t qualifier_length);
+void           ebi_mdbuilder_set (EBIMDBuilder *self, int key, 
+                 const char *value, size_t length);
+BOOL           ebi_mdbuilder_has (const EBIMDBuilder *self, int key);
+BOOL           ebi_mdbuilder_wants (const EBIMDBuilder *self, int key);
+BOOL           ebi_mdbuilder_complete (const EBIMDBuilder *self);
+const char    *ebi_mdbuilder_keep (EBIMDBuilder *self, char *s);
+EBookMetadata *ebi_mdbuilder_build (const EBIMDBuilder *self);
+void           ebi_mdbuilder_clear (EBIMDBuilder *self);
+
+// Make pool, which may be NULL, the calling thread's current string 
+//  pool, and return the one it replaces
+EBookStringPool *ebi_metadata_set_pool (EBookStringPool *pool);
+
+// The classic fields, by number. ebi_metadata_edited() is a mask, 
+//  1 << FIELD_TITLE and so on, of those changed with the setters
+unsigned int   ebi_metadata_edited (const EBookMetadata *self);
+const char    *ebi_metadata_get_field (const EBookMetadata *self, 
+                 int field);
+void           ebi_metadata_set_field (EBookMetadata *self, int field, 
+                 const char *value);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
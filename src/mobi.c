@@ -13,59 +13,35 @@
 #include <ebookinfo/ebook.h>
 #include <ebookinfo/constants.h>
 #include <ebookinfo/ebookmetadata.h>
-#include "epub.h" 
+#include "mobi.h" 
+#include "alloc.h"
+#include "metadata.h"
+#include "cancel.h"
 
 typedef struct _MOBI 
   {
-  char *filename;
+  const unsigned char *data;
+  size_t length;
   EBookMetadata *cached_metadata;
+  unsigned int cached_fields;
   } MOBI;
 
 
-/*============================================================================
-mobi_recognize
-============================================================================*/
-BOOL mobi_recognize (const char *filename)
-  {
-  BOOL ret = FALSE;
-  int f = open (filename, O_RDONLY);
-  if (f)
-    {
-    unsigned char buff[78];
-    int n;
-    n = read (f, buff, sizeof (buff));
-    if (n == sizeof (buff))
-      {
-      if (strncmp ((const char *)buff + 64, "MOBI", 4) == 0)
-        {
-        ret = TRUE;
-        }
-      }
-    close (f);
-    }
-  return ret;
-  }
-
-
 /*============================================================================
 mobi_close
 ============================================================================*/
-void mobi_close (EBook *self)
+static void mobi_close (EBook *self)
   {
   if (self)
     {
     MOBI *mobi = (MOBI *) ebook_get_data (self);
     if (mobi)
       {
-      if (mobi->filename)
-        {
-        free (mobi->filename);
-        }
       if (mobi->cached_metadata)
         {
         ebookmetadata_destroy (mobi->cached_metadata);
         }
-      free (mobi);
+      ebi_free (mobi);
       }
     }
   }
@@ -73,14 +49,17 @@ void mobi_close (EBook *self)
 
 /*============================================================================
 mobi_open
+The book is read in place from the source, which stays valid until
+the book is closed
 ============================================================================*/
-BOOL mobi_open (EBook *self, const char *filename, char **error)
+static BOOL mobi_open (EBook *self, const EBookSource *source, char **error)
   {
   BOOL ret = TRUE;
 
-  MOBI *mobi = malloc (sizeof (MOBI));
+  MOBI *mobi = ebi_malloc (sizeof (MOBI));
   memset (mobi, 0, sizeof (MOBI));
-  mobi->filename = strdup (filename);
+  mobi->data = source->data;
+  mobi->length = source->length;
   ebook_set_data (self, mobi);
   
   return ret;
@@ -88,163 +67,136 @@ BOOL mobi_open (EBook *self, const char *filename, char **error)
 
 
 /*===========================================================================
-do_mobi_record
+get32
+MOBI integers are big-endian
 ===========================================================================*/
-void do_mobi_record (int f, int offset, int length, char **title, 
-       char **creator, char **year, char **genre, 
-       char **comment) 
+static unsigned int get32 (const unsigned char *p)
   {
-  //printf ("offset=%d\n", offset);
-  //printf ("length=%d\n", length);
-  int old_offset = lseek (f, 0, SEEK_CUR);
-  lseek (f, offset, SEEK_SET);
+  return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+  }
 
-  unsigned char buff[128];
-  read (f, buff, sizeof (buff));
+
+/*===========================================================================
+do_mobi_record
+The fields found are referenced in place, in the source data
+===========================================================================*/
+static void do_mobi_record (const unsigned char *data, size_t length,
+       size_t offset, EBIMDBuilder *builder) 
+  {
+  if (offset > length || length - offset < 24) return;
+  const unsigned char *buff = data + offset;
 
   if (strncmp ((const char *)buff+16, "MOBI", 4) == 0)
     {
-    int mobi_len = 
-          256 * 256 * 256 * (int)buff[20] +
-          256 * 256 * (int)buff[21] +
-          256 * (int)buff[22] +
-          (int)buff[23];
+    size_t mobi_len = get32 (buff + 20);
 
-    lseek (f, offset + mobi_len + 16, SEEK_SET);
     // We should now be four bytes int the EXTH header, if there is one
-    read (f, buff, 12); // Just read up to the start of the EXTH records 
-    //printf ("%c %c %c %c\n", buff[0], buff[1], buff[2], buff[3]);
+    size_t p = offset + mobi_len + 16;
+    if (p > length || length - p < 12) return;
+    buff = data + p;
     if (strncmp ((const char *)buff, "EXTH", 4) == 0)
       {
-      //int ext_len = 
-      //    256 * 256 * 256 * (int)buff[4] +
-      //    256 * 256 * (int)buff[5] +
-      //    256 * (int)buff[6] +
-      //    (int)buff[7];
-      
-      int ext_count = 
-          256 * 256 * 256 * (int)buff[8] +
-          256 * 256 * (int)buff[9] +
-          256 * (int)buff[10] +
-          (int)buff[11];
-      
-      //printf ("GOT EXTH %d %d\n", ext_len, ext_count);
+      int ext_count = get32 (buff + 8);
+      p += 12;
 
       int j;
-      for (j = 0; j < ext_count; j++)
+      for (j = 0; j < ext_count && !ebi_mdbuilder_complete (builder); j++)
         {
-        read (f, buff, 4); 
-        
-        int record_type = 
-          256 * 256 * 256 * (int)buff[0] +
-          256 * 256 * (int)buff[1] +
-          256 * (int)buff[2] +
-          (int)buff[3];
-      
-        read (f, buff, 4); 
-        
-        int record_len = 
-          256 * 256 * 256 * (int)buff[0] +
-          256 * 256 * (int)buff[1] +
-          256 * (int)buff[2] +
-          (int)buff[3];
-
-        char *exth = malloc (record_len - 8 + 1);
-        memset (exth, 0, record_len - 8 + 1);
-        read (f, exth, record_len - 8); 
-        //printf ("type=%d, len=%d, data=%s\n", record_type, record_len, exth);
+        if (length - p < 8) break;
+        int record_type = get32 (data + p);
+        size_t record_len = get32 (data + p + 4);
+        if (record_len < 8 || record_len > length - p) break;
+
+        const char *exth = (const char *)data + p + 8;
+        int exth_len = record_len - 8;
+        p += record_len;
         
-        if (record_type == 100)
-          *creator = strdup (exth);
-        else if (record_type == 503)
-          *title = strdup (exth);
-        else if (record_type == 106)
+        switch (record_type)
           {
-          if (*year == NULL)
-            {
-            *year = strdup (exth);
-            if (strlen (*year) > 4) (*year)[4] = 0;
-            }
+          case 100:
+            ebi_mdbuilder_add (builder, EBOOK_KEY_CREATOR, exth, exth_len,
+              NULL, 0);
+            break;
+          case 101:
+            ebi_mdbuilder_add (builder, EBOOK_KEY_PUBLISHER, exth, exth_len,
+              NULL, 0);
+            break;
+          case 103:
+            if (!ebi_mdbuilder_has (builder, EBOOK_KEY_DESCRIPTION))
+              ebi_mdbuilder_add (builder, EBOOK_KEY_DESCRIPTION, exth, 
+                exth_len, NULL, 0);
+            break;
+          case 104:
+            ebi_mdbuilder_add (builder, EBOOK_KEY_IDENTIFIER, exth, exth_len,
+              "ISBN", 4);
+            break;
+          case 105:
+            ebi_mdbuilder_add (builder, EBOOK_KEY_SUBJECT, exth, exth_len,
+              NULL, 0);
+            break;
+          case 106:
+            if (!ebi_mdbuilder_has (builder, EBOOK_KEY_DATE))
+              ebi_mdbuilder_add (builder, EBOOK_KEY_DATE, exth, exth_len,
+                NULL, 0);
+            break;
+          case 113:
+            ebi_mdbuilder_add (builder, EBOOK_KEY_IDENTIFIER, exth, exth_len,
+              "ASIN", 4);
+            break;
+          case 503:
+            ebi_mdbuilder_set (builder, EBOOK_KEY_TITLE, exth, exth_len);
+            break;
+          case 524:
+            ebi_mdbuilder_add (builder, EBOOK_KEY_LANGUAGE, exth, exth_len,
+              NULL, 0);
+            break;
           }
-        else if (record_type == 105)
-          {
-          if (*genre)
-            {
-            *genre = realloc (*genre, strlen (*genre) + strlen (exth) + 5);
-            strcat (*genre, ",");
-            strcat (*genre, exth);
-            }
-          else
-            *genre = strdup (exth);
-          }
-        else if (record_type == 103)
-          if (*comment == NULL)
-            *comment = strdup (exth);
-
-        free (exth);
         }
       }
     }
-
-  lseek (f, old_offset, SEEK_SET);
   }
 
 /*===========================================================================
-mobi_get_metadata
+_mobi_get_metadata
+Records are read until the builder has every field it wants
 ===========================================================================*/
-BOOL _mobi_get_metadata (const char *filename, 
-        char **title, char **creator, char **year, char **genre, 
-        char **comment, char **error)
+static BOOL _mobi_get_metadata (const unsigned char *data, size_t length, 
+        EBIMDBuilder *builder, char **error)
   {
   BOOL ret = FALSE;
-  int f = open (filename, O_RDONLY);
-  if (!f)
-    {
-    return ret;
-    }
 
-  unsigned char buff[78];
-  int n;
-  n = read (f, buff, sizeof (buff));
-  if (n == sizeof (buff))
+  if (length >= 78 + 8)
     {
-    if (strncmp ((const char *)buff + 64, "MOBI", 4) == 0)
+    if (strncmp ((const char *)data + 64, "MOBI", 4) == 0)
       {
       // If we get this far, we are almost certainly looking at a MOBI
       //  file, whether it turns out to have any meta-data or not.
       // So this is a successful read.
       ret = TRUE;
-      int num_records = 256 * (int)buff[76] + (int)buff[77];
-      read (f, buff, 8);
-      int last_offset = 
-          256 * 256 * 256 * (int)buff[0] +
-          256 * 256 * (int)buff[1] +
-          256 * (int)buff[2] +
-          (int)buff[3];
+      int num_records = 256 * (int)data[76] + (int)data[77];
+      size_t p = 78;
+      size_t last_offset = get32 (data + p);
+      int n;
       for (n = 1; n < num_records; n++)
         {
-        read (f, buff, 8);
-        int offset = 
-          256 * 256 * 256 * (int)buff[0] +
-          256 * 256 * (int)buff[1] +
-          256 * (int)buff[2] +
-          (int)buff[3];
-        do_mobi_record (f, last_offset, offset-last_offset, title,
-          creator, year, genre, comment);
+        if (EBI_CANCELLED () || ebi_mdbuilder_complete (builder)) break;
+        p += 8;
+        if (p + 8 > length) break;
+        size_t offset = get32 (data + p); 
+        do_mobi_record (data, length, last_offset, builder);
         last_offset = offset;
         }
       }
     else
       {
-      //kmslog_debug ("Did not find MOBI identifier in file: %s", filename);
+      asprintf (error, "Did not find MOBI identifier");
       }
     }
   else
    {
-      //kmslog_error ("Can't read file header: %s", filename);
+   asprintf (error, "Can't read MOBI header");
    }
 
-  close (f);
   return ret;
   }
 
@@ -254,39 +206,57 @@ BOOL _mobi_get_metadata (const char *filename,
 /*============================================================================
 mobi_get_metadata
 ============================================================================*/
-EBookMetadata *mobi_get_metadata (const EBook *ebook, char **error)
+static EBookMetadata *mobi_get_metadata (const EBook *ebook, 
+    unsigned int fields, char **error)
   {
   EBookMetadata *ret = NULL;
 
-  char *title = NULL, *author=NULL, *year=NULL, *genre=NULL, *comment=NULL;
-
   MOBI *mobi = (MOBI *) ebook_get_data (ebook);
 
-  if (mobi->cached_metadata) 
-    return ebookmetadata_clone (mobi->cached_metadata);
+  if (mobi->cached_metadata && (fields & ~mobi->cached_fields) == 0) 
+    return ebookmetadata_retain (mobi->cached_metadata);
 
-  const char *filename = mobi->filename;
+  // Re-read the cached fields too, so that the cache only grows
+  if (mobi->cached_metadata) fields |= mobi->cached_fields;
 
-  BOOL ok = _mobi_get_metadata (filename, 
-     &title, &author, &year, &genre, &comment,
-     error);
+  EBIMDBuilder builder;
+  ebi_mdbuilder_init (&builder, fields);
+
+  BOOL ok = _mobi_get_metadata (mobi->data, mobi->length, &builder, error);
 
   if (ok)
     {
-    ret = ebookmetadata_create (title, 
-      author, year, genre, comment); 
-  
-    if (title) free (title);
-    if (author) free (author);
-    if (year) free (year);
-    if (genre) free (genre);
-    if (comment) free (comment);
-
-    mobi->cached_metadata = ebookmetadata_clone (ret);
+    ret = ebi_mdbuilder_build (&builder);
+    ebookmetadata_destroy (mobi->cached_metadata);
+    mobi->cached_metadata = ebookmetadata_retain (ret);
+    mobi->cached_fields = fields;
     }
+
+  ebi_mdbuilder_clear (&builder);
   
   return ret;
   }
 
 
+/*============================================================================
+mobi_format
+============================================================================*/
+static const EBookMagic mobi_magics[] =
+  {
+  { 60, "BOOKMOBI", 8, EBOOK_CONFIDENCE_HIGH },
+  { 64, "MOBI", 4, EBOOK_CONFIDENCE_MEDIUM },
+  { 0, NULL, 0, 0 }
+  };
+
+const EBookFormat mobi_format =
+  {
+  EBOOK_TYPE_MOBI,
+  "MOBI",
+  mobi_magics,
+  NULL,
+  mobi_open,
+  mobi_get_metadata,
+  mobi_close
+  };
+
 
@@ -6,17 +6,13 @@
 
 #pragma once
 
-#include <ebookinfo/constants.h> 
-#include <ebookinfo/ebookmetadata.h> 
+#include "format.h" 
 
 #ifdef __CPLUSPLUS
 extern "C" {
 #endif
 
-BOOL           mobi_recognize (const char *filename);
-void           mobi_close (EBook *self);
-BOOL           mobi_open (EBook *self, const char *filename, char **error);
-EBookMetadata *mobi_get_metadata (const EBook *ebook, char **error);
+extern const EBookFormat mobi_format;
 
 #ifdef __CPLUSPLUS
 }
@@ -0,0 +1,264 @@
+/*============================================================================
+ * ebookinfo
+ * outbuf.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include "outbuf.h"
+
+// Records are collected until the buffer holds at least this much,
+//  and then written in one go
+#define OUTBUF_FLUSH_SIZE (1024 * 1024)
+
+struct _OutBuf
+  {
+  char *data;
+  size_t length;
+  size_t size;
+  };
+
+static int out_fd = 1;
+static pthread_mutex_t flush_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread OutBuf *thread_outbuf;
+
+// Set while a JSON array is open and no item has been written out yet:
+//  the first item to reach the file loses its leading separator
+static BOOL array_first;
+
+
+/*============================================================================
+outbuf_init
+Set the descriptor that all buffers flush to. The default is stdout
+============================================================================*/
+void outbuf_init (int fd)
+  {
+  out_fd = fd;
+  }
+
+
+/*============================================================================
+outbuf_get
+Get the calling thread's buffer, creating it if necessary
+============================================================================*/
+OutBuf *outbuf_get (void)
+  {
+  if (!thread_outbuf)
+    {
+    OutBuf *self = malloc (sizeof (OutBuf));
+    self->size = OUTBUF_FLUSH_SIZE + OUTBUF_FLUSH_SIZE / 4;
+    self->data = malloc (self->size);
+    self->length = 0;
+    thread_outbuf = self;
+    }
+  return thread_outbuf;
+  }
+
+
+/*============================================================================
+outbuf_append
+============================================================================*/
+void outbuf_append (OutBuf *self, const char *s, size_t length)
+  {
+  if (self->length + length > self->size)
+    {
+    while (self->length + length > self->size) self->size *= 2;
+    self->data = realloc (self->data, self->size);
+    }
+  memcpy (self->data + self->length, s, length);
+  self->length += length;
+  }
+
+
+/*============================================================================
+outbuf_puts
+============================================================================*/
+void outbuf_puts (OutBuf *self, const char *s)
+  {
+  outbuf_append (self, s, strlen (s));
+  }
+
+
+/*============================================================================
+outbuf_printf
+============================================================================*/
+void outbuf_printf (OutBuf *self, const char *fmt, ...)
+  {
+  va_list ap;
+  va_start (ap, fmt);
+  char *s = NULL;
+  int n = vasprintf (&s, fmt, ap);
+  va_end (ap);
+  // On failure, s is undefined; an empty result is still allocated
+  if (n < 0) return;
+  if (n > 0) outbuf_append (self, s, n);
+  free (s);
+  }
+
+
+/*============================================================================
+utf8_length
+Return the length of the well-formed UTF-8 sequence at s, or 0 if
+there isn't one
+============================================================================*/
+static int utf8_length (const unsigned char *s)
+  {
+  int n;
+  if (s[0] < 0x80) return 1;
+  else if (s[0] >= 0xC2 && s[0] <= 0xDF) n = 2;
+  else if (s[0] >= 0xE0 && s[0] <= 0xEF) n = 3;
+  else if (s[0] >= 0xF0 && s[0] <= 0xF4) n = 4;
+  else return 0;
+  int i;
+  for (i = 1; i < n; i++)
+    if ((s[i] & 0xC0) != 0x80) return 0;
+  return n;
+  }
+
+
+/*============================================================================
+outbuf_json_string
+Write s as a quoted JSON string. Bytes that are not valid UTF-8 -- 
+RTF metadata is often in a legacy 8-bit encoding -- are taken to be 
+Latin-1, so the output is always valid JSON
+============================================================================*/
+void outbuf_json_string (OutBuf *self, const char *s)
+  {
+  static const char hex[] = "0123456789abcdef";
+  const unsigned char *p = (const unsigned char *)s;
+  const unsigned char *run = p;
+
+  outbuf_append (self, "\"", 1);
+  while (*p)
+    {
+    int n = utf8_length (p);
+    if (n > 1 || (n == 1 && *p >= 0x20 && *p != '"' && *p != '\\'))
+      {
+      p += n;
+      continue;
+      }
+
+    outbuf_append (self, (const char *)run, p - run);
+    char esc[7] = "\\u00";
+    switch (*p)
+      {
+      case '"':  outbuf_append (self, "\\\"", 2); break;
+      case '\\': outbuf_append (self, "\\\\", 2); break;
+      case '\n': outbuf_append (self, "\\n", 2); break;
+      case '\r': outbuf_append (self, "\\r", 2); break;
+      case '\t': outbuf_append (self, "\\t", 2); break;
+      case '\b': outbuf_append (self, "\\b", 2); break;
+      case '\f': outbuf_append (self, "\\f", 2); break;
+      default:
+        esc[4] = hex[*p >> 4];
+        esc[5] = hex[*p & 15];
+        outbuf_append (self, esc, 6);
+      }
+    p++;
+    run = p;
+    }
+  outbuf_append (self, (const char *)run, p - run);
+  outbuf_append (self, "\"", 1);
+  }
+
+
+/*============================================================================
+outbuf_flush
+============================================================================*/
+void outbuf_flush (OutBuf *self)
+  {
+  pthread_mutex_lock (&flush_mutex);
+  const char *p = self->data;
+  size_t n = self->length;
+  if (array_first && n >= 2 && p[0] == ',')
+    {
+    p += 2; n -= 2;
+    array_first = FALSE;
+    }
+  while (n > 0)
+    {
+    ssize_t w = write (out_fd, p, n);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) break;
+    p += w;
+    n -= w;
+    }
+  pthread_mutex_unlock (&flush_mutex);
+  self->length = 0;
+  }
+
+
+/*============================================================================
+outbuf_release
+============================================================================*/
+void outbuf_release (void)
+  {
+  OutBuf *self = thread_outbuf;
+  if (!self) return;
+  outbuf_flush (self);
+  free (self->data);
+  free (self);
+  thread_outbuf = NULL;
+  }
+
+
+/*============================================================================
+outbuf_end_record
+Mark the end of a complete record. The buffer is flushed only here,
+and only when enough has built up
+============================================================================*/
+void outbuf_end_record (OutBuf *self)
+  {
+  if (self->length >= OUTBUF_FLUSH_SIZE) outbuf_flush (self);
+  }
+
+
+/*============================================================================
+outbuf_mark, outbuf_since, outbuf_rewind
+============================================================================*/
+size_t outbuf_mark (const OutBuf *self)
+  {
+  return self->length;
+  }
+
+const char *outbuf_since (const OutBuf *self, size_t mark, size_t *length)
+  {
+  *length = self->length - mark;
+  return self->data + mark;
+  }
+
+void outbuf_rewind (OutBuf *self, size_t mark)
+  {
+  self->length = mark;
+  }
+
+
+/*============================================================================
+outbuf_array_begin, outbuf_array_item, outbuf_array_end
+A JSON array whose items may come from any thread. Each item starts
+with a separator, except the first to be written out
+============================================================================*/
+void outbuf_array_begin (OutBuf *self)
+  {
+  outbuf_puts (self, "[\n");
+  outbuf_flush (self);
+  array_first = TRUE;
+  }
+
+void outbuf_array_item (OutBuf *self)
+  {
+  outbuf_puts (self, ",\n");
+  }
+
+void outbuf_array_end (OutBuf *self)
+  {
+  outbuf_puts (self, "\n]\n");
+  }
+
+
@@ -0,0 +1,50 @@
+/*============================================================================
+ * ebookinfo
+ * outbuf.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <ebookinfo/constants.h>
+
+/*============================================================================
+An OutBuf collects output records in memory, and writes them to a file
+descriptor in large blocks. Each thread has its own, so formatting 
+output takes no locks; flushing is serialized, and only ever writes
+complete records, so output from different threads never interleaves
+within a record.
+============================================================================*/
+struct _OutBuf;
+typedef struct _OutBuf OutBuf;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+void    outbuf_init (int fd);
+OutBuf *outbuf_get (void);
+void    outbuf_append (OutBuf *self, const char *s, size_t length);
+void    outbuf_puts (OutBuf *self, const char *s);
+void    outbuf_printf (OutBuf *self, const char *fmt, ...)
+          __attribute__ ((format (printf, 2, 3)));
+void    outbuf_json_string (OutBuf *self, const char *s);
+void    outbuf_end_record (OutBuf *self);
+// For taking back what was written since a mark, as a record to be
+//  sorted. No record must have been ended in between
+size_t  outbuf_mark (const OutBuf *self);
+const char *outbuf_since (const OutBuf *self, size_t mark, size_t *length);
+void    outbuf_rewind (OutBuf *self, size_t mark);
+void    outbuf_flush (OutBuf *self);
+// Flush and free the calling thread's buffer, as a thread ends
+void    outbuf_release (void);
+void    outbuf_array_begin (OutBuf *self);
+void    outbuf_array_item (OutBuf *self);
+void    outbuf_array_end (OutBuf *self);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
+
@@ -0,0 +1,105 @@
+/*============================================================================
+ * ebookinfo
+ * pathqueue.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#include <stdlib.h>
+#include <pthread.h>
+#include <ebookinfo/constants.h>
+#include "pathqueue.h"
+
+// A ring of capacity slots, of which count, from head, are in use
+struct _PathQueue
+  {
+  pthread_mutex_t lock;
+  pthread_cond_t not_full;
+  pthread_cond_t not_empty;
+  char **paths;
+  int capacity;
+  int head;
+  int count;
+  BOOL closed;
+  };
+
+
+/*============================================================================
+pathqueue_create
+============================================================================*/
+PathQueue *pathqueue_create (int capacity)
+  {
+  PathQueue *self = calloc (1, sizeof (PathQueue));
+  pthread_mutex_init (&self->lock, NULL);
+  pthread_cond_init (&self->not_full, NULL);
+  pthread_cond_init (&self->not_empty, NULL);
+  self->capacity = capacity > 0 ? capacity : 1;
+  self->paths = malloc (self->capacity * sizeof (char *));
+  return self;
+  }
+
+
+/*============================================================================
+pathqueue_destroy
+============================================================================*/
+void pathqueue_destroy (PathQueue *self)
+  {
+  while (self->count)
+    {
+    free (self->paths[self->head]);
+    self->head = (self->head + 1) % self->capacity;
+    self->count--;
+    }
+  free (self->paths);
+  pthread_cond_destroy (&self->not_empty);
+  pthread_cond_destroy (&self->not_full);
+  pthread_mutex_destroy (&self->lock);
+  free (self);
+  }
+
+
+/*============================================================================
+pathqueue_push
+============================================================================*/
+void pathqueue_push (PathQueue *self, char *path)
+  {
+  pthread_mutex_lock (&self->lock);
+  while (self->count == self->capacity)
+    pthread_cond_wait (&self->not_full, &self->lock);
+  self->paths[(self->head + self->count) % self->capacity] = path;
+  self->count++;
+  pthread_cond_signal (&self->not_empty);
+  pthread_mutex_unlock (&self->lock);
+  }
+
+
+/*============================================================================
+pathqueue_close
+============================================================================*/
+void pathqueue_close (PathQueue *self)
+  {
+  pthread_mutex_lock (&self->lock);
+  self->closed = TRUE;
+  pthread_cond_broadcast (&self->not_empty);
+  pthread_mutex_unlock (&self->lock);
+  }
+
+
+/*============================================================================
+pathqueue_pop
+============================================================================*/
+char *pathqueue_pop (PathQueue *self)
+  {
+  char *path = NULL;
+  pthread_mutex_lock (&self->lock);
+  while (self->count == 0 && !self->closed)
+    pthread_cond_wait (&self->not_empty, &self->lock);
+  if (self->count)
+    {
+    path = self->paths[self->head];
+    self->head = (self->head + 1) % self->capacity;
+    self->count--;
+    pthread_cond_signal (&self->not_full);
+    }
+  pthread_mutex_unlock (&self->lock);
+  return path;
+  }
+
@@ -0,0 +1,37 @@
+/*============================================================================
+ * ebookinfo
+ * pathqueue.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+/*============================================================================
+A PathQueue passes filenames from the thread that finds them to the
+threads that read the books. It holds a fixed number at most: pushing
+waits while it is full, so however long the list of files, memory
+stays flat, and the finding never runs far ahead of the reading.
+Popping waits while it is empty, until the queue is closed
+============================================================================*/
+
+struct _PathQueue;
+typedef struct _PathQueue PathQueue;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+PathQueue *pathqueue_create (int capacity);
+void       pathqueue_destroy (PathQueue *self);
+// Takes charge of path, which must be malloc()'d
+void       pathqueue_push (PathQueue *self, char *path);
+// No more paths will be pushed
+void       pathqueue_close (PathQueue *self);
+// The next path, for the caller to free(); or NULL, once the queue is
+//  closed and empty
+char      *pathqueue_pop (PathQueue *self);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
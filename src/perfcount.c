@@ -0,0 +1,259 @@
+/*============================================================================
+ * ebookinfo
+ * perfcount.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <ebookinfo/ebookinfo.h>
+#include "perfcount.h"
+
+typedef struct _Totals
+  {
+  unsigned long long calls;
+  unsigned long long values[PERFCOUNT_N];
+  unsigned long long multiplexed; // Calls whose counts were scaled
+  unsigned long long missed;      // Calls not counted at all
+  } Totals;
+
+// What a read of the group leader returns, with PERF_FORMAT_GROUP and
+//  both times: the values are in the order the counters joined
+typedef struct _GroupRead
+  {
+  unsigned long long nr;
+  unsigned long long time_enabled;
+  unsigned long long time_running;
+  unsigned long long values[PERFCOUNT_N];
+  } GroupRead;
+
+static const unsigned long long configs[PERFCOUNT_N] =
+  {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES
+  };
+
+static const char *names[PERFCOUNT_N] =
+  { "cycles", "instrs", "cache-miss", "br-miss" };
+
+static BOOL enabled;
+static BOOL available[PERFCOUNT_N];
+static pthread_mutex_t totals_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Totals totals[EBOOK_STATS_FORMATS];
+
+// Counters are opened per thread, since a counter opened with pid 0
+//  follows only the thread that opened it. They are opened as one
+//  group, so that the kernel schedules them onto the PMU together:
+//  either all count, or none do, and the ratios between them hold
+//  even when other users of the PMU force multiplexing. leader is -1
+//  if no counter could be opened; members[] gives the counter at each
+//  position in the group
+static __thread int leader = -1;
+static __thread int members[PERFCOUNT_N];
+static __thread int n_members;
+static __thread BOOL thread_ready;
+
+
+/*============================================================================
+open_counter
+============================================================================*/
+static int open_counter (unsigned long long config, int group)
+  {
+  struct perf_event_attr attr;
+  memset (&attr, 0, sizeof (attr));
+  attr.size = sizeof (attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED 
+    | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall (SYS_perf_event_open, &attr, 0, -1, group, 
+    PERF_FLAG_FD_CLOEXEC);
+  }
+
+
+/*============================================================================
+open_thread
+Open, as one group, each counter in wanted[] that can be. The first
+to open leads the group. A counter is refused if the group would then
+no longer fit on the PMU, so the group only ever holds counters that
+can run together. The descriptors of members other than the leader
+are never used again, but must stay open; they close with the process
+============================================================================*/
+static void open_thread (const BOOL *wanted, int *last_errno)
+  {
+  int i;
+  leader = -1;
+  n_members = 0;
+  for (i = 0; i < PERFCOUNT_N; i++)
+    {
+    if (!wanted[i]) continue;
+    int fd = open_counter (configs[i], leader);
+    if (fd < 0)
+      {
+      if (last_errno) *last_errno = errno;
+      continue;
+      }
+    if (leader < 0) leader = fd;
+    members[n_members++] = i;
+    }
+  thread_ready = TRUE;
+  }
+
+
+/*============================================================================
+read_group
+Read all the counters at once, into a sample indexed by counter
+============================================================================*/
+static void read_group (PerfSample *sample)
+  {
+  GroupRead g;
+  int i;
+  memset (sample, 0, sizeof (PerfSample));
+  if (leader < 0 || read (leader, &g, sizeof (g)) < 0) return;
+  for (i = 0; i < n_members && i < g.nr; i++)
+    sample->values[members[i]] = g.values[i];
+  sample->time_enabled = g.time_enabled;
+  sample->time_running = g.time_running;
+  }
+
+
+/*============================================================================
+perfcount_init
+============================================================================*/
+BOOL perfcount_init (char **error)
+  {
+  int i, last_errno = 0;
+  BOOL all[PERFCOUNT_N];
+  for (i = 0; i < PERFCOUNT_N; i++) all[i] = TRUE;
+  open_thread (all, &last_errno);
+  for (i = 0; i < n_members; i++)
+    available[members[i]] = TRUE;
+
+  if (leader < 0)
+    {
+    asprintf (error, "Performance counters are not available: %s",
+      strerror (last_errno));
+    return FALSE;
+    }
+  enabled = TRUE;
+  return TRUE;
+  }
+
+
+/*============================================================================
+perfcount_start
+============================================================================*/
+void perfcount_start (PerfSample *sample)
+  {
+  if (!enabled) return;
+  if (!thread_ready) open_thread (available, NULL);
+  read_group (sample);
+  }
+
+
+/*============================================================================
+perfcount_stop
+Add the counts since start to the totals for a format. If the group
+was on the PMU for only part of the time, the counts are scaled up by
+the time it was enabled over the time it ran, as perf stat does
+============================================================================*/
+void perfcount_stop (const PerfSample *start, int type)
+  {
+  if (!enabled) return;
+  PerfSample end;
+  int i;
+  read_group (&end);
+  unsigned long long enabled_time = end.time_enabled - start->time_enabled;
+  unsigned long long running_time = end.time_running - start->time_running;
+
+  if (type < 0 || type >= EBOOK_STATS_UNKNOWN) type = EBOOK_STATS_UNKNOWN;
+  pthread_mutex_lock (&totals_mutex);
+  Totals *t = &totals[type];
+  t->calls++;
+  if (running_time == 0)
+    t->missed++;
+  else
+    {
+    double scale = 1.0;
+    if (running_time < enabled_time)
+      {
+      scale = (double)enabled_time / running_time;
+      t->multiplexed++;
+      }
+    for (i = 0; i < PERFCOUNT_N; i++)
+      t->values[i] += (end.values[i] - start->values[i]) * scale + 0.5;
+    }
+  pthread_mutex_unlock (&totals_mutex);
+  }
+
+
+/*============================================================================
+perfcount_report
+Totals per format, with instructions per cycle, and each miss count
+per thousand instructions so that formats of different sizes compare
+============================================================================*/
+void perfcount_report (FILE *f)
+  {
+  if (!enabled) return;
+  int i, c;
+  unsigned long long multiplexed = 0, missed = 0;
+  fprintf (f, "%-8s %7s", "format", "calls");
+  for (c = 0; c < PERFCOUNT_N; c++)
+    if (available[c]) fprintf (f, " %12s", names[c]);
+  fprintf (f, " %6s %9s %9s\n", "IPC", "cm/kinst", "bm/kinst");
+
+  for (i = 0; i < EBOOK_STATS_FORMATS; i++)
+    {
+    const Totals *t = &totals[i];
+    if (t->calls == 0) continue;
+    multiplexed += t->multiplexed;
+    missed += t->missed;
+    fprintf (f, "%-8s %7llu",
+      i == EBOOK_STATS_UNKNOWN ? "unknown" : ebook_type_name (i), t->calls);
+    for (c = 0; c < PERFCOUNT_N; c++)
+      if (available[c]) fprintf (f, " %12llu", t->values[c]);
+
+    unsigned long long cycles = t->values[PERFCOUNT_CYCLES];
+    unsigned long long instrs = t->values[PERFCOUNT_INSTRUCTIONS];
+    if (available[PERFCOUNT_CYCLES] && available[PERFCOUNT_INSTRUCTIONS]
+        && cycles)
+      fprintf (f, " %6.2f", (double)instrs / cycles);
+    else
+      fprintf (f, " %6s", "-");
+    if (available[PERFCOUNT_INSTRUCTIONS] && instrs)
+      {
+      if (available[PERFCOUNT_CACHE_MISSES])
+        fprintf (f, " %9.2f", 1000.0 * t->values[PERFCOUNT_CACHE_MISSES] 
+          / instrs);
+      else
+        fprintf (f, " %9s", "-");
+      if (available[PERFCOUNT_BRANCH_MISSES])
+        fprintf (f, " %9.2f", 1000.0 * t->values[PERFCOUNT_BRANCH_MISSES] 
+          / instrs);
+      else
+        fprintf (f, " %9s", "-");
+      }
+    else
+      fprintf (f, " %9s %9s", "-", "-");
+    fprintf (f, "\n");
+    }
+
+  if (multiplexed)
+    fprintf (f, "Counters were multiplexed in %llu calls; their counts "
+      "are scaled estimates\n", multiplexed);
+  if (missed)
+    fprintf (f, "Counters never ran in %llu calls, which are not "
+      "counted\n", missed);
+  }
+
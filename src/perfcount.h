@@ -0,0 +1,50 @@
+/*============================================================================
+ * ebookinfo
+ * perfcount.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stdio.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/stats.h>
+
+/*============================================================================
+Hardware performance counters, read with perf_event_open() around
+each call into a format handler, and added up per format. Counters
+are opened per thread, in user space only, so that the default
+perf_event_paranoid setting allows them, and as one group, whose
+counts are scaled up for any time it was multiplexed off the PMU. Any
+counter that cannot be opened -- no PMU in a virtual machine, a kernel
+without perf support, a seccomp filter -- is simply left out of the
+report
+============================================================================*/
+
+#define PERFCOUNT_CYCLES       0
+#define PERFCOUNT_INSTRUCTIONS 1
+#define PERFCOUNT_CACHE_MISSES 2
+#define PERFCOUNT_BRANCH_MISSES 3
+#define PERFCOUNT_N            4
+
+typedef struct _PerfSample
+  {
+  unsigned long long values[PERFCOUNT_N];
+  unsigned long long time_enabled;
+  unsigned long long time_running;
+  } PerfSample;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+// Returns FALSE, with an error, if no counter at all can be opened
+BOOL    perfcount_init (char **error);
+void    perfcount_start (PerfSample *sample);
+void    perfcount_stop (const PerfSample *start, int type);
+void    perfcount_report (FILE *f);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
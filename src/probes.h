@@ -0,0 +1,53 @@
+/*============================================================================
+ * libebookinfo
+ * probes.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+/*============================================================================
+USDT static probes, for attaching bpftrace or SystemTap to a running
+process, in the "ebookinfo" provider. Each probe compiles to a single
+nop, plus a note in the ELF file that tells the tracer where it is and
+where its arguments live; nothing is evaluated unless a tracer is
+attached. They are built in only when the Makefile finds systemtap's
+<sys/sdt.h>; without it, they compile to nothing.
+
+  open__start      path (NULL for fd and memory opens)
+  open__done       path, format, bytes, book (NULL on failure)
+  recognize        path, format, bytes examined
+  entry__read      entry name, bytes, TRUE on success
+  xml__parse__start  name, bytes
+  xml__parse__done   name, TRUE on success
+  metadata__done   format, metadata (NULL on failure)
+
+Formats are EBOOK_TYPE_XXX values, with EBOOK_TYPE_UNKNOWN for files
+that were not recognized. For example:
+
+  bpftrace -e 'usdt:./libebookinfo.so.*:ebookinfo:open__done
+    { printf ("%s %d\n", str (arg0), arg2); }'
+============================================================================*/
+
+#ifdef HAVE_SDT
+
+#include <sys/sdt.h>
+
+#define EBI_PROBE1(name, a) \
+  DTRACE_PROBE1 (ebookinfo, name, a)
+#define EBI_PROBE2(name, a, b) \
+  DTRACE_PROBE2 (ebookinfo, name, a, b)
+#define EBI_PROBE3(name, a, b, c) \
+  DTRACE_PROBE3 (ebookinfo, name, a, b, c)
+#define EBI_PROBE4(name, a, b, c, d) \
+  DTRACE_PROBE4 (ebookinfo, name, a, b, c, d)
+
+#else
+
+#define EBI_PROBE1(name, a) do {} while (0)
+#define EBI_PROBE2(name, a, b) do {} while (0)
+#define EBI_PROBE3(name, a, b, c) do {} while (0)
+#define EBI_PROBE4(name, a, b, c, d) do {} while (0)
+
+#endif
+
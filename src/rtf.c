@@ -10,20 +10,28 @@
 #include <unistd.h>
 #include <malloc.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <pcre.h>
 #include <ebookinfo/ebook.h>
 #include <ebookinfo/constants.h>
-#include "epub.h" 
+#include "rtf.h" 
+#include "alloc.h"
+#include "metadata.h"
 
 
 typedef struct _RTF
   {
-  char *filename;
+  const unsigned char *data;
+  size_t length;
   EBookMetadata *cached_metadata;
+  unsigned int cached_fields;
   } RTF;
 
 
+// Compiled once, on first use, and kept for the life of the process;
+//  pcre_exec() can share them between threads
 static pcre *re_title, *re_author, *re_genre, *re_year, *re_comment;
+static pthread_once_t re_once = PTHREAD_ONCE_INIT;
 
 
 /*============================================================================
@@ -46,68 +54,23 @@ static void init_re (void)
     &pcreErrorStr, &pcreErrorOffset, NULL);
   }
 
-/*============================================================================
-init_re
-============================================================================*/
-static void cleanup_re (void)
-  {
-  if (re_title)
-    pcre_free (re_title);
-  if (re_author)
-    pcre_free (re_author);
-  if (re_genre)
-    pcre_free (re_genre);
-  if (re_year)
-    pcre_free (re_year);
-  if (re_comment)
-    pcre_free (re_comment);
-  }
-
-
-/*============================================================================
-rtf_recognize
-============================================================================*/
-BOOL rtf_recognize (const char *filename)
-  {
-  BOOL ret = FALSE;
-  int f = open (filename, O_RDONLY);
-  if (f)
-    {
-    unsigned char buff[20];
-    int n;
-    n = read (f, buff, sizeof (buff));
-    if (n == sizeof (buff))
-      {
-      if (strncmp ((const char *)buff, "{\\rtf", 5) == 0)
-        {
-        ret = TRUE;
-        }
-      }
-    close (f);
-    }
-  return ret;
-  }
 
 
 /*============================================================================
 rtf_close
 ============================================================================*/
-void rtf_close (EBook *self)
+static void rtf_close (EBook *self)
   {
   if (self)
     {
     RTF *rtf = (RTF *) ebook_get_data (self);
     if (rtf)
       {
-      if (rtf->filename)
-        {
-        free (rtf->filename);
-        }
       if (rtf->cached_metadata)
         {
         ebookmetadata_destroy (rtf->cached_metadata);
         }
-      free (rtf);
+      ebi_free (rtf);
       }
     }
   }
@@ -116,13 +79,14 @@ void rtf_close (EBook *self)
 /*============================================================================
 rtf_open
 ============================================================================*/
-BOOL rtf_open (EBook *self, const char *filename, char **error)
+static BOOL rtf_open (EBook *self, const EBookSource *source, char **error)
   {
   BOOL ret = TRUE;
 
-  RTF *rtf = malloc (sizeof (RTF));
+  RTF *rtf = ebi_malloc (sizeof (RTF));
   memset (rtf, 0, sizeof (RTF));
-  rtf->filename = strdup (filename);
+  rtf->data = source->data;
+  rtf->length = source->length;
   ebook_set_data (self, rtf);
   
   return ret;
@@ -133,105 +97,72 @@ BOOL rtf_open (EBook *self, const char *filename, char **error)
 /*============================================================================
 rtf_get_metadata
 ============================================================================*/
-EBookMetadata *rtf_get_metadata (const EBook *ebook, char **error)
+static EBookMetadata *rtf_get_metadata (const EBook *ebook, 
+    unsigned int fields, char **error)
   {
   EBookMetadata *ret = NULL;
 
-  char *title = NULL, *author=NULL, *year=NULL, *genre=NULL, *comment=NULL;
-
   RTF *rtf = (RTF *) ebook_get_data (ebook);
 
-  if (rtf->cached_metadata) 
-    return ebookmetadata_clone (rtf->cached_metadata);
+  if (rtf->cached_metadata && (fields & ~rtf->cached_fields) == 0) 
+    return ebookmetadata_retain (rtf->cached_metadata);
 
-  init_re();
+  // Re-read the cached fields too, so that the cache only grows
+  if (rtf->cached_metadata) fields |= rtf->cached_fields;
 
-  const char *filename = rtf->filename;
-  int f = open (filename, O_RDONLY);
-  if (f)
-    {
-    BOOL ok = TRUE;
+  pthread_once (&re_once, init_re);
 
-    int len = 500000; // If it ain't in the first 50-k, tough
-    char *buff = malloc (len);
-    memset (buff, 0, len);
-    read (f, buff, len);
+  // The patterns are matched in place, against the source, and the
+  //  matches are packed straight from there
+  int len = 500000; // If it ain't in the first 50-k, tough
+  if (rtf->length < len) len = rtf->length;
+  const char *buff = (const char *)rtf->data;
 
-    int vec[10];
+  static pcre **const res[] = 
+    { &re_title, &re_author, &re_year, &re_genre, &re_comment };
+  static const int keys[] = { EBOOK_KEY_TITLE, EBOOK_KEY_CREATOR, 
+    EBOOK_KEY_DATE, EBOOK_KEY_SUBJECT, EBOOK_KEY_DESCRIPTION };
+  EBIMDBuilder builder;
+  ebi_mdbuilder_init (&builder, fields);
 
-    int count = pcre_exec (re_title, NULL, buff, len,  
-       0, 0, vec, 10);         
-    if (count == 2)
-     {
-     int m = vec[3] - vec[2] + 1;
-     title = malloc (m);
-     strncpy (title, buff + vec[2], vec[3] - vec[2]);
-     title[vec[3] - vec[2]]=0;
-     }
-
-    count = pcre_exec (re_author, NULL, buff, len,  
-       0, 0, vec, 10);         
-    if (count == 2)
-     {
-     int m = vec[3] - vec[2] + 1;
-     author = malloc (m);
-     strncpy (author, buff + vec[2], vec[3] - vec[2]);
-     author[vec[3] - vec[2]]=0;
-     }
-
-    count = pcre_exec (re_genre, NULL, buff, len,  
-       0, 0, vec, 10);         
-    if (count == 2)
-     {
-     int m = vec[3] - vec[2] + 1;
-     genre = malloc (m);
-     strncpy (genre, buff + vec[2], vec[3] - vec[2]);
-     genre[vec[3] - vec[2]]=0;
-     }
-
-    count = pcre_exec (re_year, NULL, buff, len,  
-       0, 0, vec, 10);         
-    if (count == 2)
-     {
-     int m = vec[3] - vec[2] + 1;
-     year = malloc (m);
-     strncpy (year, buff + vec[2], vec[3] - vec[2]);
-     year[vec[3] - vec[2]]=0;
-     }
-
-    count = pcre_exec (re_comment, NULL, buff, len,  
-       0, 0, vec, 10);         
+  int i;
+  for (i = 0; i < sizeof (keys) / sizeof (keys[0]); i++)
+    {
+    if (!ebi_mdbuilder_wants (&builder, keys[i])) continue;
+    int vec[10];
+    int count = pcre_exec (*res[i], NULL, buff, len, 0, 0, vec, 10);
     if (count == 2)
-     {
-     int m = vec[3] - vec[2] + 1;
-     comment = malloc (m);
-     strncpy (comment, buff + vec[2], vec[3] - vec[2]);
-     comment[vec[3] - vec[2]]=0;
-     }
-
-    if (ok)
-      {
-      ret = ebookmetadata_create (title, 
-        author, year, genre, comment); 
-
-      rtf->cached_metadata = ebookmetadata_clone (ret);
-      }
-
-
-    free (buff);
-    close (f);
+      ebi_mdbuilder_add (&builder, keys[i], buff + vec[2], vec[3] - vec[2],
+        NULL, 0);
     }
 
-  cleanup_re();
-  
-  if (title) free (title);
-  if (author) free (author);
-  if (year) free (year);
-  if (genre) free (genre);
-  if (comment) free (comment);
+  ret = ebi_mdbuilder_build (&builder);
+  ebookmetadata_destroy (rtf->cached_metadata);
+  rtf->cached_metadata = ebookmetadata_retain (ret);
+  rtf->cached_fields = fields;
 
   return ret;
   }
 
 
+/*============================================================================
+rtf_format
+============================================================================*/
+static const EBookMagic rtf_magics[] =
+  {
+  { 0, "{\\rtf", 5, EBOOK_CONFIDENCE_HIGH },
+  { 0, NULL, 0, 0 }
+  };
+
+const EBookFormat rtf_format =
+  {
+  EBOOK_TYPE_RTF,
+  "RTF",
+  rtf_magics,
+  NULL,
+  rtf_open,
+  rtf_get_metadata,
+  rtf_close
+  };
+
 
@@ -6,17 +6,13 @@
 
 #pragma once
 
-#include <ebookinfo/constants.h> 
-#include <ebookinfo/ebookinfo.h> 
+#include "format.h" 
 
 #ifdef __CPLUSPLUS
 extern "C" {
 #endif
 
-BOOL           rtf_recognize (const char *filename);
-BOOL           rtf_open (EBook *self, const char *filename, char **error);
-void           rtf_close (EBook *self);
-EBookMetadata *rtf_get_metadata (const EBook *ebook, char **error);
+extern const EBookFormat rtf_format;
 
 #ifdef __CPLUSPLUS
 }
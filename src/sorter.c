@@ -0,0 +1,376 @@
+/*============================================================================
+ * ebookinfo
+ * sorter.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "sorter.h"
+
+// The key length of a record that has no key
+#define NO_KEY ((size_t)-1)
+
+// The most runs merged at once. With more, the first are merged into
+//  one run first, which keeps the number of open files down
+#define MAX_FANIN 64
+
+/*============================================================================
+An entry holds a record's key, NUL-terminated, followed by its data.
+seq is the order of adding, for the in-memory sort to be stable; runs
+are merged in the order they were written, so need no seq
+============================================================================*/
+typedef struct _Entry
+  {
+  size_t key_length;
+  size_t length;
+  size_t seq;
+  char bytes[];
+  } Entry;
+
+typedef struct _Run
+  {
+  FILE *f;
+  Entry *current;
+  } Run;
+
+struct _Sorter
+  {
+  size_t memory;
+  size_t used;
+  Entry **entries;
+  size_t n;
+  size_t size;
+  size_t seq;
+  FILE **runs;
+  int n_runs;
+  };
+
+typedef void (*EntryOut) (const Entry *entry, void *user);
+
+
+/*============================================================================
+sorter_create
+memory is the most, in bytes, that records take before they are
+written out to a run
+============================================================================*/
+Sorter *sorter_create (size_t memory)
+  {
+  Sorter *self = calloc (1, sizeof (Sorter));
+  self->memory = memory;
+  return self;
+  }
+
+
+/*============================================================================
+sorter_destroy
+============================================================================*/
+void sorter_destroy (Sorter *self)
+  {
+  size_t i;
+  for (i = 0; i < self->n; i++) free (self->entries[i]);
+  free (self->entries);
+  int r;
+  for (r = 0; r < self->n_runs; r++) fclose (self->runs[r]);
+  free (self->runs);
+  free (self);
+  }
+
+
+/*============================================================================
+entry_data
+============================================================================*/
+static const char *entry_data (const Entry *e)
+  {
+  return e->key_length == NO_KEY ? e->bytes : e->bytes + e->key_length + 1;
+  }
+
+
+/*============================================================================
+compare_entries
+By key alone; records with no key come last
+============================================================================*/
+static int compare_entries (const Entry *a, const Entry *b)
+  {
+  BOOL a_none = a->key_length == NO_KEY, b_none = b->key_length == NO_KEY;
+  if (a_none || b_none) return a_none - b_none;
+  return strcmp (a->bytes, b->bytes);
+  }
+
+
+/*============================================================================
+compare_seq
+For qsort(): by key, and then in the order added
+============================================================================*/
+static int compare_seq (const void *a, const void *b)
+  {
+  const Entry *ea = *(const Entry **)a, *eb = *(const Entry **)b;
+  int c = compare_entries (ea, eb);
+  if (c) return c;
+  return ea->seq < eb->seq ? -1 : ea->seq > eb->seq;
+  }
+
+
+/*============================================================================
+temp_file
+An anonymous temporary file: it is deleted as soon as it is made, and
+is gone once closed
+============================================================================*/
+static FILE *temp_file (char **error)
+  {
+  const char *dir = getenv ("TMPDIR");
+  if (!dir || !*dir) dir = "/tmp";
+  char *path;
+  asprintf (&path, "%s/ebookinfo-sort-XXXXXX", dir);
+  int fd = mkstemp (path);
+  if (fd < 0)
+    {
+    asprintf (error, "Can't create temporary file in %s: %s", dir,
+      strerror (errno));
+    free (path);
+    return NULL;
+    }
+  unlink (path);
+  free (path);
+  return fdopen (fd, "w+");
+  }
+
+
+/*============================================================================
+write_entry
+============================================================================*/
+static void write_entry (const Entry *e, void *user)
+  {
+  FILE *f = user;
+  fwrite (&e->key_length, sizeof (size_t), 1, f);
+  fwrite (&e->length, sizeof (size_t), 1, f);
+  if (e->key_length != NO_KEY) fwrite (e->bytes, 1, e->key_length + 1, f);
+  fwrite (entry_data (e), 1, e->length, f);
+  }
+
+
+/*============================================================================
+read_entry
+The next entry of a run, or NULL at its end
+============================================================================*/
+static Entry *read_entry (FILE *f)
+  {
+  size_t header[2];
+  if (fread (header, sizeof (size_t), 2, f) != 2) return NULL;
+  size_t key = header[0] == NO_KEY ? 0 : header[0] + 1;
+  Entry *e = malloc (sizeof (Entry) + key + header[1]);
+  e->key_length = header[0];
+  e->length = header[1];
+  e->seq = 0;
+  if (fread (e->bytes, 1, key + header[1], f) != key + header[1])
+    {
+    free (e);
+    return NULL;
+    }
+  return e;
+  }
+
+
+/*============================================================================
+finish_file
+Check that a run was written in full, and make it ready to read
+============================================================================*/
+static BOOL finish_file (FILE *f, char **error)
+  {
+  if (fflush (f) != 0 || ferror (f))
+    {
+    asprintf (error, "Can't write temporary file: %s", strerror (errno));
+    return FALSE;
+    }
+  rewind (f);
+  return TRUE;
+  }
+
+
+/*============================================================================
+spill
+Sort what is in memory, and write it out as a run
+============================================================================*/
+static BOOL spill (Sorter *self, char **error)
+  {
+  FILE *f = temp_file (error);
+  if (!f) return FALSE;
+  qsort (self->entries, self->n, sizeof (Entry *), compare_seq);
+  size_t i;
+  for (i = 0; i < self->n; i++)
+    {
+    write_entry (self->entries[i], f);
+    free (self->entries[i]);
+    }
+  self->n = 0;
+  self->used = 0;
+  if (!finish_file (f, error))
+    {
+    fclose (f);
+    return FALSE;
+    }
+  self->runs = realloc (self->runs, (self->n_runs + 1) * sizeof (FILE *));
+  self->runs[self->n_runs++] = f;
+  return TRUE;
+  }
+
+
+/*============================================================================
+sorter_add
+============================================================================*/
+BOOL sorter_add (Sorter *self, const char *key, const char *data,
+       size_t length, char **error)
+  {
+  size_t key_length = key ? strlen (key) : NO_KEY;
+  size_t bytes = (key ? key_length + 1 : 0) + length;
+  size_t cost = sizeof (Entry) + bytes + sizeof (Entry *);
+  if (self->n && self->used + cost > self->memory)
+    {
+    if (!spill (self, error)) return FALSE;
+    }
+
+  Entry *e = malloc (sizeof (Entry) + bytes);
+  e->key_length = key_length;
+  e->length = length;
+  e->seq = self->seq++;
+  if (key) memcpy (e->bytes, key, key_length + 1);
+  memcpy ((char *)entry_data (e), data, length);
+  if (self->n == self->size)
+    {
+    self->size = self->size ? self->size * 2 : 1024;
+    self->entries = realloc (self->entries, self->size * sizeof (Entry *));
+    }
+  self->entries[self->n++] = e;
+  self->used += cost;
+  return TRUE;
+  }
+
+
+/*============================================================================
+run_before
+Whether run i's entry comes before run j's. Earlier runs win ties,
+which keeps the merge stable
+============================================================================*/
+static BOOL run_before (const Run *runs, int i, int j)
+  {
+  int c = compare_entries (runs[i].current, runs[j].current);
+  return c < 0 || (c == 0 && i < j);
+  }
+
+
+/*============================================================================
+merge
+Merge n runs, passing each entry to out in order, and close them. A
+heap holds the runs that have entries left, the next entry at the top
+============================================================================*/
+static BOOL merge (FILE **files, int n, EntryOut out, void *user,
+       char **error)
+  {
+  Run runs[n];
+  int heap[n], n_heap = 0, i;
+  for (i = 0; i < n; i++)
+    {
+    runs[i].f = files[i];
+    runs[i].current = read_entry (files[i]);
+    if (!runs[i].current) continue;
+    // Sift up
+    int c = n_heap++;
+    heap[c] = i;
+    while (c > 0 && run_before (runs, heap[c], heap[(c - 1) / 2]))
+      {
+      int t = heap[c]; heap[c] = heap[(c - 1) / 2]; heap[(c - 1) / 2] = t;
+      c = (c - 1) / 2;
+      }
+    }
+
+  while (n_heap > 0)
+    {
+    Run *run = &runs[heap[0]];
+    out (run->current, user);
+    free (run->current);
+    run->current = read_entry (run->f);
+    if (!run->current) heap[0] = heap[--n_heap];
+    // Sift down
+    int c = 0;
+    while (TRUE)
+      {
+      int l = 2 * c + 1, r = l + 1, m = c;
+      if (l < n_heap && run_before (runs, heap[l], heap[m])) m = l;
+      if (r < n_heap && run_before (runs, heap[r], heap[m])) m = r;
+      if (m == c) break;
+      int t = heap[c]; heap[c] = heap[m]; heap[m] = t;
+      c = m;
+      }
+    }
+
+  BOOL ret = TRUE;
+  for (i = 0; i < n; i++)
+    {
+    if (ferror (runs[i].f) || !feof (runs[i].f)) ret = FALSE;
+    fclose (runs[i].f);
+    }
+  if (!ret) asprintf (error, "Can't read temporary file");
+  return ret;
+  }
+
+
+/*============================================================================
+emit_entry
+============================================================================*/
+typedef struct _EmitTo
+  {
+  SorterEmit emit;
+  void *user;
+  } EmitTo;
+
+static void emit_entry (const Entry *e, void *user)
+  {
+  EmitTo *to = user;
+  to->emit (entry_data (e), e->length, to->user);
+  }
+
+
+/*============================================================================
+sorter_finish
+With no runs, everything is sorted in memory. Otherwise what is left
+in memory becomes a run too, and the runs are merged -- MAX_FANIN at
+a time, to start with, if there are too many for one merge
+============================================================================*/
+BOOL sorter_finish (Sorter *self, SorterEmit emit, void *user, char **error)
+  {
+  EmitTo to = { emit, user };
+  size_t i;
+  if (self->n_runs == 0)
+    {
+    qsort (self->entries, self->n, sizeof (Entry *), compare_seq);
+    for (i = 0; i < self->n; i++)
+      {
+      emit_entry (self->entries[i], &to);
+      free (self->entries[i]);
+      }
+    self->n = 0;
+    self->used = 0;
+    return TRUE;
+    }
+
+  if (self->n && !spill (self, error)) return FALSE;
+  while (self->n_runs > MAX_FANIN)
+    {
+    FILE *f = temp_file (error);
+    if (!f) return FALSE;
+    BOOL ok = merge (self->runs, MAX_FANIN, write_entry, f, error);
+    // The merged runs are closed either way
+    memmove (self->runs + 1, self->runs + MAX_FANIN,
+      (self->n_runs - MAX_FANIN) * sizeof (FILE *));
+    self->n_runs -= MAX_FANIN - 1;
+    self->runs[0] = f;
+    if (!ok || !finish_file (f, error)) return FALSE;
+    }
+  BOOL ret = merge (self->runs, self->n_runs, emit_entry, &to, error);
+  self->n_runs = 0;
+  return ret;
+  }
+
@@ -0,0 +1,42 @@
+/*============================================================================
+ * ebookinfo
+ * sorter.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <ebookinfo/constants.h>
+
+/*============================================================================
+A Sorter takes output records, each with a sort key, and gives them
+back in order of key, as strcmp() orders them. Records with no key
+come last, and records with the same key come in the order they were
+added. Records are held in memory up to a limit; beyond that, each
+memory-full is sorted and written to a temporary file -- in $TMPDIR,
+or /tmp -- as a run, and the runs are merged at the end. A sorter is
+not safe to use from more than one thread at once
+============================================================================*/
+
+struct _Sorter;
+typedef struct _Sorter Sorter;
+
+typedef void (*SorterEmit) (const char *data, size_t length, void *user);
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+Sorter *sorter_create (size_t memory);
+void    sorter_destroy (Sorter *self);
+BOOL    sorter_add (Sorter *self, const char *key, const char *data,
+          size_t length, char **error);
+// Pass every record to emit, in order. The sorter is empty after this
+BOOL    sorter_finish (Sorter *self, SorterEmit emit, void *user,
+          char **error);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
@@ -0,0 +1,281 @@
+/*============================================================================
+ * libebookinfo
+ * sortkey.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <ebookinfo/constants.h>
+#include "sortkey.h"
+#include "alloc.h"
+
+// U+00C0 to U+017F, as lower-case ASCII; NULL for the two that are
+//  not letters
+static const char *latin[] =
+  {
+  "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i",
+  "i", "i", "d", "n", "o", "o", "o", "o", "o", NULL, "o", "u", "u", "u",
+  "u", "y", "th", "ss", "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e",
+  "e", "e", "i", "i", "i", "i", "d", "n", "o", "o", "o", "o", "o", NULL,
+  "o", "u", "u", "u", "u", "y", "th", "y", "a", "a", "a", "a", "a", "a",
+  "c", "c", "c", "c", "c", "c", "c", "c", "d", "d", "d", "d", "e", "e",
+  "e", "e", "e", "e", "e", "e", "e", "e", "g", "g", "g", "g", "g", "g",
+  "g", "g", "h", "h", "h", "h", "i", "i", "i", "i", "i", "i", "i", "i",
+  "i", "i", "ij", "ij", "j", "j", "k", "k", "k", "l", "l", "l", "l", "l",
+  "l", "l", "l", "l", "l", "n", "n", "n", "n", "n", "n", "n", "n", "n",
+  "o", "o", "o", "o", "o", "o", "oe", "oe", "r", "r", "r", "r", "r", "r",
+  "s", "s", "s", "s", "s", "s", "s", "s", "t", "t", "t", "t", "t", "t",
+  "u", "u", "u", "u", "u", "u", "u", "u", "u", "u", "u", "u", "w", "w",
+  "y", "y", "y", "z", "z", "z", "z", "z", "z", "s"
+  };
+
+// Leading articles, by language. The first entry of each list is the
+//  language's two- and three-letter codes
+static const char *articles[][12] =
+  {
+  { "en eng", "the", "a", "an", NULL },
+  { "fr fre fra", "le", "la", "les", "l", "un", "une", NULL },
+  { "de ger deu", "der", "die", "das", "ein", "eine", NULL },
+  { "es spa", "el", "la", "los", "las", "un", "una", NULL },
+  { "it ita", "il", "lo", "la", "i", "gli", "le", "l", "un", "una", "uno",
+    NULL },
+  { "nl dut nld", "de", "het", "een", NULL },
+  { "pt por", "o", "a", "os", "as", "um", "uma", NULL },
+  };
+#define N_LANGUAGES (sizeof (articles) / sizeof (articles[0]))
+
+typedef struct _Folder
+  {
+  char *out;
+  size_t length;
+  BOOL space;
+  } Folder;
+
+
+/*============================================================================
+emit
+Add characters to the key, after a space if one is pending
+============================================================================*/
+static void emit (Folder *f, const char *s, size_t n)
+  {
+  if (f->space && f->length && *s != ',') f->out[f->length++] = ' ';
+  f->space = FALSE;
+  memcpy (f->out + f->length, s, n);
+  f->length += n;
+  }
+
+
+/*============================================================================
+entity_length
+The length of the HTML entity at s, as "&amp;" or "&#233;", or 0
+============================================================================*/
+static size_t entity_length (const char *s, size_t length)
+  {
+  size_t i;
+  for (i = 1; i < length && i < 10; i++)
+    {
+    char c = s[i];
+    if (c == ';') return i > 1 ? i + 1 : 0;
+    if (!(c == '#' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')
+        || (c >= 'A' && c <= 'Z')))
+      return 0;
+    }
+  return 0;
+  }
+
+
+/*============================================================================
+fold
+Write the folded form of s to out, which must have room for twice its
+length, plus one. Returns the key's length
+============================================================================*/
+static size_t fold (const char *s, size_t length, char *out)
+  {
+  Folder f = { out, 0, FALSE };
+  const unsigned char *p = (const unsigned char *)s;
+  size_t i = 0;
+  while (i < length)
+    {
+    unsigned char c = p[i];
+    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+      {
+      emit (&f, (const char *)p + i, 1);
+      i++;
+      }
+    else if (c >= 'A' && c <= 'Z')
+      {
+      char lower = c - 'A' + 'a';
+      emit (&f, &lower, 1);
+      i++;
+      }
+    else if (c == ',')
+      {
+      if (f.length) emit (&f, ",", 1);
+      f.space = TRUE;
+      i++;
+      }
+    else if (c == '&' && entity_length (s + i, length - i))
+      {
+      f.space = TRUE;
+      i += entity_length (s + i, length - i);
+      }
+    else if (c < 0x80)
+      {
+      f.space = TRUE;
+      i++;
+      }
+    else
+      {
+      // A UTF-8 sequence: Latin letters are folded, Latin-1 and
+      //  general punctuation separate words, and anything else is
+      //  kept as it is. Broken sequences separate words too
+      size_t n = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+      size_t j;
+      for (j = 1; j < n && i + j < length; j++)
+        if ((p[i + j] & 0xc0) != 0x80) break;
+      if (n == 1 || j < n)
+        {
+        f.space = TRUE;
+        i += j;
+        continue;
+        }
+      unsigned int cp = c & (0xff >> (n + 1));
+      for (j = 1; j < n; j++) cp = (cp << 6) | (p[i + j] & 0x3f);
+      if (cp >= 0xc0 && cp < 0x180 && latin[cp - 0xc0])
+        emit (&f, latin[cp - 0xc0], strlen (latin[cp - 0xc0]));
+      else if (cp < 0xc0 || (cp >= 0x2000 && cp < 0x2070)
+          || (cp >= 0xc0 && cp < 0x180))
+        f.space = TRUE;
+      else
+        emit (&f, (const char *)p + i, n);
+      i += n;
+      }
+    }
+  while (f.length && out[f.length - 1] == ',') f.length--;
+  out[f.length] = 0;
+  return f.length;
+  }
+
+
+/*============================================================================
+is_suffix
+============================================================================*/
+static BOOL is_suffix (const char *word, size_t length)
+  {
+  static const char *suffixes[] = { "jr", "sr", "ii", "iii", "iv", NULL };
+  int i;
+  for (i = 0; suffixes[i]; i++)
+    if (strlen (suffixes[i]) == length
+        && memcmp (suffixes[i], word, length) == 0)
+      return TRUE;
+  return FALSE;
+  }
+
+
+/*============================================================================
+ebi_sortkey_author
+The last word is the surname, unless it is a suffix like "Jr", which
+is kept at the end
+============================================================================*/
+char *ebi_sortkey_author (const char *author, size_t length)
+  {
+  if (!author) return NULL;
+  length = strnlen (author, length);
+  char *key = ebi_malloc (2 * length + 1);
+  size_t n = fold (author, length, key);
+  if (memchr (author, ',', length)) return key;
+
+  // Where the words start, ignoring any suffixes
+  char *last = NULL, *suffix = NULL, *w;
+  for (w = key; w; w = strchr (w, ' '))
+    {
+    if (*w == ' ') w++;
+    char *end = strchr (w, ' ');
+    size_t wl = end ? (size_t)(end - w) : strlen (w);
+    if (last && is_suffix (w, wl))
+      {
+      if (!suffix) suffix = w;
+      }
+    else
+      {
+      last = w;
+      suffix = NULL;
+      }
+    }
+  if (last == key) return key;
+
+  // "first middle last jr" -> "last, first middle jr"
+  char *ret = ebi_malloc (n + 3);
+  size_t last_length = (suffix ? suffix - 1 : key + n) - last;
+  memcpy (ret, last, last_length);
+  memcpy (ret + last_length, ", ", 2);
+  size_t first_length = last - 1 - key;
+  memcpy (ret + last_length + 2, key, first_length);
+  size_t end = last_length + 2 + first_length;
+  if (suffix)
+    {
+    ret[end++] = ' ';
+    memcpy (ret + end, suffix, key + n - suffix);
+    end += key + n - suffix;
+    }
+  ret[end] = 0;
+  ebi_free (key);
+  return ret;
+  }
+
+
+/*============================================================================
+find_articles
+The articles for a language code like "en", "fre" or "de-AT"
+============================================================================*/
+static const char **find_articles (const char *language)
+  {
+  if (!language) return articles[0] + 1;
+  char code[4];
+  size_t n = 0;
+  while (n < 3 && ((language[n] >= 'a' && language[n] <= 'z')
+      || (language[n] >= 'A' && language[n] <= 'Z')))
+    {
+    code[n] = language[n] | 0x20;
+    n++;
+    }
+  code[n] = 0;
+  size_t i;
+  for (i = 0; n >= 2 && i < N_LANGUAGES; i++)
+    {
+    const char *codes = articles[i][0];
+    const char *found = strstr (codes, code);
+    if (found && (found == codes || found[-1] == ' ')
+        && (found[n] == 0 || found[n] == ' '))
+      return articles[i] + 1;
+    }
+  return articles[0] + 1;
+  }
+
+
+/*============================================================================
+ebi_sortkey_title
+A title that is nothing but an article keeps it
+============================================================================*/
+char *ebi_sortkey_title (const char *title, size_t length,
+        const char *language)
+  {
+  if (!title) return NULL;
+  length = strnlen (title, length);
+  char *key = ebi_malloc (2 * length + 1);
+  size_t n = fold (title, length, key);
+  const char **a = find_articles (language);
+  char *space = strchr (key, ' ');
+  for (; space && *a; a++)
+    {
+    if (strlen (*a) == (size_t)(space - key)
+        && memcmp (*a, key, space - key) == 0)
+      {
+      memmove (key, space + 1, key + n - space);
+      break;
+      }
+    }
+  return key;
+  }
+
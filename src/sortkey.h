@@ -0,0 +1,36 @@
+/*============================================================================
+ * libebookinfo
+ * sortkey.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <ebookinfo/constants.h>
+
+/*============================================================================
+Sort keys for authors and titles, made once when the metadata is built
+so that sorting is a plain strcmp(). A key is folded to lower case,
+with the accents taken off Latin letters, HTML entities and
+punctuation turned into single spaces, and spaces trimmed. An author
+key is "last, first" -- names that already have a comma are taken to
+be in that form. A title key has any leading article of the book's
+language removed; with no language, English is assumed.
+
+Both take a string that need not be NUL-terminated, and return an
+ebi_malloc()'d key, or NULL for a NULL string
+============================================================================*/
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+char *ebi_sortkey_author (const char *author, size_t length);
+char *ebi_sortkey_title (const char *title, size_t length,
+        const char *language);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
@@ -0,0 +1,163 @@
+/*============================================================================
+ * libebookinfo
+ * source.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ebookinfo/constants.h>
+#include "source.h"
+#include "alloc.h"
+#include "stats.h"
+
+// The most read from a descriptor that can't be mapped, such as a pipe
+//  or socket. Book contents are indexed with ints further on, so this
+//  is also the most that could be used
+#define MAX_READ_LENGTH INT_MAX
+
+
+/*============================================================================
+read_all
+Read fd to EOF into a buffer from ebi_malloc(), for descriptors that can't 
+be mapped. Fails once MAX_READ_LENGTH bytes have been read without 
+reaching EOF
+============================================================================*/
+static BOOL read_all (EBookSource *self, int fd, char **error)
+  {
+  size_t size = 65536, length = 0;
+  unsigned char *buff = ebi_malloc (size);
+  while (1)
+    {
+    if (length == size)
+      {
+      if (size >= MAX_READ_LENGTH)
+        {
+        asprintf (error, "Input is too large: no end after %d bytes", 
+          MAX_READ_LENGTH);
+        ebi_free (buff);
+        return FALSE;
+        }
+      size = size > MAX_READ_LENGTH / 2 ? MAX_READ_LENGTH : size * 2;
+      unsigned char *bigger = ebi_realloc (buff, size);
+      if (!bigger)
+        {
+        asprintf (error, "Out of memory reading input");
+        ebi_free (buff);
+        return FALSE;
+        }
+      buff = bigger;
+      }
+    ssize_t n = read (fd, buff + length, size - length);
+    self->syscalls++;
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0)
+      {
+      asprintf (error, "%s", strerror (errno));
+      ebi_free (buff);
+      return FALSE;
+      }
+    if (n == 0) break;
+    length += n;
+    }
+  self->data = buff;
+  self->length = length;
+  self->owned = TRUE;
+  return TRUE;
+  }
+
+
+/*============================================================================
+ebooksource_open_fd
+The caller keeps ownership of fd, and may close it as soon as this
+returns
+============================================================================*/
+BOOL ebooksource_open_fd (EBookSource *self, int fd, char **error)
+  {
+  memset (self, 0, sizeof (EBookSource));
+
+  struct stat sb;
+  self->syscalls++;
+  if (fstat (fd, &sb) != 0)
+    {
+    asprintf (error, "%s", strerror (errno));
+    return FALSE;
+    }
+
+  if (S_ISREG (sb.st_mode))
+    {
+    if (sb.st_size == 0) return TRUE;
+    void *p = mmap (NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    self->syscalls++;
+    if (p != MAP_FAILED)
+      {
+      self->data = p;
+      self->length = sb.st_size;
+      self->mapped = TRUE;
+      return TRUE;
+      }
+    }
+
+  return read_all (self, fd, error);
+  }
+
+
+/*============================================================================
+ebooksource_open_file
+============================================================================*/
+BOOL ebooksource_open_file (EBookSource *self, const char *filename, 
+       char **error)
+  {
+  memset (self, 0, sizeof (EBookSource));
+
+  int f = open (filename, O_RDONLY);
+  if (f < 0)
+    {
+    asprintf (error, "%s", strerror (errno));
+    return FALSE;
+    }
+  BOOL ret = ebooksource_open_fd (self, f, error);
+  close (f);
+  self->syscalls += 2;
+  if (ret) self->name = ebi_strdup (filename);
+  return ret;
+  }
+
+
+/*============================================================================
+ebooksource_open_memory
+The caller keeps ownership of buf, which must stay valid until the
+source is closed
+============================================================================*/
+void ebooksource_open_memory (EBookSource *self, const void *buf, 
+       size_t length)
+  {
+  memset (self, 0, sizeof (EBookSource));
+  self->data = buf;
+  self->length = length;
+  }
+
+
+/*============================================================================
+ebooksource_close
+============================================================================*/
+void ebooksource_close (EBookSource *self)
+  {
+  if (self->mapped)
+    {
+    munmap ((void *)self->data, self->length);
+    EBI_STATS_COUNT (syscalls, 1);
+    }
+  if (self->owned) ebi_free ((void *)self->data);
+  if (self->name) ebi_free (self->name);
+  memset (self, 0, sizeof (EBookSource));
+  }
+
+
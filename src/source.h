@@ -0,0 +1,47 @@
+/*============================================================================
+ * libebookinfo
+ * source.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebook.h>
+
+/*============================================================================
+An EBookSource is the complete contents of an e-book as one read-only
+run of bytes. Files and file descriptors are mapped into memory, or
+read into a buffer if they can't be mapped (pipes, sockets); memory
+supplied by the caller is used in place. Format handlers only ever
+see the bytes, never the file.
+============================================================================*/
+typedef struct _EBookSource
+  {
+  const unsigned char *data;
+  size_t length;
+  char *name;        // For error messages: the filename, if there is one
+  BOOL mapped;       // data must be munmap()'d
+  BOOL owned;        // data must be ebi_free()'d
+  int syscalls;      // Made in opening, for the stats
+  } EBookSource;
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+BOOL ebooksource_open_file (EBookSource *self, const char *filename, 
+       char **error);
+BOOL ebooksource_open_fd (EBookSource *self, int fd, char **error);
+void ebooksource_open_memory (EBookSource *self, const void *buf, 
+       size_t length);
+void ebooksource_close (EBookSource *self);
+
+const EBookSource *ebook_get_source (const EBook *self);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
+
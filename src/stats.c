@@ -0,0 +1,198 @@
+/*============================================================================
+ * libebookinfo
+ * stats.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/ebook.h>
+#include <ebookinfo/stats.h>
+#include "stats.h"
+
+/*============================================================================
+Each thread that counts anything gets a block, linked into a global
+list so that ebook_stats_get() can find it. Only linking and unlinking
+take the lock. A reader may see a counter part-way through an update
+from another thread, which is fine for statistics. When a thread
+exits, its counts are folded into retired and its block is freed
+============================================================================*/
+typedef struct _StatsBlock
+  {
+  EBookStats stats;
+  struct _StatsBlock *next;
+  struct _StatsBlock *prev;
+  } StatsBlock;
+
+BOOL ebi_stats_enabled = FALSE;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static StatsBlock *blocks;
+static EBookStats retired;
+
+static __thread StatsBlock *local;
+static __thread int current_type = EBOOK_TYPE_UNKNOWN;
+
+static const char *phase_names[EBOOK_N_PHASES] =
+  { "sniff", "open", "metadata", "close" };
+
+
+/*============================================================================
+add_stats
+============================================================================*/
+static void add_stats (EBookStats *to, const EBookStats *from)
+  {
+  // Every member is an unsigned long long, so the structure can be
+  //  added up as an array
+  unsigned long long *t = (unsigned long long *)to;
+  const unsigned long long *f = (const unsigned long long *)from;
+  size_t i, n = sizeof (EBookStats) / sizeof (unsigned long long);
+  for (i = 0; i < n; i++) t[i] += f[i];
+  }
+
+
+/*============================================================================
+retire_block
+pthread key destructor, called when a thread exits
+============================================================================*/
+static void retire_block (void *p)
+  {
+  StatsBlock *block = p;
+  pthread_mutex_lock (&lock);
+  add_stats (&retired, &block->stats);
+  if (block->prev) block->prev->next = block->next;
+  else blocks = block->next;
+  if (block->next) block->next->prev = block->prev;
+  pthread_mutex_unlock (&lock);
+  free (block);
+  }
+
+
+/*============================================================================
+make_key
+============================================================================*/
+static void make_key (void)
+  {
+  pthread_key_create (&key, retire_block);
+  }
+
+
+/*============================================================================
+ebi_stats_for
+This thread's counters for a format
+============================================================================*/
+EBookFormatStats *ebi_stats_for (int type)
+  {
+  if (!local)
+    {
+    pthread_once (&key_once, make_key);
+    local = calloc (1, sizeof (StatsBlock));
+    pthread_mutex_lock (&lock);
+    local->next = blocks;
+    if (blocks) blocks->prev = local;
+    blocks = local;
+    pthread_mutex_unlock (&lock);
+    pthread_setspecific (key, local);
+    }
+  if (type < 0 || type >= EBOOK_STATS_UNKNOWN) type = EBOOK_STATS_UNKNOWN;
+  return &local->stats.formats[type];
+  }
+
+
+/*============================================================================
+ebi_stats_set_format
+============================================================================*/
+void ebi_stats_set_format (int type)
+  {
+  current_type = type;
+  }
+
+
+/*============================================================================
+ebi_stats_format
+============================================================================*/
+int ebi_stats_format (void)
+  {
+  return current_type;
+  }
+
+
+/*============================================================================
+ebi_stats_now
+Nanoseconds on the monotonic clock, or 0 if stats are off
+============================================================================*/
+unsigned long long ebi_stats_now (void)
+  {
+  if (!ebi_stats_enabled) return 0;
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+
+/*============================================================================
+ebi_stats_phase
+Count one call of a phase that began at start (from ebi_stats_now())
+============================================================================*/
+void ebi_stats_phase (int type, int phase, unsigned long long start)
+  {
+  if (!ebi_stats_enabled || !start) return;
+  EBookFormatStats *s = ebi_stats_for (type);
+  s->phase_calls[phase]++;
+  s->phase_ns[phase] += ebi_stats_now () - start;
+  }
+
+
+/*============================================================================
+ebook_stats_enable
+============================================================================*/
+void ebook_stats_enable (BOOL enable)
+  {
+  ebi_stats_enabled = enable;
+  }
+
+
+/*============================================================================
+ebook_stats_get
+============================================================================*/
+void ebook_stats_get (EBookStats *stats)
+  {
+  pthread_mutex_lock (&lock);
+  *stats = retired;
+  StatsBlock *b;
+  for (b = blocks; b; b = b->next)
+    add_stats (stats, &b->stats);
+  pthread_mutex_unlock (&lock);
+  }
+
+
+/*============================================================================
+ebook_stats_reset
+Counts being made by other threads at the same moment may survive
+============================================================================*/
+void ebook_stats_reset (void)
+  {
+  pthread_mutex_lock (&lock);
+  memset (&retired, 0, sizeof (retired));
+  StatsBlock *b;
+  for (b = blocks; b; b = b->next)
+    memset (&b->stats, 0, sizeof (EBookStats));
+  pthread_mutex_unlock (&lock);
+  }
+
+
+/*============================================================================
+ebook_phase_name
+============================================================================*/
+const char *ebook_phase_name (int phase)
+  {
+  if (phase < 0 || phase >= EBOOK_N_PHASES) return "unknown";
+  return phase_names[phase];
+  }
+
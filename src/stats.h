@@ -0,0 +1,40 @@
+/*============================================================================
+ * libebookinfo
+ * stats.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <ebookinfo/constants.h>
+#include <ebookinfo/stats.h>
+
+/*============================================================================
+Internal side of the stats. Code that does not know which format it is
+working for -- the ZIP reader, the XML parser -- counts against the
+thread's current format, which ebook.c sets around each call into a
+format handler. Everything is guarded by ebi_stats_enabled, so that
+the cost when stats are off is one test
+============================================================================*/
+
+extern BOOL ebi_stats_enabled;
+
+#define EBI_STATS_COUNT(field, n) \
+  do { if (ebi_stats_enabled) \
+    ebi_stats_for (ebi_stats_format ())->field += (n); } while (0)
+
+#ifdef __CPLUSPLUS
+extern "C" {
+#endif
+
+EBookFormatStats   *ebi_stats_for (int type);
+void                ebi_stats_set_format (int type);
+int                 ebi_stats_format (void);
+unsigned long long  ebi_stats_now (void);
+void                ebi_stats_phase (int type, int phase,
+                      unsigned long long start);
+
+#ifdef __CPLUSPLUS
+}
+#endif
+
@@ -0,0 +1,238 @@
+/*============================================================================
+ * libebookinfo
+ * stringpool.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/stringpool.h>
+#include "alloc.h"
+
+/*============================================================================
+The pool is split into shards by the top bits of each string's hash,
+and each shard has its own lock, hash table and blocks of storage, so
+threads interning different strings seldom wait for one another. The
+tables use open addressing, and keep each string's hash beside it, so
+that a probe seldom has to look at the string itself. Tables and
+blocks start small and double as a shard fills, so that a pool for a
+few books costs little more than the strings
+============================================================================*/
+#define SHARD_BITS 6
+#define N_SHARDS (1 << SHARD_BITS)
+#define FIRST_BLOCK_SIZE 512
+#define BLOCK_SIZE 65536
+#define FIRST_TABLE_SIZE 16
+
+typedef struct _Block
+  {
+  struct _Block *next;
+  size_t used;
+  size_t size;
+  char data[];
+  } Block;
+
+typedef struct _Slot
+  {
+  const char *s;
+  uint64_t hash;
+  } Slot;
+
+typedef struct _Shard
+  {
+  pthread_mutex_t lock;
+  Slot *slots;
+  size_t size;
+  size_t n;
+  Block *blocks;
+  size_t block_size;         // Of the last shared block made
+  size_t bytes;
+  } Shard;
+
+struct _EBookStringPool
+  {
+  Shard shards[N_SHARDS];
+  };
+
+
+/*============================================================================
+hash_string
+FNV-1a
+============================================================================*/
+static uint64_t hash_string (const char *s, size_t length)
+  {
+  uint64_t h = 14695981039346656037ULL;
+  size_t i;
+  for (i = 0; i < length; i++)
+    {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+    }
+  return h;
+  }
+
+
+/*============================================================================
+ebookstringpool_create
+============================================================================*/
+EBookStringPool *ebookstringpool_create (void)
+  {
+  EBookStringPool *self = ebi_calloc (1, sizeof (EBookStringPool));
+  int i;
+  for (i = 0; i < N_SHARDS; i++)
+    pthread_mutex_init (&self->shards[i].lock, NULL);
+  return self;
+  }
+
+
+/*============================================================================
+ebookstringpool_destroy
+============================================================================*/
+void ebookstringpool_destroy (EBookStringPool *self)
+  {
+  if (!self) return;
+  int i;
+  for (i = 0; i < N_SHARDS; i++)
+    {
+    Shard *shard = &self->shards[i];
+    Block *b = shard->blocks;
+    while (b)
+      {
+      Block *next = b->next;
+      ebi_free (b);
+      b = next;
+      }
+    if (shard->slots) ebi_free (shard->slots);
+    pthread_mutex_destroy (&shard->lock);
+    }
+  ebi_free (self);
+  }
+
+
+/*============================================================================
+store
+Copy a string into the shard's blocks. A string too big to share a
+block well gets one of its own, behind the current one
+============================================================================*/
+static const char *store (Shard *shard, const char *s, size_t length)
+  {
+  Block *b = shard->blocks;
+  if (!b || b->size - b->used < length + 1)
+    {
+    BOOL own = (length + 1 > BLOCK_SIZE / 4);
+    size_t size = length + 1;
+    if (!own)
+      {
+      if (!shard->block_size)
+        shard->block_size = FIRST_BLOCK_SIZE;
+      else if (shard->block_size < BLOCK_SIZE)
+        shard->block_size *= 2;
+      while (shard->block_size < length + 1) shard->block_size *= 2;
+      size = shard->block_size;
+      }
+    Block *nb = ebi_malloc (sizeof (Block) + size);
+    nb->used = 0;
+    nb->size = size;
+    if (b && own)
+      {
+      nb->next = b->next;
+      b->next = nb;
+      }
+    else
+      {
+      nb->next = b;
+      shard->blocks = nb;
+      }
+    shard->bytes += sizeof (Block) + size;
+    b = nb;
+    }
+  char *ret = b->data + b->used;
+  memcpy (ret, s, length);
+  ret[length] = 0;
+  b->used += length + 1;
+  return ret;
+  }
+
+
+/*============================================================================
+grow
+============================================================================*/
+static void grow (Shard *shard)
+  {
+  size_t old_size = shard->size, i;
+  Slot *old = shard->slots;
+  shard->size = old_size ? old_size * 2 : FIRST_TABLE_SIZE;
+  shard->slots = ebi_calloc (shard->size, sizeof (Slot));
+  for (i = 0; i < old_size; i++)
+    {
+    if (!old[i].s) continue;
+    size_t j = old[i].hash & (shard->size - 1);
+    while (shard->slots[j].s) j = (j + 1) & (shard->size - 1);
+    shard->slots[j] = old[i];
+    }
+  if (old) ebi_free (old);
+  shard->bytes += (shard->size - old_size) * sizeof (Slot);
+  }
+
+
+/*============================================================================
+ebookstringpool_intern
+============================================================================*/
+const char *ebookstringpool_intern (EBookStringPool *self, const char *s,
+         size_t length)
+  {
+  if (!s) return NULL;
+  length = strnlen (s, length);
+  uint64_t hash = hash_string (s, length);
+  Shard *shard = &self->shards[hash >> (64 - SHARD_BITS)];
+  const char *ret = NULL;
+
+  pthread_mutex_lock (&shard->lock);
+  if (2 * (shard->n + 1) > shard->size) grow (shard);
+  size_t j = hash & (shard->size - 1);
+  while (shard->slots[j].s)
+    {
+    const Slot *slot = &shard->slots[j];
+    if (slot->hash == hash && strncmp (slot->s, s, length) == 0
+        && slot->s[length] == 0)
+      {
+      ret = slot->s;
+      break;
+      }
+    j = (j + 1) & (shard->size - 1);
+    }
+  if (!ret)
+    {
+    ret = store (shard, s, length);
+    shard->slots[j].s = ret;
+    shard->slots[j].hash = hash;
+    shard->n++;
+    }
+  pthread_mutex_unlock (&shard->lock);
+  return ret;
+  }
+
+
+/*============================================================================
+ebookstringpool_get_stats
+============================================================================*/
+void ebookstringpool_get_stats (EBookStringPool *self, size_t *strings,
+       size_t *bytes)
+  {
+  size_t n = 0, b = sizeof (EBookStringPool);
+  int i;
+  for (i = 0; i < N_SHARDS; i++)
+    {
+    Shard *shard = &self->shards[i];
+    pthread_mutex_lock (&shard->lock);
+    n += shard->n;
+    b += shard->bytes;
+    pthread_mutex_unlock (&shard->lock);
+    }
+  if (strings) *strings = n;
+  if (bytes) *bytes = b;
+  }
+
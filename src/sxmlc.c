@@ -26,6 +26,8 @@
 #include <ctype.h>
 #include "sxmlutils.h"
 #include "sxmlc.h"
+#include "stats.h" /* libebookinfo */
+#include "cancel.h" /* libebookinfo */
 
 /*
  Struct defining "special" tags such as "<? ?>" or "<![CDATA[ ]]/>".
@@ -1026,6 +1028,7 @@ static int _parse_data_SAX(void* in, const DataSourceType in_type, const SAX_Cal
 	(void)XMLNode_init(&node);
 	while ((n0 = read_line_alloc(in, in_type, &line, &sz, 0, NULC, C2SX('>'), true, C2SX('\n'), &ncr)) != 0) {
 		(void)XMLNode_free(&node);
+		if (EBI_CANCELLED()) { ret = false; break; } /* libebookinfo */
 		for (p = line; *p != NULC && sx_isspace(*p); p++) ; /* Checks if text is only spaces */
 		if (*p == NULC) break;
 		sd->line_num += ncr;
@@ -1090,7 +1093,7 @@ static int _parse_data_SAX(void* in, const DataSourceType in_type, const SAX_Cal
 
 			case TAG_END:
 				if (sax->end_node != NULL || sax->all_event != NULL) {
-					if (sax->end_node != NULL && !sax->end_node(&node, sd)) break;
+					if (sax->end_node != NULL && !sax->end_node(&node, sd)) { exit = true; break; } /* libebookinfo */
 					if (sax->all_event != NULL && !sax->all_event(XML_EVENT_END_NODE, &node, NULL, sd->line_num, sd)) break;
 				}
 				break;
@@ -1124,10 +1127,10 @@ static int _parse_data_SAX(void* in, const DataSourceType in_type, const SAX_Cal
 					}
 				}
 				if (ret == false) break;
-				if (sax->start_node != NULL && !sax->start_node(&node, sd)) break;
+				if (sax->start_node != NULL && !sax->start_node(&node, sd)) { exit = true; break; } /* libebookinfo */
 				if (sax->all_event != NULL && !sax->all_event(XML_EVENT_START_NODE, &node, NULL, sd->line_num, sd)) break;
 				if (node.tag_type != TAG_FATHER && (sax->end_node != NULL || sax->all_event != NULL)) {
-					if (sax->end_node != NULL && !sax->end_node(&node, sd)) break;
+					if (sax->end_node != NULL && !sax->end_node(&node, sd)) { exit = true; break; } /* libebookinfo */
 					if (sax->all_event != NULL && !sax->all_event(XML_EVENT_END_NODE, &node, NULL, sd->line_num, sd)) break;
 				}
 			break;
@@ -1176,6 +1179,7 @@ int DOMXMLDoc_node_start(const XMLNode* node, SAX_Data* sd)
 	int i;
 
 	if ((new_node = XMLNode_dup(node, true)) == NULL) goto node_start_err; /* No real need to put 'true' for 'XMLNode_dup', but cleaner */
+	EBI_STATS_COUNT(xml_nodes, 1); /* libebookinfo */
 	
 	if (dom->current == NULL) {
 		if ((i = _add_node(&dom->doc->nodes, &dom->doc->n_nodes, new_node)) < 0) goto node_start_err;
@@ -1374,11 +1378,21 @@ else
 
 int XMLDoc_parse_buffer_SAX(const SXML_CHAR* buffer, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user)
 {
-	DataSourceBuffer dsb = { buffer, 0 };
+	return XMLDoc_parse_buffer_SAX_len(buffer, -1, name, sax, user);
+}
+
+int XMLDoc_parse_buffer_SAX_len(const SXML_CHAR* buffer, int len, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user)
+{
+	DataSourceBuffer dsb = { buffer, 0, len };
 	SAX_Data sd;
 
 	if (sax == NULL || buffer == NULL) return false;
 
+	/* Skip a UTF-8 BOM, as XMLDoc_parse_file_SAX does (libebookinfo) */
+	if ((len < 0 || len >= 3) && (unsigned char)buffer[0] == 0xEF
+		&& (unsigned char)buffer[1] == 0xBB && (unsigned char)buffer[2] == 0xBF)
+		dsb.cur_pos = 3;
+
 	sd.name = name;
 	sd.user = user;
 	return _parse_data_SAX((void*)&dsb, DATA_SOURCE_BUFFER, sax, &sd);
@@ -1423,6 +1437,11 @@ int XMLDoc_parse_file_DOM(const SXML_CHAR* filename, XMLDoc* doc)
 }
 
 int XMLDoc_parse_buffer_DOM(const SXML_CHAR* buffer, const SXML_CHAR* name, XMLDoc* doc)
+{
+	return XMLDoc_parse_buffer_DOM_len(buffer, -1, name, doc);
+}
+
+int XMLDoc_parse_buffer_DOM_len(const SXML_CHAR* buffer, int len, const SXML_CHAR* name, XMLDoc* doc)
 {
 	DOM_through_SAX dom;
 	SAX_Callbacks sax;
@@ -1433,5 +1452,5 @@ int XMLDoc_parse_buffer_DOM(const SXML_CHAR* buffer, const SXML_CHAR* name, XMLD
 	dom.current = NULL;
 	SAX_Callbacks_init_DOM(&sax);
 
-	return XMLDoc_parse_buffer_SAX(buffer, name, &sax, &dom) ? true : XMLDoc_free(doc);
+	return XMLDoc_parse_buffer_SAX_len(buffer, len, name, &sax, &dom) ? true : XMLDoc_free(doc);
 }
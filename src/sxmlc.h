@@ -545,6 +545,12 @@ int XMLDoc_parse_file_DOM(const SXML_CHAR* filename, XMLDoc* doc);
  */
 int XMLDoc_parse_buffer_DOM(const SXML_CHAR* buffer, const SXML_CHAR* name, XMLDoc* doc);
 
+/*
+ As 'XMLDoc_parse_buffer_DOM', but reads at most 'len' characters from 'buffer', which then
+ need not be 0-terminated. A negative 'len' means 'buffer' is 0-terminated.
+ */
+int XMLDoc_parse_buffer_DOM_len(const SXML_CHAR* buffer, int len, const SXML_CHAR* name, XMLDoc* doc);
+
 /*
  Parse an XML document from a given 'filename', calling SAX callbacks given in the 'sax' structure.
  'user' is a user-given pointer that will be given back to all callbacks.
@@ -560,6 +566,12 @@ int XMLDoc_parse_file_SAX(const SXML_CHAR* filename, const SAX_Callbacks* sax, v
  */
 int XMLDoc_parse_buffer_SAX(const SXML_CHAR* buffer, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user);
 
+/*
+ As 'XMLDoc_parse_buffer_SAX', but reads at most 'len' characters from 'buffer', which then
+ need not be 0-terminated. A negative 'len' means 'buffer' is 0-terminated.
+ */
+int XMLDoc_parse_buffer_SAX_len(const SXML_CHAR* buffer, int len, const SXML_CHAR* name, const SAX_Callbacks* sax, void* user);
+
 /*
  Parse an XML file using the DOM implementation.
  */
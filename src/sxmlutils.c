@@ -82,7 +82,7 @@ static struct _html_special_dict {
 
 int _bgetc(DataSourceBuffer* ds)
 {
-	if (ds == NULL || ds->buf[ds->cur_pos] == NULC) return EOF;
+	if (ds == NULL || (ds->len >= 0 && ds->cur_pos >= ds->len) || ds->buf[ds->cur_pos] == NULC) return EOF;
 	
 	return (int)(ds->buf[ds->cur_pos++]);
 }
@@ -90,7 +90,7 @@ int _bgetc(DataSourceBuffer* ds)
 int _beob(DataSourceBuffer* ds)
 {
 
-	if (ds == NULL || ds->buf[ds->cur_pos] == NULC) return true;
+	if (ds == NULL || (ds->len >= 0 && ds->cur_pos >= ds->len) || ds->buf[ds->cur_pos] == NULC) return true;
 
 	return false;
 }
@@ -82,12 +82,15 @@ void* __realloc(void* mem, size_t sz);
 void __free(void* mem);
 char* __strdup(const char* s);
 #else
-#define __malloc malloc
-#define __calloc calloc
-#define __realloc realloc
-#define __free free
+// libebookinfo: route the parser's allocations through the library's
+//  allocator
+#include "alloc.h"
+#define __malloc ebi_malloc
+#define __calloc ebi_calloc
+#define __realloc ebi_realloc
+#define __free ebi_free
 #undef __strdup
-#define __strdup strdup
+#define __strdup ebi_strdup
 #endif
 
 #ifndef MEM_INCR_RLA
@@ -108,11 +111,13 @@ char* __strdup(const char* s);
 
 /*
  Buffer data source used by 'read_line_alloc' when required.
- 'buf' should be 0-terminated.
+ 'buf' should be 0-terminated, unless 'len' is not negative, in which case
+ reading stops after 'len' characters.
  */
 typedef struct _DataSourceBuffer {
 	const SXML_CHAR* buf;
 	int cur_pos;
+	int len;
 } DataSourceBuffer;
 
 typedef FILE* DataSourceFile;
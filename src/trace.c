@@ -0,0 +1,207 @@
+/*============================================================================
+ * libebookinfo
+ * trace.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/trace.h>
+#include "trace.h"
+
+/*============================================================================
+Each thread records into a list of fixed-size chunks that only it
+appends to. The first time a thread records anything, it pushes its
+list onto a global stack with a compare-and-swap, so recording never
+takes a lock. Chunks are never freed; a trace is expected to be
+written once, at the end of a run
+============================================================================*/
+#define EVENTS_PER_CHUNK 4096
+
+typedef struct _TraceEvent
+  {
+  unsigned long long ts;
+  const char *name;      // NULL for the end of a span
+  char *arg;
+  } TraceEvent;
+
+typedef struct _TraceChunk
+  {
+  TraceEvent events[EVENTS_PER_CHUNK];
+  int n;
+  struct _TraceChunk *next;
+  } TraceChunk;
+
+typedef struct _TraceThread
+  {
+  int tid;
+  int index;
+  TraceChunk *first;
+  TraceChunk *last;
+  struct _TraceThread *next;
+  } TraceThread;
+
+BOOL ebi_trace_enabled = FALSE;
+
+static TraceThread *threads;
+static int n_threads;
+static unsigned long long base_ts;
+static __thread TraceThread *local;
+
+
+/*============================================================================
+now
+============================================================================*/
+static unsigned long long now (void)
+  {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+
+/*============================================================================
+add_event
+============================================================================*/
+static void add_event (const char *name, const char *arg)
+  {
+  if (!local)
+    {
+    local = calloc (1, sizeof (TraceThread));
+    local->tid = syscall (SYS_gettid);
+    local->index = __atomic_fetch_add (&n_threads, 1, __ATOMIC_RELAXED);
+    local->next = __atomic_load_n (&threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n (&threads, &local->next, local,
+         TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+    }
+  TraceChunk *chunk = local->last;
+  if (!chunk || chunk->n == EVENTS_PER_CHUNK)
+    {
+    chunk = malloc (sizeof (TraceChunk));
+    chunk->n = 0;
+    chunk->next = NULL;
+    if (local->last) local->last->next = chunk;
+    else local->first = chunk;
+    local->last = chunk;
+    }
+  TraceEvent *e = &chunk->events[chunk->n++];
+  e->ts = now ();
+  e->name = name;
+  e->arg = arg ? strdup (arg) : NULL;
+  }
+
+
+/*============================================================================
+ebook_trace_enable
+============================================================================*/
+void ebook_trace_enable (BOOL enable)
+  {
+  if (enable && !base_ts) base_ts = now ();
+  ebi_trace_enabled = enable;
+  }
+
+
+/*============================================================================
+ebook_trace_begin
+============================================================================*/
+void ebook_trace_begin (const char *name, const char *arg)
+  {
+  if (ebi_trace_enabled) add_event (name, arg);
+  }
+
+
+/*============================================================================
+ebook_trace_end
+============================================================================*/
+void ebook_trace_end (void)
+  {
+  if (ebi_trace_enabled) add_event (NULL, NULL);
+  }
+
+
+/*============================================================================
+write_json_string
+============================================================================*/
+static void write_json_string (FILE *f, const char *s)
+  {
+  fputc ('"', f);
+  for (; *s; s++)
+    {
+    unsigned char c = *s;
+    if (c == '"' || c == '\\')
+      fprintf (f, "\\%c", c);
+    else if (c < 0x20)
+      fprintf (f, "\\u%04x", c);
+    else
+      fputc (c, f);
+    }
+  fputc ('"', f);
+  }
+
+
+/*============================================================================
+ebook_trace_write
+============================================================================*/
+BOOL ebook_trace_write (const char *filename, char **error)
+  {
+  FILE *f = fopen (filename, "w");
+  if (!f)
+    {
+    asprintf (error, "Can't write trace %s: %s", filename, strerror (errno));
+    return FALSE;
+    }
+
+  int pid = getpid ();
+  fprintf (f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf (f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+    "\"args\":{\"name\":\"ebookinfo\"}}", pid);
+
+  TraceThread *t;
+  for (t = __atomic_load_n (&threads, __ATOMIC_ACQUIRE); t; t = t->next)
+    {
+    fprintf (f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+      "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", pid, t->tid,
+      t->index);
+    TraceChunk *c;
+    for (c = t->first; c; c = c->next)
+      {
+      int i;
+      for (i = 0; i < c->n; i++)
+        {
+        const TraceEvent *e = &c->events[i];
+        double ts = (e->ts - base_ts) / 1000.0;
+        if (e->name)
+          {
+          fprintf (f, ",\n{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%.3f,"
+            "\"pid\":%d,\"tid\":%d", e->name, ts, pid, t->tid);
+          if (e->arg)
+            {
+            fprintf (f, ",\"args\":{\"arg\":");
+            write_json_string (f, e->arg);
+            fprintf (f, "}");
+            }
+          fprintf (f, "}");
+          }
+        else
+          fprintf (f, ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+            ts, pid, t->tid);
+        }
+      }
+    }
+
+  fprintf (f, "\n]}\n");
+  if (fclose (f) != 0)
+    {
+    asprintf (error, "Can't write trace %s: %s", filename, strerror (errno));
+    return FALSE;
+    }
+  return TRUE;
+  }
+
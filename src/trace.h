@@ -0,0 +1,20 @@
+/*============================================================================
+ * libebookinfo
+ * trace.h
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+#pragma once
+
+#include <ebookinfo/constants.h>
+#include <ebookinfo/trace.h>
+
+extern BOOL ebi_trace_enabled;
+
+// Spans inside the library. Like the stats, these cost one test when
+//  tracing is off
+#define EBI_TRACE_BEGIN(name, arg) \
+  do { if (ebi_trace_enabled) ebook_trace_begin ((name), (arg)); } while (0)
+#define EBI_TRACE_END() \
+  do { if (ebi_trace_enabled) ebook_trace_end (); } while (0)
+
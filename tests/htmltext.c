@@ -0,0 +1,165 @@
+/*============================================================================
+ * libebookinfo
+ * htmltext.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+/*============================================================================
+Tests for the HTML-to-text converter: tags, entities, whitespace,
+paragraph and line breaks, skipped elements, and '<' and '&' that are
+not markup. Each case is converted whole and also fed a byte at a
+time, so that nothing depends on where the input is split. Runs of
+text much longer than the converter's output buffer must come out
+whole too
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ebookinfo/constants.h>
+#include <ebookinfo/htmltext.h>
+
+#define LONG_RUN 20000
+
+static int failures = 0;
+
+typedef struct _Case
+  {
+  const char *name;
+  const char *html;
+  const char *text;
+  } Case;
+
+static const Case cases[] =
+  {
+  { "plain text", "Just some text", "Just some text" },
+  { "tags stripped", "<b>Bold</b> and <i class=\"x\">italic</i>", 
+    "Bold and italic" },
+  { "quoted '>' in attribute", "<a title=\"a > b\">link</a>", "link" },
+  { "named entities", "Fish &amp; chips &lt;3 &quot;yes&quot;", 
+    "Fish & chips <3 \"yes\"" },
+  { "numeric entities", "caf&#233; &#x2014; &#8230;", 
+    "caf\xc3\xa9 \xe2\x80\x94 \xe2\x80\xa6" },
+  { "unknown entity kept", "&bogus; &#xZZ;", "&bogus; &#xZZ;" },
+  { "nbsp is a space", "a&nbsp;&nbsp;b", "a b" },
+  { "whitespace collapsed", "  one \n\t two   three  ", "one two three" },
+  { "paragraphs", "<p>One</p>\n<p>Two</p><div>Three</div>", 
+    "One\n\nTwo\n\nThree" },
+  { "line breaks", "one<br>two<br/>three", "one\ntwo\nthree" },
+  { "list items", "<ul><li>a</li><li>b</li></ul>after", 
+    "* a\n* b\n\nafter" },
+  { "paragraph beats line", "a<br><p>b", "a\n\nb" },
+  { "script skipped", "a<script>if (x < 1 && y) { z(); }</script>b", 
+    "ab" },
+  { "style skipped", "<style>p { color: red }</style>text", "text" },
+  { "comment skipped", "a<!-- <p> -- not text -->b", "ab" },
+  { "processing instruction", "<?xml version=\"1.0\"?>text", "text" },
+  { "bare '<' before space", "Ages 3 < 7 and more. Great book", 
+    "Ages 3 < 7 and more. Great book" },
+  { "bare '<' before digit", "x<3 y", "x<3 y" },
+  { "bare '<' at end", "less <", "less <" },
+  { "bare '&'", "Tom & Jerry & Co", "Tom & Jerry & Co" },
+  { "bare '&' at end", "this &", "this &" },
+  { NULL, NULL, NULL }
+  };
+
+
+/*============================================================================
+check
+============================================================================*/
+static void check (const char *name, const char *got, const char *expected)
+  {
+  if (strcmp (got, expected) == 0)
+    printf ("ok     %s\n", name);
+  else
+    {
+    if (strlen (got) < 100 && strlen (expected) < 100)
+      printf ("FAILED %s: got \"%s\", expected \"%s\"\n", name, got, 
+        expected);
+    else
+      printf ("FAILED %s: got %zu bytes, expected %zu\n", name, 
+        strlen (got), strlen (expected));
+    failures++;
+    }
+  }
+
+
+/*============================================================================
+string_sink
+============================================================================*/
+typedef struct _Collected
+  {
+  char *s;
+  size_t length;
+  } Collected;
+
+static void string_sink (const char *text, size_t length, void *user)
+  {
+  Collected *c = user;
+  c->s = realloc (c->s, c->length + length + 1);
+  memcpy (c->s + c->length, text, length);
+  c->length += length;
+  c->s[c->length] = 0;
+  }
+
+
+/*============================================================================
+main
+============================================================================*/
+int main (int argc, char **argv)
+  {
+  const Case *t;
+  for (t = cases; t->name; t++)
+    {
+    char *text = ebookhtmltext_convert (t->html);
+    check (t->name, text, t->text);
+    free (text);
+
+    Collected c = { strdup (""), 0 };
+    EBookHTMLText *h = ebookhtmltext_create (string_sink, &c);
+    const char *p;
+    for (p = t->html; *p; p++)
+      ebookhtmltext_feed (h, p, 1);
+    ebookhtmltext_finish (h);
+    ebookhtmltext_destroy (h);
+    char *name;
+    asprintf (&name, "%s, a byte at a time", t->name);
+    check (name, c.s, t->text);
+    free (name);
+    free (c.s);
+    }
+
+  char *run = malloc (LONG_RUN + 1);
+  memset (run, 'x', LONG_RUN);
+  run[LONG_RUN] = 0;
+
+  // A single run, longer than the output buffer
+  char *text = ebookhtmltext_convert (run);
+  check ("long run", text, run);
+  free (text);
+
+  // The same, after buffered text and inside markup
+  char *html, *expected;
+  asprintf (&html, "<p>start</p><p>%s</p><p>end &amp; %s</p>", run, run);
+  asprintf (&expected, "start\n\n%s\n\nend & %s", run, run);
+  text = ebookhtmltext_convert (html);
+  check ("long runs in markup", text, expected);
+  free (text);
+
+  // Fed in pieces, so that runs straddle calls to feed
+  Collected c = { strdup (""), 0 };
+  EBookHTMLText *h = ebookhtmltext_create (string_sink, &c);
+  size_t i, length = strlen (html);
+  for (i = 0; i < length; i += 777)
+    ebookhtmltext_feed (h, html + i, length - i < 777 ? length - i : 777);
+  ebookhtmltext_finish (h);
+  ebookhtmltext_destroy (h);
+  check ("long runs fed in pieces", c.s, expected);
+  free (c.s);
+
+  free (html);
+  free (expected);
+  free (run);
+  return failures ? 1 : 0;
+  }
+
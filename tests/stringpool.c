@@ -0,0 +1,181 @@
+/*============================================================================
+ * libebookinfo
+ * stringpool.c
+ * Copyright (c)2017 Kevin Boone. GPLv3.0
+============================================================================*/
+
+/*============================================================================
+Tests for the string pool. Two books by the same author, read through
+one pool, must get the very same author and genre strings; and
+threads interning the same strings, directly and by reading books, 
+must all get the same pointers. The books are small RTF documents
+held in memory
+============================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <ebookinfo/ebookinfo.h>
+
+#define N_THREADS 8
+#define N_STRINGS 100
+#define ROUNDS    50
+
+static int failures = 0;
+static EBookStringPool *pool;
+static const char *interned[N_THREADS][N_STRINGS];
+
+
+/*============================================================================
+check
+============================================================================*/
+static void check (const char *name, BOOL ok)
+  {
+  printf ("%s %s\n", ok ? "ok    " : "FAILED", name);
+  if (!ok) failures++;
+  }
+
+
+/*============================================================================
+read_rtf
+The metadata of an RTF book with the given title, author and subject,
+read through pool, which may be NULL
+============================================================================*/
+static EBookMetadata *read_rtf (EBookStringPool *pool, const char *title,
+    const char *author, const char *subject)
+  {
+  char *rtf, *error = NULL;
+  asprintf (&rtf, "{\\rtf1{\\info{\\title %s}{\\author %s}{\\subject %s}}"
+    "Text}", title, author, subject);
+  EBook *ebook = ebook_open_memory (rtf, strlen (rtf), &error);
+  EBookMetadata *ret = NULL;
+  if (ebook)
+    {
+    ebook_set_string_pool (ebook, pool);
+    ret = ebook_get_metadata (ebook, &error);
+    ebook_close (ebook);
+    }
+  if (!ret)
+    {
+    printf ("Can't read test book: %s\n", error);
+    exit (1);
+    }
+  free (rtf);
+  return ret;
+  }
+
+
+/*============================================================================
+same_author
+============================================================================*/
+static void same_author (void)
+  {
+  EBookStringPool *pool = ebookstringpool_create ();
+  EBookMetadata *a = read_rtf (pool, "Emma", "Jane Austen", "Fiction");
+  EBookMetadata *b = read_rtf (pool, "Persuasion", "Jane Austen", 
+    "Fiction");
+  check ("same author, same pointer", ebookmetadata_get_author (a) 
+    == ebookmetadata_get_author (b));
+  check ("same genre, same pointer", ebookmetadata_get_genre (a) 
+    == ebookmetadata_get_genre (b));
+  check ("author is the pool's", ebookmetadata_get_author (a)
+    == ebookstringpool_intern (pool, "Jane Austen", -1));
+  check ("titles still differ", 
+    strcmp (ebookmetadata_get_title (a), "Emma") == 0
+    && strcmp (ebookmetadata_get_title (b), "Persuasion") == 0);
+  ebookmetadata_destroy (a);
+  ebookmetadata_destroy (b);
+
+  a = read_rtf (NULL, "Emma", "Jane Austen", "Fiction");
+  b = read_rtf (NULL, "Persuasion", "Jane Austen", "Fiction");
+  check ("without a pool, separate copies", ebookmetadata_get_author (a) 
+    != ebookmetadata_get_author (b) 
+    && strcmp (ebookmetadata_get_author (a), 
+         ebookmetadata_get_author (b)) == 0);
+  ebookmetadata_destroy (a);
+  ebookmetadata_destroy (b);
+  ebookstringpool_destroy (pool);
+  }
+
+
+/*============================================================================
+worker
+Intern the same strings as every other thread, in a different order,
+and read books by the same authors
+============================================================================*/
+static void *worker (void *arg)
+  {
+  int t = (int)(long)arg - 1, r, i;
+  BOOL ok = TRUE;
+  for (r = 0; r < ROUNDS; r++)
+    for (i = 0; i < N_STRINGS; i++)
+      {
+      int k = (i * 7 + t * 13) % N_STRINGS;
+      char s[32];
+      snprintf (s, sizeof (s), "Author %d", k);
+      const char *p = ebookstringpool_intern (pool, s, -1);
+      if (interned[t][k] && interned[t][k] != p) ok = FALSE;
+      interned[t][k] = p;
+      if (i % 10 == 0)
+        {
+        EBookMetadata *m = read_rtf (pool, "Title", s, "Subject");
+        if (ebookmetadata_get_author (m) != p) ok = FALSE;
+        ebookmetadata_destroy (m);
+        }
+      }
+  return ok ? arg : NULL;
+  }
+
+
+/*============================================================================
+threads
+============================================================================*/
+static void threads (void)
+  {
+  pool = ebookstringpool_create ();
+  pthread_t threads[N_THREADS];
+  BOOL ok = TRUE;
+  int t, i;
+  for (t = 0; t < N_THREADS; t++)
+    pthread_create (&threads[t], NULL, worker, (void *)(long)(t + 1));
+  for (t = 0; t < N_THREADS; t++)
+    {
+    void *ret;
+    pthread_join (threads[t], &ret);
+    if (ret != (void *)(long)(t + 1)) ok = FALSE;
+    }
+  check ("threads agree with themselves and with the books", ok);
+
+  ok = TRUE;
+  for (t = 1; t < N_THREADS; t++)
+    for (i = 0; i < N_STRINGS; i++)
+      if (interned[t][i] != interned[0][i]) ok = FALSE;
+  check ("threads agree with one another", ok);
+
+  // Interning them all again must add nothing
+  size_t before, after;
+  ebookstringpool_get_stats (pool, &before, NULL);
+  for (i = 0; i < N_STRINGS; i++)
+    {
+    char s[32];
+    snprintf (s, sizeof (s), "Author %d", i);
+    if (ebookstringpool_intern (pool, s, -1) != interned[0][i]) ok = FALSE;
+    }
+  ebookstringpool_get_stats (pool, &after, NULL);
+  check ("one copy of each string", ok && before == after 
+    && before >= N_STRINGS);
+  ebookstringpool_destroy (pool);
+  }
+
+
+/*============================================================================
+main
+============================================================================*/
+int main (int argc, char **argv)
+  {
+  same_author ();
+  threads ();
+  return failures ? 1 : 0;
+  }
+